@@ -22,445 +22,594 @@
 #include "globals.hpp"
 #include "util.hpp"
 
-AudioFileManager::AudioFileManager(const std::filesystem::path& filename, ContextData& ctx_data)
-    : m_ctx_data { &ctx_data }
-{
-    open_and_setup(filename);
-    find_stream();
-    stream_open();
-}
+#include <pthread.h>
 
-void AudioFileManager::open_and_setup(const std::filesystem::path& filename)
-{
-    AVDictionary* opt{};
-    av_dict_set(&opt, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
+#include <algorithm>
+#include <cmath>
 
-    AVFormatContext* ctx{};
-    int err = avformat_open_input(&ctx, filename.c_str(), nullptr, &opt);
-    if (err < 0)
-    {
-        av_dict_free(&opt);
-        std::array<char, AV_ERROR_MAX_STRING_SIZE> errBuff { 0 };
+// Start opening the next track once the current one is this close to its end
+static constexpr double PrepareAheadSeconds{ 10.0 };
 
-        util::Log(color::yellow, "avformat_open_input: error code: {}, filename: {}, error msg: {}, errno: {}\n",
-                  err, filename.string(), av_make_error_string(errBuff.data(), AV_ERROR_MAX_STRING_SIZE, err), strerror(errno));
+// The governor never grows the ring beyond this, unless it starts out larger
+static constexpr std::size_t MaxGrownSeconds{ 8 };
 
-        throw std::runtime_error(std::format("Error avformat_open_input, with code: {}, filename: {}, errmsg: {}", err, filename.string(), errBuff.data()));
-    }
-    av_dict_free(&opt);
+// A seek empties the ring, the underruns while it fills up again are ours
+static constexpr std::chrono::seconds SeekSettleTime{ 1 };
 
-    m_ctx_data->format_ctx = std::shared_ptr<AVFormatContext>(ctx, [](AVFormatContext* ptr) { avformat_close_input(&ptr); });
+static RingBuffer MakeRing(const AudioSettings& settings, BufferSettings bufferSettings, std::size_t block)
+{
+    const auto bytes_per_second = BytesPerSecond(settings);
 
-    m_ctx_data->format_ctx->interrupt_callback.callback = +[]([[maybe_unused]] void*)
-    {
-        return static_cast<int>(Globals::stop_request);
-    };
-    m_ctx_data->format_ctx->interrupt_callback.opaque = nullptr;
+    const auto high = bytes_per_second * static_cast<std::size_t>(bufferSettings.high_watermark_ms) / 1000;
+    const auto low  = bytes_per_second * static_cast<std::size_t>(bufferSettings.low_watermark_ms) / 1000;
+
+    // Whole seconds, so the history always ends on a frame boundary
+    const auto history = bytes_per_second * static_cast<std::size_t>(bufferSettings.seek_history_s);
 
-    av_format_inject_global_side_data(m_ctx_data->format_ctx.get());
+    // Room for the largest target the governor may ask for, and
+    // a whole decoded block has to fit on top of that
+    const auto most = std::max(high, std::min(high << BufferGovernor::MaxLevel, bytes_per_second * MaxGrownSeconds));
+    return RingBuffer{ most + block, high, low, history };
 }
 
-void AudioFileManager::find_stream()
+AudioLoop::AudioLoop(const std::filesystem::path& path, PlaybackEngine& engine, std::vector<std::filesystem::path> upcoming, BufferSettings bufferSettings)
+    : m_engine            { engine }
+    , m_producer          { engine.Producer() }
+    , m_read_ahead        { bufferSettings.read_ahead }
+    , m_realtime          { bufferSettings.realtime }
+    , m_affinity          { bufferSettings.affinity }
+    , m_decoder           { std::make_unique<Decoder>(path, engine.Pools(), m_read_ahead) }
+    , m_upcoming          { std::move(upcoming) }
+    , m_audioSettings     { m_decoder->getAudioSettings() }
+    , m_statusView        { engine.Status() }
+    , m_ring              { MakeRing(*m_audioSettings, bufferSettings, m_decoder->BufferCapacity()) }
+    , m_pipewire          { engine.Output(m_audioSettings, bufferSettings.output) }
+    , m_prebuffer         { BytesPerSecond(*m_audioSettings) * static_cast<std::size_t>(bufferSettings.prebuffer_ms) / 1000 }
+    , m_open_timings      { m_decoder->getOpenTimings() }
+    , m_high_watermark_ms { bufferSettings.high_watermark_ms }
+    , m_low_watermark_ms  { bufferSettings.low_watermark_ms }
 {
-    int err = avformat_find_stream_info(m_ctx_data->format_ctx.get(), nullptr);
-    if (err < 0)
-    {
-        throw std::runtime_error("Failed: avformat_find_stream_info");
-    }
+    util::Log(color::green, "Audio loop init init [fmt][freq][nb_ch]: [{}][{}][{}]\n", SampleFormatName(m_audioSettings->fmt), m_audioSettings->freq, m_audioSettings->ch_layout.nb_channels);
+    util::Log(color::green, "Ring buffer capacity: {} bytes, watermarks: [{}ms][{}ms], prebuffer: {}ms\n", m_ring.capacity(), bufferSettings.low_watermark_ms, bufferSettings.high_watermark_ms, bufferSettings.prebuffer_ms);
 
-    if (m_ctx_data->format_ctx->pb)
-        m_ctx_data->format_ctx->pb->eof_reached = 0;
+    // Attached but not started yet, see startStream()
+    m_pipewire.Configure(m_audioSettings, m_ring);
 
-    m_streamIndex = av_find_best_stream(m_ctx_data->format_ctx.get(), AVMEDIA_TYPE_AUDIO, m_streamIndex - 1, m_streamIndex, nullptr, 0);
+    // Whatever the previous loop's governor left behind, this one starts over
+    m_pipewire.set_latency_scale(m_governor.scale());
+    m_statusView.SetBufferTarget(m_high_watermark_ms);
 
-#ifdef DEBUG
-    av_dump_format(m_ctx_data->format_ctx.get(), m_streamIndex, m_ctx_data->format_ctx->url, 0);
-#endif
+    m_statusView.SetFormat(*m_audioSettings);
+    m_statusView.SetTrack(m_decoder->getContextData());
+    m_segments.push_back({ .start = 0, .position = 0, .track = m_decoder->getContextData(), .duration = m_decoder->Duration() });
 
-    if (AVERROR_STREAM_NOT_FOUND == m_streamIndex)
+    if (m_realtime.enabled)
     {
-        throw std::runtime_error(std::format("No streams found in {}\n", m_ctx_data->format_ctx->url));
-    }
-    else if (AVERROR_DECODER_NOT_FOUND == m_streamIndex)
-    {
-        throw std::runtime_error(std::format("Decoder not found in {}\n", m_ctx_data->format_ctx->url));
+        const auto storage = m_ring.storage();
+        m_ring_lock = rt::MemoryLock{ storage.data(), storage.size() };
+        lockDecoder();
     }
 
-    if (m_streamIndex < 0)
-    {
-        throw std::runtime_error("Stream index < 0\n");
-    }
+    if (m_affinity.any())
+        pinThreads();
+
+    if (m_realtime.enabled)
+        enterRealtime();
+
+    // Last, nothing may throw once the producer runs on this
+    m_producer.Run([this](std::stop_token st) { this->producer_loop(st); });
 }
 
-void AudioFileManager::stream_open()
+void AudioLoop::lockDecoder() noexcept
 {
-    m_ctx_data->codec_ctx = std::shared_ptr<AVCodecContext> { avcodec_alloc_context3(nullptr), [](::AVCodecContext* p) { ::avcodec_free_context(&p); } };
+    if (m_realtime.enabled)
+        m_decoder->LockBuffer();
+}
 
-    int ret = avcodec_parameters_to_context(m_ctx_data->codec_ctx.get(), m_ctx_data->format_ctx->streams[m_streamIndex]->codecpar);
-    if (ret < 0)
-    {
-        throw std::runtime_error(std::format("avcodec_parameters_to_context failed with code: {}", ret));
-    }
+void AudioLoop::enterRealtime()
+{
+    // The output has to be able to preempt the producer, never the other way around
+    const bool output   = m_pipewire.PromoteOutput(m_realtime.priority);
+    const auto handle   = m_producer.native_handle();
+    const bool producer = rt::IsRealtime(handle) or Pipewire::AcquireRealtime(handle, m_realtime.priority - 1);
+
+    util::Log(output and producer ? color::green : color::yellow,
+              "Realtime: output {}, producer {}, {} KiB locked\n",
+              output ? "SCHED_FIFO" : "not permitted",
+              producer ? "SCHED_FIFO" : "not permitted",
+              (m_ring_lock.size() + m_decoder->LockedBytes()) / 1024);
+}
 
-    m_ctx_data->codec_ctx->pkt_timebase = m_ctx_data->format_ctx->streams[m_streamIndex]->time_base;
+void AudioLoop::pinThreads()
+{
+    // The producer thread belongs to the engine, it started out on the CPUs of whoever created it
+    const bool producer = rt::Pin(m_producer.native_handle(), m_affinity.producer);
+    const bool pipewire = m_pipewire.PinThreads(m_affinity.pipewire, m_affinity.output);
+
+    util::Log(producer and pipewire ? color::green : color::yellow,
+              "Affinity: producer {}, pipewire {}, output {}{}\n",
+              rt::FormatCpuList(m_affinity.producer),
+              rt::FormatCpuList(m_affinity.pipewire),
+              rt::FormatCpuList(m_affinity.output),
+              producer and pipewire ? "" : ", not all of them could be pinned");
+}
 
-    const auto* codec = avcodec_find_decoder(m_ctx_data->codec_ctx->codec_id);
-    if (!codec)
-    {
-        throw std::runtime_error(std::format("Failed to find decoder for {} codec_id", static_cast<int>(m_ctx_data->codec_ctx->codec_id)));
-    }
+AudioLoop::~AudioLoop()
+{
+    // The stream outlives us, it must let go of the ring first
+    m_pipewire.Detach();
+    m_producer.Stop();
+
+    // The tracks are let go of here so the last reference is the decoder's
+    m_segments.clear();
+
+    // Closing the files is up to the engine, the next track doesn't wait for
+    // it, nor for the one that may still be getting prepared
+    m_engine.Retire(std::move(m_decoder));
+    m_engine.Retire(std::move(m_previous));
+    m_engine.Retire(std::move(m_next));
+}
 
-    // TODO: This line seems redundant
-    m_ctx_data->codec_ctx->codec_id = codec->id;
+std::vector<std::filesystem::path> AudioLoop::TakeUpcoming()
+{
+    // The queue is the producer's, it has to be done with it first
+    m_producer.Stop();
 
-    ret = avcodec_open2(m_ctx_data->codec_ctx.get(), codec, nullptr);
-    if (ret < 0)
-    {
-        throw std::runtime_error("Failed to open codec");
-    }
+    return std::exchange(m_upcoming, {});
+}
 
-    if (m_ctx_data->codec_ctx->codec_type != AVMEDIA_TYPE_AUDIO)
+void AudioLoop::PrepareNext()
+{
+    m_next = std::async(std::launch::async, [path = m_upcoming.front(), &pools = m_engine.Pools(), readAhead = m_read_ahead,
+                                             cpus = m_affinity.control]
     {
-        throw std::runtime_error("Codec is of wrong type");
-    }
+        pthread_setname_np(pthread_self(), "Preparer");
 
-    m_ctx_data->format_ctx->streams[m_streamIndex]->discard = AVDISCARD_DEFAULT;
+        // Created by the producer, it would otherwise share its CPUs
+        if (cpus.any())
+            rt::Pin(pthread_self(), cpus);
+
+        auto decoder = std::make_unique<Decoder>(path, pools, readAhead);
+        decoder->Prime();
+        return decoder;
+    });
 }
 
-AudioLoop::AudioLoop(const std::filesystem::path &path )
-    : m_produced_buf { Wrap::make_aligned_buffer() }
-    , m_ctx_data     {}
-    , manager        { path, m_ctx_data }
-    , swr            { *m_ctx_data.codec_ctx }
-    , m_statusView   { m_ctx_data, swr.getAudioSettings() }
-    , m_pipewire     { swr.getAudioSettings() }
+bool AudioLoop::SpliceNext()
 {
-    auto ConvertFmtToStr = [](AVSampleFormat fmt)
+    while (not m_upcoming.empty())
     {
-        switch (fmt)
+        // Either the duration is unknown or the track was too short to notice
+        if (not m_next.valid())
+            PrepareNext();
+
+        std::unique_ptr<Decoder> next{};
+        try
         {
-        case AV_SAMPLE_FMT_U8:
-            return "U8";
-        case AV_SAMPLE_FMT_S16:
-            return "S16";
-        case AV_SAMPLE_FMT_S32:
-            return "S32";
-        case AV_SAMPLE_FMT_FLT:
-            return "FLT";
-        case AV_SAMPLE_FMT_DBL:
-            return "DBL";
-
-        case AV_SAMPLE_FMT_U8P:
-            return "U8P";
-        case AV_SAMPLE_FMT_S16P:
-            return "S16P";
-        case AV_SAMPLE_FMT_S32P:
-            return "S32P";
-        case AV_SAMPLE_FMT_FLTP:
-            return "FLTP";
-        case AV_SAMPLE_FMT_DBLP:
-            return "DBLP";
-        case AV_SAMPLE_FMT_S64:
-            return "S64";
-        case AV_SAMPLE_FMT_S64P:
-            return "S64P";
-
-        default:
-            std::unreachable();
-        };
-    };
-
-    const auto& audioSettings = swr.getAudioSettings();
-    util::Log(color::green, "Audio loop init init [fmt][freq][nb_ch]: [{}][{}][{}]\n", ConvertFmtToStr(audioSettings->fmt), audioSettings->freq, audioSettings->ch_layout.nb_channels);
-
-    th_producer_loop = std::jthread{ [this](std::stop_token st) { this->producer_loop(st); } };
-    pthread_setname_np(th_producer_loop.native_handle(), "Producer");
-}
+            next = m_next.get();
+        }
+        catch (const std::exception& e)
+        {
+            util::Log(color::red, "Failed to prepare {}: {}\n", m_upcoming.front().string(), e.what());
+            m_upcoming.erase(m_upcoming.begin());
+            continue;
+        }
 
-AudioLoop::~AudioLoop()
-{
-    th_producer_loop.request_stop();
-    if (th_producer_loop.joinable())
-    {
-        th_producer_loop.join();
+        // The ring holds this format only, the track stays queued and gets
+        // its own loop once we are done, that one renegotiates the stream.
+        const auto& settings = *next->getAudioSettings();
+        if (settings.freq != m_audioSettings->freq or settings.fmt != m_audioSettings->fmt or
+            av_channel_layout_compare(&settings.ch_layout, &m_audioSettings->ch_layout) != 0)
+        {
+            util::Log(color::yellow, "{} has a different output format, not splicing\n", next->getPath().string());
+            return false;
+        }
+
+        util::Log(color::green, "Splicing in {}\n", next->getPath().string());
+
+        m_upcoming.erase(m_upcoming.begin());
+        // The one before the previous one is long gone from the speakers
+        m_engine.Retire(std::exchange(m_previous, std::exchange(m_decoder, std::move(next))));
+        lockDecoder();
+
+        std::scoped_lock seg{ m_segments_mtx };
+        m_segments.push_back({ .start = m_ring.write_position(), .position = 0, .track = m_decoder->getContextData(), .duration = m_decoder->Duration() });
+
+        return true;
     }
+
+    return false;
 }
 
-int AudioLoop::FillAudioBuffer()
+void AudioLoop::PushToRing(const std::uint8_t* ptr, std::size_t length, std::stop_token& st)
 {
-    auto send_packet = [this](AVCodecContext* cc, AVPacket* pkt)
+    while (length > 0 && !Globals::stop_request && !st.stop_requested())
     {
-        std::scoped_lock lk{ m_format_mtx };
+        const auto epoch   = m_ring.producer_epoch();
+        const auto written = m_ring.write(ptr, length);
+        ptr    += written;
+        length -= written;
 
-        int ret = avcodec_send_packet(cc, pkt);
-        if (ret < 0)
+        if (written == 0)
         {
-            util::Log("send_packet error {}\n", ret);
-            handle_error(ret);
+            // A seek leaves the rest of this block stale, nothing to wait for
+            if (TakeRequest())
+                return;
+
+            m_ring.wait_producer(epoch);
         }
+    }
+}
+
+bool AudioLoop::TakeRequest()
+{
+    const auto request = m_requests.take();
+    if (not request)
+        return false;
 
-        return ret;
-    };
+    m_producer_paused = request->paused;
+    if (request->seek_serial == m_seek_applied.load(std::memory_order_relaxed))
+        return false;
 
-    auto read_frame = [this](AVFormatContext* format_ctx, AVPacket* pkt)
+    // Spliced out already, but still heard. It is decoded again from the
+    // target and the track after it goes back into the queue.
+    if (m_previous and request->track == m_previous->getContextData().format_ctx.get())
     {
-        std::scoped_lock lk{ m_format_mtx };
+        m_upcoming.insert(m_upcoming.begin(), m_decoder->getPath());
 
-        auto ret = av_read_frame(format_ctx, pkt);
-        if (ret < 0)
-        {
-            if (ret == AVERROR_EOF)
-            {
-                util::Log("av_read_frame: EOF\n");
-                return -2;
-            }
-
-            std::array<char, 128> buf{};
-            int error_ret = av_strerror(ret, buf.data(), buf.size());
-            if (error_ret == 0)
-                throw std::runtime_error(std::format("Error: {}\n", buf.data()));
-            else
-                throw std::runtime_error("Failed abtain erorr from av_strerorr");
-        }
+        // Closing the current one is up to the engine, as is the track that
+        // was prepared after it, waiting for it here would hold up the seek.
+        m_engine.Retire(std::exchange(m_decoder, std::move(m_previous)));
+        m_engine.Retire(std::move(m_next));
+        lockDecoder();
+    }
+
+    if (request->track == m_decoder->getContextData().format_ctx.get())
+    {
+        m_decoder->Seek(request->seek_sample);
 
-        return ret;
-    };
+        // Nothing is written to the ring while it is flushed, so nothing
+        // from before the seek can follow the discard.
+        const auto start = m_ring.discard();
 
-    Wrap::AvPacket pkt{ 16'000 };
-    while (true)
+        std::scoped_lock seg{ m_segments_mtx };
+        m_segments.clear();
+        m_segments.push_back({ .start = start, .position = request->seek_position, .track = m_decoder->getContextData(), .duration = m_decoder->Duration() });
+        m_statusView.SetTrack(m_decoder->getContextData());
+
+        m_eof_reached = false;
+    }
+    else
     {
-        if (pkt->data)
-        {
-            pkt.reset();
+        util::Log(color::yellow, "Dropped a seek in a track that is long gone\n");
+    }
 
-            int ret = read_frame(m_ctx_data.format_ctx.get(), pkt);
-            if (ret < 0)
-            {
-                if (ret == -1)
-                    return ret;
+    // Tells the control side its position is the audible one again
+    m_seek_applied.store(request->seek_serial, std::memory_order_release);
+    return true;
+}
 
-                return 0;
-            }
+void AudioLoop::PostRequest()
+{
+    m_requests.post(m_request);
+    m_ring.wake_producer();
+}
 
-            // read_frame() likes to return other stream's
-            // like mp3's stream which contains album art
-            if (pkt->stream_index != manager.getStreamIndex())
-                continue;
-        }
+bool AudioLoop::SeekPending() const noexcept
+{
+    return m_seek_applied.load(std::memory_order_acquire) != m_request.seek_serial;
+}
 
-        const auto cc = m_ctx_data.codec_ctx.get();
+void AudioLoop::producer_loop(std::stop_token st)
+{
+    // Whatever we are blocked on, a stop request has to get us out of it
+    std::stop_callback wake_on_stop{ st, [this] { m_ring.wake_producer(); } };
 
-        if (int ret = send_packet(cc, pkt); ret != 0)
-        {
-            handle_error(ret);
-        }
+    bool throttled{ false };
 
-        Wrap::AvFrame frame{};
-        int ret = avcodec_receive_frame(cc, frame);
-        if (ret != 0)
+    while (!Globals::stop_request && !st.stop_requested())
+    {
+        // Taken before the requests are looked at, a request posted
+        // after that bumps it and the wait below returns right away.
+        const auto epoch = m_ring.producer_epoch();
+        TakeRequest();
+
+        // Once we are far enough ahead of the output, don't decode anything
+        // until the consumer drains the ring down to the low watermark.
+        if (m_ring.above_high_watermark())
+            throttled = true;
+        else if (m_ring.below_low_watermark())
+            throttled = false;
+
+        // Requests and the consumer crossing the low watermark bump the epoch
+        if (m_producer_paused or m_eof_reached or throttled)
         {
-            if (ret == AVERROR_EOF)
-            {
-                util::Log(color::beige, "End of file reached\n");
-                return -2;
-            }
-
-            std::array<char, 128> error_buf{};
-            av_strerror(ret, error_buf.data(), error_buf.size());
-
-            if (ret == AVERROR(EINVAL))
-            {
-                throw std::runtime_error(std::format("Codec is not open: {}", error_buf.data()));
-            }
-
-            // Output is not available in this state.
-            util::Log("avcodec_receive_frame: {}\n", error_buf.data());
+            m_ring.wait_producer(epoch);
             continue;
         }
 
-        if (swr)
+        // Have the next track opened and primed before this one runs out
+        if (not m_next.valid() and not m_upcoming.empty() and m_decoder->SecondsLeft() < PrepareAheadSeconds)
         {
-            const auto nb_samples = frame->nb_samples;
-            auto buf_ptr = m_produced_buf.get();
-
-            ret = swr.convert(&buf_ptr, nb_samples, frame->extended_data, nb_samples);
+            PrepareNext();
+        }
 
-            int buffer_used_len = ret * cc->ch_layout.nb_channels * static_cast<int>(sizeof(int16_t));
-            return buffer_used_len;
+        if (int nr_read = m_decoder->Decode(); nr_read < 0)
+        {
+            // Carry on with the next track in the same stream, if we can
+            if (not SpliceNext())
+                m_eof_reached = true;
         }
-        else
+        else if (nr_read > 0)
         {
-            int buffer_used_len = av_samples_get_buffer_size(nullptr,
-                                                             cc->ch_layout.nb_channels,
-                                                             frame->nb_samples,
-                                                             swr.getAudioFormat(), 1);
-            if (buffer_used_len < 0)
-            {
-                std::array<char, 128> errbuf{};
-                av_strerror(buffer_used_len, errbuf.data(), errbuf.size());
-                util::Log("av_samples_get_buffer_size failed with: {}\n", errbuf.data());
-                return 0;
-            }
-
-            memcpy(m_produced_buf.get(), frame->data[0], buffer_used_len);
-            return buffer_used_len;
+            if (m_first_frame_ns.load(std::memory_order_relaxed) == 0)
+                m_first_frame_ns.store(util::NowNs(), std::memory_order_relaxed);
+
+            PushToRing(m_decoder->buffer(), static_cast<std::size_t>(nr_read), st);
         }
+
+        if (not m_prebuffered.load(std::memory_order_relaxed) and (m_eof_reached or m_ring.size() >= m_prebuffer))
+            markPrebuffered();
     }
+
+    // Never leave the control side waiting for audio that won't come
+    markPrebuffered();
 }
 
-void AudioLoop::producer_loop(std::stop_token st)
+void AudioLoop::markPrebuffered() noexcept
+{
+    if (m_prebuffered.load(std::memory_order_relaxed))
+        return;
+
+    m_prebuffered_ns.store(util::NowNs(), std::memory_order_relaxed);
+    m_prebuffered.store(true, std::memory_order_release);
+    m_prebuffered.notify_all();
+}
+
+void AudioLoop::startStream(std::stop_token& st)
 {
-    while (!Globals::stop_request && !st.stop_requested())
     {
-        if (m_paused)
+        // Stopping while a slow file is still being read must not hang here
+        std::stop_callback release{ st, [this]
         {
-            using namespace std::chrono_literals;
-            std::this_thread::sleep_for(50ms);
-            continue;
-        }
+            m_prebuffered.store(true, std::memory_order_release);
+            m_prebuffered.notify_all();
+        } };
 
-        if (int nr_read = FillAudioBuffer(); nr_read <= 0)
-        {
-            if (nr_read == -1) // eof
-            {
-                m_eof_reached = true;
-                break;
-            }
-            else
-            {
-                // Sleep and try again while data is not available
-                util::Log("Sleep and try again\n");
-                using namespace std::chrono_literals;
-                std::this_thread::sleep_for(50ms);
-            }
-        }
-        else
-        {
-            {
-                std::scoped_lock lk{ m_buffer_mtx };
-
-                if (auto ptr = m_produced_buf.get(); ptr)
-                {
-                    std::ranges::copy(ptr,
-                                    std::next(ptr, nr_read),
-                                    std::back_inserter(m_buffer));
-                }
-            }
-        }
+        m_prebuffered.wait(false, std::memory_order_acquire);
     }
+
+    if (not st.stop_requested())
+        m_pipewire.Start();
 }
 
-void AudioLoop::handleSeekRequest(std::int64_t offset)
+void AudioLoop::governBuffer()
 {
+    const auto now    = std::chrono::steady_clock::now();
+    const auto health = m_pipewire.health();
+
+    // The end of the track runs the ring dry and nothing fills it up again
+    const bool settling = SeekPending() or m_eof_reached or now < m_settle_until;
+    if (not m_governor.update(now, health.underruns, health.near_misses, settling))
+        return;
+
+    const auto bytes_per_second = BytesPerSecond(*m_audioSettings);
+    const auto scale            = static_cast<std::size_t>(m_governor.scale());
+
+    m_ring.set_watermarks(bytes_per_second * static_cast<std::size_t>(m_high_watermark_ms) / 1000 * scale,
+                          bytes_per_second * static_cast<std::size_t>(m_low_watermark_ms) / 1000 * scale);
+    m_pipewire.set_latency_scale(m_governor.scale());
+
+    const auto target_ms = static_cast<int>(m_ring.high_watermark() * 1000 / bytes_per_second);
+    m_statusView.SetBufferTarget(target_ms);
+
+    util::Log(color::yellow, "{} underruns, {} near misses so far, buffering {}ms ahead at {}x the quantum\n",
+              m_governor.underruns(), m_governor.near_misses(), target_ms, scale);
+}
+
+void AudioLoop::reportStartup()
+{
+    const auto startup = m_pipewire.startup();
+    if (m_startup_reported or startup.streaming_ns == 0 or startup.first_audible_ns == 0)
+        return;
+
+    m_startup_reported = true;
+
+    // Everything in milliseconds since the loop was created
+    const auto since = [this](std::int64_t ns) { return static_cast<double>(ns - m_created_ns) / 1e6; };
+    const auto ms    = [](std::chrono::nanoseconds d) { return std::chrono::duration<double, std::milli>(d).count(); };
+
+    const auto open  = ms(m_open_timings.open);
+    const auto probe = open + ms(m_open_timings.probe);
+    const auto codec = probe + ms(m_open_timings.codec);
+
+    util::Log(color::aqua, "Startup [ms]: open {:.1f}, probe {:.1f}, codec open {:.1f}, first frame {:.1f}, prebuffered {:.1f}, streaming {:.1f}, first sample heard {:.1f}\n",
+              open, probe, codec,
+              since(m_first_frame_ns.load(std::memory_order_relaxed)),
+              since(m_prebuffered_ns.load(std::memory_order_relaxed)),
+              since(startup.streaming_ns),
+              since(startup.first_audible_ns));
+}
+
+void AudioLoop::handleSeekRequest(SeekTarget request)
+{
+    // Everything is counted in whole output frames, so the position shown
+    // and the audio that follows start on the very same sample.
+    const auto frame_bytes = BytesPerSecond(*m_audioSettings) / static_cast<std::size_t>(m_audioSettings->freq);
+    const auto freq        = static_cast<double>(m_audioSettings->freq);
+    const bool pending     = SeekPending();
+    const auto current     = position_in_bytes() / frame_bytes * frame_bytes;
+    const auto position    = static_cast<double>(current / frame_bytes) / freq;
+
+    const AVFormatContext* track{};
+    double duration{};
     {
-        std::scoped_lock lk{ m_format_mtx };
-        const auto cc                          = m_ctx_data.codec_ctx.get();
-        const auto format                      = swr.getAudioFormat();
-        const auto bytes_per_sample            = av_get_bytes_per_sample(static_cast<AVSampleFormat>(format));
-        const auto bytes_per_second            = cc->sample_rate * bytes_per_sample * cc->ch_layout.nb_channels;
-        const auto current_position_in_seconds = static_cast<std::int64_t>(m_position_in_bytes / bytes_per_second);
+        std::scoped_lock seg{ m_segments_mtx };
+        track    = m_segments.front().track.format_ctx.get();
+        duration = m_segments.front().duration;
+    }
 
-        std::int64_t seek_target{ 0 };
+    const auto seek_target = request.Resolve(position, duration);
+    if (not seek_target)
+        return;
 
-        if (offset < 0 && (current_position_in_seconds - std::abs(offset)) < 0)
-        {
-            seek_target = 0;
-        }
-        else
-        {
-            seek_target = current_position_in_seconds + offset;
-        }
+    const auto target_sample = std::llround(*seek_target * freq);
+    const auto new_position  = static_cast<std::size_t>(target_sample) * frame_bytes;
 
-        avcodec_flush_buffers(cc);
+    // The discard of a seek that is still on its way would undo a rewind
+    if (not pending and rewindHistory(new_position))
+    {
+        m_statusView.draw(new_position);
+        return;
+    }
 
-        const auto seek_min = std::numeric_limits<std::int64_t>::min();
-        const auto seek_max = std::numeric_limits<std::int64_t>::max();
-        int ret = avformat_seek_file(m_ctx_data.format_ctx.get(), -1, seek_min, seek_target * AV_TIME_BASE, seek_max, 0);
-        if (ret < 0)
-        {
-            util::Log(color::red, "Seek failed\n");
-        }
+    // Seeking again before the last one was done stays in the same track
+    m_settle_until = std::chrono::steady_clock::now() + SeekSettleTime;
+    m_request.seek_serial++;
+    m_request.seek_sample   = target_sample;
+    m_request.seek_position = new_position;
+    m_request.track         = pending ? m_request.track : track;
+    PostRequest();
 
-        if (seek_target == 0)
-            m_position_in_bytes = 0;
-        else
-            m_position_in_bytes += bytes_per_second * offset;
+    m_statusView.draw(new_position);
+}
+
+void AudioLoop::measurePause()
+{
+    // Nothing but the stream going away and coming back should wake us up in between
+    const auto now     = std::chrono::steady_clock::now();
+    const auto wakeups = util::Wakeups();
 
-        m_statusView.draw(seek_target);
+    if (not m_paused)
+    {
+        const auto seconds = std::chrono::duration<double>(now - m_paused_since).count();
+        util::Log(color::aqua, "Paused for {:.1f}s, {:.2f} wakeups/s\n", seconds, static_cast<double>(wakeups - m_paused_wakeups) / seconds);
     }
 
-    std::scoped_lock lk{ m_buffer_mtx };
-    m_buffer.clear();
+    m_paused_since   = now;
+    m_paused_wakeups = wakeups;
 }
 
-void AudioLoop::HandleEvent()
+bool AudioLoop::rewindHistory(std::size_t target)
 {
-    if (Globals::event.m_EventHappened)
+    const auto read = m_ring.read_position();
+
+    // Never back into a track that was spliced in front of this one
+    std::scoped_lock seg{ m_segments_mtx };
+    const auto& current = m_segments.front();
+    if (target < current.position)
+        return false;
+
+    // What is heard lags behind the read position, so even a short
+    // forward seek can land in audio that was already handed out.
+    const auto at = current.start + (target - current.position);
+    if (at >= read or read - at > m_ring.history())
+        return false;
+
+    m_ring.rewind(read - at);
+    return true;
+}
+
+void AudioLoop::HandleEvents()
+{
+    Globals::controls.Drain([this](const Control& command)
     {
-        switch (Globals::event.act.load())
+        switch (command.kind)
         {
-        using enum Event::Action;
-
-        case UP_VOLUME:
-            if (Globals::m_audioVolume <= .99f)
-            {
-                Globals::m_audioVolume += 0.01f;
-                m_pipewire.set_volume(Globals::m_audioVolume);
-            }
-            break;
-        case DOWN_VOLUME:
-            if (Globals::m_audioVolume > 0.f)
-            {
-                Globals::m_audioVolume -= 0.01f;
-                m_pipewire.set_volume(Globals::m_audioVolume);
-            }
-            break;
-        case SEEK_FORWARDS:
-            handleSeekRequest(10l);
+        using enum Control::Kind;
+
+        case VOLUME:
+            Globals::m_audioVolume = std::clamp(Globals::m_audioVolume + command.volume_delta, 0.f, 1.f);
+            m_pipewire.set_volume(Globals::m_audioVolume);
             break;
-        case SEEK_BACKWARDS:
-            handleSeekRequest(-10l);
+        case SEEK:
+            handleSeekRequest(command.seek);
             break;
         case PAUSE:
             m_paused = !m_paused;
+            m_pipewire.set_paused(m_paused);
+
+            m_request.paused = m_paused;
+            PostRequest();
+            measurePause();
             break;
         }
-        Globals::event.m_EventHappened = false;
-    }
+    });
 }
 
-void AudioLoop::consumer_loop(std::stop_token& t)
+std::size_t AudioLoop::position_in_bytes()
 {
-    while (!t.stop_requested() && !Globals::stop_request)
+    // Until the producer got to it the segments still describe the old position
+    if (SeekPending())
+        return m_request.seek_position;
+
+    const auto read = m_pipewire.audible_position();
+
+    std::scoped_lock lk{ m_segments_mtx };
+
+    // Retire what is no longer heard, when that crosses into
+    // a spliced track the status line follows along.
+    while (m_segments.size() > 1 && m_segments[1].start <= read)
     {
-        HandleEvent();
+        m_segments.pop_front();
+        m_statusView.SetTrack(m_segments.front().track);
+    }
+
+    const auto& current = m_segments.front();
+    return current.position + static_cast<std::size_t>(read - std::min(read, current.start));
+}
 
-        m_statusView.draw(m_position_in_bytes);
+std::chrono::milliseconds AudioLoop::NextStatusUpdate()
+{
+    const auto bytes_per_second = BytesPerSecond(*m_audioSettings);
+    const auto position_ms      = position_in_bytes() * 1000 / bytes_per_second;
 
-        if (m_paused == false)
-        {
-            std::scoped_lock lk{ m_buffer_mtx };
+    // The status line only shows whole seconds
+    auto next = std::chrono::milliseconds{ static_cast<std::int64_t>(1000 - position_ms % 1000) };
 
-            if (m_buffer.size() <= 0 and m_eof_reached)
-            {
-                // last update for statusView
-                m_statusView.draw();
-                break;
-            }
+    // The track ends once Pipewire has consumed what is left in the ring
+    if (m_eof_reached)
+    {
+        next = std::min(next, std::chrono::milliseconds{ static_cast<std::int64_t>(m_ring.size() * 1000 / bytes_per_second + 1) });
+    }
 
-            auto ret = m_pipewire.write_audio(m_buffer.data(), m_buffer.size());
+    return next;
+}
 
-            const auto min = std::min(ret, m_buffer.size());
+void AudioLoop::control_loop(std::stop_token& t)
+{
+    startStream(t);
 
-            m_buffer.erase(m_buffer.begin(), std::next(m_buffer.begin(), static_cast<long long>(min)));
-            m_position_in_bytes += min;
+    while (!t.stop_requested() && !Globals::stop_request)
+    {
+        HandleEvents();
 
-            m_pipewire.period_wait();
-        }
-        else
+        governBuffer();
+        m_statusView.draw(position_in_bytes());
+        reportStartup();
+
+        // Pipewire pulls the audio by itself, we are only here to
+        // handle the events and notice the end of the track.
+        // A seek the producer didn't get to yet might be what gets us out of the end
+        if (not m_paused and not SeekPending() and m_eof_reached and m_ring.empty())
         {
-            using namespace std::chrono_literals;
-            std::this_thread::sleep_for(50ms);
+            // last update for statusView
+            m_statusView.draw();
+            break;
         }
+
+        // Nothing moves while paused, sleep until the next event
+        if (m_paused)
+            Globals::controls.Wait(t);
+        else
+            Globals::controls.WaitFor(t, NextStatusUpdate());
     }
+
+    if (const auto stats = Globals::controls.stats(); stats.dropped > 0 or stats.coalesced > 0 or stats.stale > 0)
+    {
+        util::Log(color::aqua, "Controls so far: {} dropped, {} coalesced, {} stale\n", stats.dropped, stats.coalesced, stats.stale);
+    }
+
+    util::Log(color::aqua, "Output: {} underruns, {} near misses, buffering {}ms ahead at {}x the quantum\n",
+              m_governor.underruns(), m_governor.near_misses(), m_ring.high_watermark() * 1000 / BytesPerSecond(*m_audioSettings), m_governor.scale());
 }
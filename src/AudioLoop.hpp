@@ -19,199 +19,35 @@
 #pragma once
 
 #include "StatusView.hpp"
-#include "Wrapper.hpp"
+#include "Decoder.hpp"
 #include "ContextData.hpp"
+#include "Controls.hpp"
 #include "AudioSettings.hpp"
+#include "BufferGovernor.hpp"
+#include "Mailbox.hpp"
+#include "PlaybackEngine.hpp"
 #include "Pipewire.hpp"
+#include "Realtime.hpp"
+#include "RingBuffer.hpp"
+#include "Worker.hpp"
 #include "util.hpp"
 
+#include <chrono>
+#include <deque>
 #include <filesystem>
+#include <future>
 #include <thread>
 #include <stop_token>
 #include <utility>
-
-extern "C"
-{
-    #include <libavformat/avformat.h>
-    #include <libavcodec/avcodec.h>
-    #include <libswresample/swresample.h>
-}
-
-inline const auto handle_error = [](int ret)
-{
-    if (ret != AVERROR(EAGAIN))
-    {
-        constexpr int bufSize{ 64 };
-        std::array<char, bufSize> errBuff { 0 };
-        int r = av_strerror(ret, errBuff.data(), bufSize);
-
-        if (r < 0)
-            throw std::runtime_error("av_strerror failed or did not find a description for error\n");
-        else
-            throw std::runtime_error(std::format("Error {}\n", errBuff.data()));
-    }
-};
-
-// This function comaprers wheather ffmpeg's format is the same as pipewires
-inline bool DoesPipewireSupportFormat(AVSampleFormat fmt) noexcept
-{
-    switch (fmt)
-    {
-    case AV_SAMPLE_FMT_U8:  [[fallthrough]];
-    case AV_SAMPLE_FMT_S16: [[fallthrough]];
-    case AV_SAMPLE_FMT_FLT:
-        return true;
-
-    case AV_SAMPLE_FMT_S32: [[fallthrough]];
-    case AV_SAMPLE_FMT_NONE: [[fallthrough]];
-    default:
-        return false;
-    }
-}
-
-class Resample
-{
-public:
-    Resample(const Resample&) = default;
-    Resample(Resample&&) = delete;
-    Resample& operator=(const Resample&) = default;
-    Resample& operator=(Resample&&) = delete;
-
-    Resample(AVCodecContext &cc)
-        : m_audioSettings{ std::make_shared<AudioSettings>() }
-    {
-        // Conveniance func for printing
-        auto ConvertFmtToStr = [](AVSampleFormat fmt)
-        {
-            switch (fmt)
-            {
-            case AV_SAMPLE_FMT_U8:
-                return "U8";
-            case AV_SAMPLE_FMT_S16:
-                return "S16";
-            case AV_SAMPLE_FMT_S32:
-                return "S32";
-            case AV_SAMPLE_FMT_FLT:
-                return "FLT";
-            case AV_SAMPLE_FMT_DBL:
-                return "DBL";
-
-            case AV_SAMPLE_FMT_U8P:
-                return "U8P";
-            case AV_SAMPLE_FMT_S16P:
-                return "S16P";
-            case AV_SAMPLE_FMT_S32P:
-                return "S32P";
-            case AV_SAMPLE_FMT_FLTP:
-                return "FLTP";
-            case AV_SAMPLE_FMT_DBLP:
-                return "DBLP";
-            case AV_SAMPLE_FMT_S64:
-                return "S64";
-            case AV_SAMPLE_FMT_S64P:
-                return "S64P";
-
-            default:
-                std::unreachable();
-            };
-        };
-
-        if (not DoesPipewireSupportFormat(cc.sample_fmt))
-        {
-            util::Log(color::aqua, "Codec: {}, Desired format: {}, but going to use: {}, sample: {}\n", avcodec_get_name(cc.codec_id),
-                                                                                                        ConvertFmtToStr(cc.sample_fmt),
-                                                                                                        ConvertFmtToStr(AV_SAMPLE_FMT_S16),
-                                                                                                        cc.sample_rate);
-
-            int ret = swr_alloc_set_opts2(&m_swr_ctx,
-                                       /* out_ch_layout  out_sample_fmt     out_sample_rate */
-                                          &cc.ch_layout, AV_SAMPLE_FMT_S16, 48'000,
-                                       /* in_ch_layout   in_sample_fmt      in_sample_rate */
-                                          &cc.ch_layout, cc.sample_fmt,     cc.sample_rate,
-                                          0, nullptr);
-            if (ret != 0)
-            {
-                handle_error(ret);
-            }
-
-            ret = swr_init(m_swr_ctx);
-            if (ret < 0)
-            {
-                swr_free(&m_swr_ctx);
-                util::Log("swr_init error\n");
-                handle_error(ret);
-            }
-
-            m_audioSettings->freq      = 48'000;
-            m_audioSettings->fmt       = AV_SAMPLE_FMT_S16;
-            m_audioSettings->ch_layout = cc.ch_layout;
-        }
-        else
-        {
-            util::Log(color::aqua, "Codec: {}, format: {}, sample: {}, Not initializing SWR\n", avcodec_get_name(cc.codec_id),
-                                                                                                ConvertFmtToStr(cc.sample_fmt),
-                                                                                                cc.sample_rate);
-
-            m_audioSettings->freq      = cc.sample_rate;
-            m_audioSettings->fmt       = cc.sample_fmt;
-            m_audioSettings->ch_layout = cc.ch_layout;
-        }
-    }
-
-    int convert(std::uint8_t** out, int out_count, std::uint8_t** in, int in_count)
-    {
-        if (int ret = swr_convert(m_swr_ctx, out, out_count, const_cast<const std::uint8_t**>(in), in_count); ret >= 0)
-        {
-            return ret;
-        }
-
-        return 0;
-    }
-
-    ~Resample()
-    {
-        swr_free(&m_swr_ctx);
-    }
-
-    operator bool() const noexcept
-    {
-        return m_swr_ctx;
-    }
-
-    operator SwrContext*() const noexcept { return m_swr_ctx; }
-
-    [[nodiscard]] std::shared_ptr<AudioSettings> getAudioSettings() const noexcept
-    { return m_audioSettings; }
-
-    [[nodiscard]] AVSampleFormat getAudioFormat() const noexcept
-    { return m_audioSettings->fmt; }
-
-private:
-    std::shared_ptr<AudioSettings> m_audioSettings;
-    SwrContext* m_swr_ctx{};
-};
-
-class AudioFileManager
-{
-public:
-    explicit AudioFileManager(const std::filesystem::path& filename, ContextData&);
-
-    [[nodiscard]] int getStreamIndex() const noexcept
-    { return m_streamIndex; }
-
-private:
-    void open_and_setup(const std::filesystem::path& filename);
-    void stream_open();
-    void find_stream();
-
-    ContextData* m_ctx_data{};
-    int m_streamIndex{};
-};
+#include <vector>
 
 class AudioLoop
 {
 public:
-    explicit AudioLoop(const std::filesystem::path& path);
+    explicit AudioLoop(const std::filesystem::path& path,
+                       PlaybackEngine& engine,
+                       std::vector<std::filesystem::path> upcoming = {},
+                       BufferSettings bufferSettings = {});
     ~AudioLoop();
 
     AudioLoop(const AudioLoop&)            = delete;
@@ -219,34 +55,133 @@ public:
     AudioLoop& operator=(const AudioLoop&) = delete;
     AudioLoop& operator=(AudioLoop&&)      = delete;
 
-    void consumer_loop(std::stop_token& st);
-    [[nodiscard]] ContextData& getContextData() noexcept
-    { return m_ctx_data; }
+    void control_loop(std::stop_token& st);
+
+    // Tracks that could not be spliced into this loop and are left to play
+    // once control_loop() returns, e.g. because their format differs.
+    [[nodiscard]] std::vector<std::filesystem::path> TakeUpcoming();
 
 private:
+    // A run of bytes in the ring that belongs to one track, starting at
+    // ring position 'start' and at 'position' bytes into that track.
+    struct Segment
+    {
+        std::uint64_t start{};
+        std::size_t position{};
+        ContextData track{};
+        double duration{};
+    };
+
+    // Everything the control side wants from the producer. It is posted as
+    // a whole, one the producer hasn't picked up yet is simply replaced.
+    struct Request
+    {
+        // A new serial asks for a seek to seek_sample, which is seek_position
+        // bytes into track. It is dropped once track is no longer decoded.
+        std::uint32_t seek_serial{};
+        std::int64_t seek_sample{};
+        std::size_t seek_position{};
+        const AVFormatContext* track{};
+
+        bool paused{};
+    };
+
     void producer_loop(std::stop_token st);
-    int FillAudioBuffer();
+    void PushToRing(const std::uint8_t* ptr, std::size_t length, std::stop_token& st);
+
+    // Producer side. Applies what was posted since the last call, true if that was a seek.
+    bool TakeRequest();
+    void PostRequest();
+    [[nodiscard]] bool SeekPending() const noexcept;
+
+    void PrepareNext();
+    bool SpliceNext();
+
+    // Keeps the output buffer of the current decoder resident in RT mode,
+    // the decoder holds on to the lock for as long as its buffer lives
+    void lockDecoder() noexcept;
+    // Raises the producer and the output thread, logs what could be done
+    void enterRealtime();
+    // Pins the producer and the PipeWire threads to the configured CPUs
+    void pinThreads();
+
+    void HandleEvents();
+    void handleSeekRequest(SeekTarget request);
+
+    // Logs how often the process woke up while it was paused
+    void measurePause();
+
+    // Producer side. Lets the stream start, enough is buffered or nothing more is coming.
+    void markPrebuffered() noexcept;
+    // Control side. Waits for the prebuffer to fill up and starts the stream.
+    void startStream(std::stop_token& st);
+    // Logs how long each step of the startup took, once the first sample was heard
+    void reportStartup();
+
+    // Scales the buffering with what the governor makes of the underruns so far
+    void governBuffer();
+
+    // Serves a seek to a point the ring has already handed out and still
+    // holds, false if it lies beyond that.
+    bool rewindHistory(std::size_t target);
+
+    // What is being heard, in bytes into the track that is being heard,
+    // or where it is about to continue from when a seek is pending.
+    [[nodiscard]] std::size_t position_in_bytes();
+    [[nodiscard]] std::chrono::milliseconds NextStatusUpdate();
+
+    // Everything in the startup report is counted from here
+    const std::int64_t m_created_ns{ util::NowNs() };
+    PlaybackEngine& m_engine;
+    Worker& m_producer;
+    const ReadAheadSettings m_read_ahead;
+    const RealtimeSettings m_realtime;
+    const AffinitySettings m_affinity;
+
+    // The decoders and the queue belong to the producer thread alone,
+    // everything else reaches it through m_requests.
+    std::unique_ptr<Decoder> m_decoder;
+
+    // Kept until the next splice, its end is still being heard for a while
+    std::unique_ptr<Decoder> m_previous{};
+    std::future<std::unique_ptr<Decoder>> m_next{};
+    std::vector<std::filesystem::path> m_upcoming;
 
-    void HandleEvent();
-    void handleSeekRequest(std::int64_t offset);
+    std::shared_ptr<AudioSettings> m_audioSettings;
+    StatusView& m_statusView;
+    RingBuffer m_ring;
+    Pipewire& m_pipewire;
+    const std::size_t m_prebuffer;
 
-    std::mutex m_buffer_mtx{};
-    std::mutex m_format_mtx{};
+    std::mutex m_segments_mtx{};
+    std::deque<Segment> m_segments{};
 
-    Wrap::align_buf_t m_produced_buf{};
+    // Control side, m_request is the last one posted
+    Request m_request{};
+    bool m_paused{};
+    std::chrono::steady_clock::time_point m_paused_since{};
+    std::uint64_t m_paused_wakeups{};
+    OpenTimings m_open_timings{};
+    bool m_startup_reported{};
 
-    std::jthread th_producer_loop{};
+    // The watermarks the governor scales, and until when a seek is still refilling the ring
+    const int m_high_watermark_ms;
+    const int m_low_watermark_ms;
+    BufferGovernor m_governor{};
+    std::chrono::steady_clock::time_point m_settle_until{};
 
-    ContextData m_ctx_data{};
-    AudioFileManager manager;
-    Resample swr;
-    StatusView m_statusView;
-    Pipewire m_pipewire;
-    std::size_t m_position_in_bytes = 0uz;
-    std::vector<std::uint8_t> m_buffer{};
+    Mailbox<Request> m_requests{};
+    std::atomic<std::uint32_t> m_seek_applied{};
 
-    bool m_paused{};
+    // Let go of before the ring it locks
+    rt::MemoryLock m_ring_lock{};
+
+    // Producer side
+    bool m_producer_paused{};
     std::atomic<bool> m_eof_reached{};
-};
 
-inline std::jthread playbackThread;
+    // Set once by the producer, with the steady clock time of both
+    std::atomic<bool> m_prebuffered{};
+    std::atomic<std::int64_t> m_first_frame_ns{};
+    std::atomic<std::int64_t> m_prebuffered_ns{};
+};
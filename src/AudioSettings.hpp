@@ -19,15 +19,138 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string_view>
+
 extern "C"
 {
     #include <libavutil/samplefmt.h>
     #include <libavutil/channel_layout.h>
 }
 
+#include "Realtime.hpp"
+
 struct AudioSettings
 {
     int freq{};
     AVChannelLayout ch_layout{};
     AVSampleFormat fmt{};
 };
+
+// For the log, FFmpeg's own name of fmt
+inline const char* SampleFormatName(AVSampleFormat fmt) noexcept
+{
+    const char* name = av_get_sample_fmt_name(fmt);
+    return name ? name : "unknown";
+}
+
+inline std::size_t BytesPerSecond(const AudioSettings& settings) noexcept
+{
+    return static_cast<std::size_t>(settings.freq) *
+           static_cast<std::size_t>(settings.ch_layout.nb_channels) *
+           static_cast<std::size_t>(av_get_bytes_per_sample(settings.fmt));
+}
+
+// Frames per graph cycle we ask Pipewire for, quantum is counted at 48 kHz
+// and scaled to the rate, so it's ~43ms by default whatever the rate. The
+// graph never goes above its own clock.max-quantum.
+inline int QuantumFrames(const AudioSettings& settings, int quantum = 2048) noexcept
+{
+    return std::clamp((quantum * settings.freq + 47'999) / 48'000, 64, 16384);
+}
+
+// What the stream negotiates with the graph
+struct OutputSettings
+{
+    // node.latency, in frames at 48 kHz, see QuantumFrames()
+    int quantum{ 2048 };
+
+    // SPA_PARAM_Buffers, how many and how many quanta each one holds
+    int buffers{ 4 };
+    int buffer_quanta{ 2 };
+};
+
+// Reads issued ahead of the demuxer for files on slow storage, a depth
+// of 0 leaves the io_uring backend off.
+struct ReadAheadSettings
+{
+    int uring_depth{ 0 };
+    int uring_block_kb{ 512 };
+};
+
+// SCHED_FIFO for the output thread at priority and the producer right
+// below it, with the ring and the decode buffers locked in memory
+struct RealtimeSettings
+{
+    bool enabled{ false };
+    int priority{ 20 };
+};
+
+// CPUs each of the long lived threads is pinned to, from the [Affinity]
+// section. An empty set leaves the thread alone.
+struct AffinitySettings
+{
+    rt::CpuSet ui{};
+    rt::CpuSet control{};
+    rt::CpuSet producer{};
+    rt::CpuSet pipewire{};
+    rt::CpuSet output{};
+
+    [[nodiscard]] bool any() const noexcept
+    { return ui.any() or control.any() or producer.any() or pipewire.any() or output.any(); }
+};
+
+// How far ahead of the output the decoder is allowed to run
+struct BufferSettings
+{
+    int high_watermark_ms{ 2000 };
+    int low_watermark_ms{ 1000 };
+
+    // Recently played audio kept around for backward seeks
+    int seek_history_s{ 15 };
+
+    // Decoded ahead before the stream is started, so it never begins with
+    // an underrun
+    int prebuffer_ms{ 200 };
+
+    OutputSettings output{};
+    ReadAheadSettings read_ahead{};
+    RealtimeSettings realtime{};
+    AffinitySettings affinity{};
+};
+
+// A named set of output and buffer settings, picked with 'profile' in the
+// [Audio] section. Single keys set next to it still override its values.
+struct LatencyProfile
+{
+    std::string_view name{};
+    OutputSettings output{};
+
+    int high_watermark_ms{};
+    int low_watermark_ms{};
+    int prebuffer_ms{};
+};
+
+inline constexpr std::array LatencyProfiles
+{
+    // ~5ms cycles for cueing, the ring stays short so seeks land right away
+    LatencyProfile{ .name = "low-latency", .output = { .quantum = 256,  .buffers = 2, .buffer_quanta = 2 },
+                    .high_watermark_ms = 500,   .low_watermark_ms = 250,  .prebuffer_ms = 50 },
+
+    // The defaults of BufferSettings
+    LatencyProfile{ .name = "balanced",    .output = { .quantum = 2048, .buffers = 4, .buffer_quanta = 2 },
+                    .high_watermark_ms = 2000,  .low_watermark_ms = 1000, .prebuffer_ms = 200 },
+
+    // 200ms cycles and a ring the decoder only tops up every few seconds
+    LatencyProfile{ .name = "power-save",  .output = { .quantum = 9600, .buffers = 2, .buffer_quanta = 1 },
+                    .high_watermark_ms = 10000, .low_watermark_ms = 4000, .prebuffer_ms = 500 },
+};
+
+// nullptr if there is no profile with that name
+inline const LatencyProfile* FindLatencyProfile(std::string_view name) noexcept
+{
+    const auto it = std::ranges::find(LatencyProfiles, name, &LatencyProfile::name);
+    return it != LatencyProfiles.end() ? &*it : nullptr;
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Decides how far ahead of the output to buffer.
+ *
+ * Every underrun doubles the buffering, up to MaxLevel times, so the ring
+ * target and the node latency are both scaled by 1 << level(). Once the
+ * stream went through a quiet period without an underrun or a near miss
+ * it is halved again, one step at a time. Underruns that were brought on
+ * by us, a seek refilling the ring or the end of a track, don't count.
+ */
+class BufferGovernor
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr int MaxLevel{ 2 };
+
+    explicit BufferGovernor(clock::duration quiet    = std::chrono::seconds{ 60 },
+                            clock::duration cooldown = std::chrono::seconds{ 5 }) noexcept
+        : m_quiet    { quiet }
+        , m_cooldown { cooldown }
+    { }
+
+    // Takes the running totals of the stream, true if the level changed.
+    // Right after a raise the ring is still filling up, whatever underruns
+    // happen within the cooldown are put down to the same cause.
+    bool update(clock::time_point now, std::uint64_t underruns, std::uint64_t near_misses, bool settling) noexcept
+    {
+        const auto new_underruns   = underruns - m_seen_underruns;
+        const auto new_near_misses = near_misses - m_seen_near_misses;
+
+        m_seen_underruns   = underruns;
+        m_seen_near_misses = near_misses;
+
+        if (settling)
+            return false;
+
+        m_underruns   += new_underruns;
+        m_near_misses += new_near_misses;
+
+        if (new_underruns > 0 or new_near_misses > 0)
+            m_quiet_since = now;
+
+        if (new_underruns > 0)
+        {
+            if (m_level == MaxLevel or now - m_changed_at < m_cooldown)
+                return false;
+
+            m_level++;
+            m_changed_at = now;
+            return true;
+        }
+
+        if (m_level > 0 and now - m_quiet_since >= m_quiet and now - m_changed_at >= m_quiet)
+        {
+            m_level--;
+            m_changed_at = now;
+            return true;
+        }
+
+        return false;
+    }
+
+    [[nodiscard]] int level() const noexcept
+    { return m_level; }
+
+    [[nodiscard]] int scale() const noexcept
+    { return 1 << m_level; }
+
+    // What was counted, without the underruns that were skipped
+    [[nodiscard]] std::uint64_t underruns() const noexcept
+    { return m_underruns; }
+
+    [[nodiscard]] std::uint64_t near_misses() const noexcept
+    { return m_near_misses; }
+
+private:
+    const clock::duration m_quiet;
+    const clock::duration m_cooldown;
+
+    int m_level{ 0 };
+    clock::time_point m_quiet_since{};
+    clock::time_point m_changed_at{};
+
+    std::uint64_t m_seen_underruns{ 0 };
+    std::uint64_t m_seen_near_misses{ 0 };
+    std::uint64_t m_underruns{ 0 };
+    std::uint64_t m_near_misses{ 0 };
+};
@@ -201,12 +201,28 @@ bool Play::execute(std::string_view)
     return true;
 }
 
-bool Pause::execute(std::string_view)
+bool ControlCommand::push(const Control& control)
 {
-    Globals::event.SetEvent(Event::Action::PAUSE);
+    if (not Globals::controls.IsOpen())
+    {
+        m_report = "Nothing is playing";
+        return true;
+    }
+
+    if (not Globals::controls.Push(control))
+    {
+        util::Log(color::yellow, "Control queue is full, command dropped\n");
+        m_report = "Playback is busy, the command was dropped";
+    }
+
     return true;
 }
 
+bool Pause::execute(std::string_view)
+{
+    return push(Control::Pause());
+}
+
 static void CommonPart(std::vector<std::uint32_t>& vec, std::string& DesiredDir)
 {
     util::Log("Last: {}\n", Globals::lastCompletion.str);
@@ -357,14 +373,12 @@ void Add::CompletePath(Add::Type t, std::vector<std::uint32_t>& vec) const
 
 bool Volup::execute(std::string_view)
 {
-    Globals::event.SetEvent(Event::Action::UP_VOLUME);
-    return true;
+    return push(Control::Volume(+0.01f));
 }
 
 bool Voldown::execute(std::string_view)
 {
-    Globals::event.SetEvent(Event::Action::DOWN_VOLUME);
-    return true;
+    return push(Control::Volume(-0.01f));
 }
 
 bool BindCommand::execute([[maybe_unused]] std::string_view command)
@@ -403,9 +417,10 @@ CycleFocus::CycleFocus(std::shared_ptr<ListView> listView, std::shared_ptr<ListV
     return true;
 }
 
-Clear::Clear(std::shared_ptr<ListView> listView, std::shared_ptr<ListView> songView)
+Clear::Clear(std::shared_ptr<ListView> listView, std::shared_ptr<ListView> songView, std::weak_ptr<PlaybackEngine> engine)
     : m_ListView(std::move(listView))
     , m_SongView(std::move(songView))
+    , m_engine(std::move(engine))
 { }
 
 bool Clear::execute([[maybe_unused]] std::string_view s)
@@ -416,10 +431,9 @@ bool Clear::execute([[maybe_unused]] std::string_view s)
     m_ListView->draw();
     m_SongView->draw();
 
-    if (playbackThread.joinable())
+    if (const auto engine = m_engine.lock())
     {
-        playbackThread.request_stop();
-        playbackThread.join();
+        engine->Stop();
     }
 
     return true;
@@ -470,8 +484,7 @@ SeekForwards::SeekForwards(std::shared_ptr<ListView> listView, std::shared_ptr<L
 
 bool SeekForwards::execute(std::string_view)
 {
-    Globals::event.SetEvent(Event::Action::SEEK_FORWARDS);
-    return true;
+    return push(Control::Seek({ .kind = SeekTarget::Kind::RELATIVE, .value = +10.0 }));
 }
 
 SeekBackwards::SeekBackwards(std::shared_ptr<ListView> listView, std::shared_ptr<ListView> songView)
@@ -481,7 +494,28 @@ SeekBackwards::SeekBackwards(std::shared_ptr<ListView> listView, std::shared_ptr
 
 bool SeekBackwards::execute(std::string_view)
 {
-    Globals::event.SetEvent(Event::Action::SEEK_BACKWARDS);
+    return push(Control::Seek({ .kind = SeekTarget::Kind::RELATIVE, .value = -10.0 }));
+}
+
+bool Seek::execute(std::string_view arguments)
+{
+    const auto target = SeekTarget::Parse(arguments);
+    if (not target)
+        return false;
+
+    return push(Control::Seek(*target));
+}
+
+bool Threads::execute([[maybe_unused]] std::string_view arguments)
+{
+    m_report.clear();
+
+    for (const auto& thread : util::ThreadAffinities())
+    {
+        util::Log(color::green, "Thread '{}' on CPUs {}\n", thread.name, thread.cpus);
+        m_report += std::format("{}{}: {}", m_report.empty() ? "" : " | ", thread.name, thread.cpus);
+    }
+
     return true;
 }
 
@@ -502,6 +536,7 @@ std::optional<std::string> CommandProcessor::processCommand(std::string_view CMD
         bool b = it->second->execute(arguments);
         if (b)
         {
+            m_report = it->second->takeReport();
             return {};
         }
 
@@ -22,8 +22,13 @@
 #include "CustomViews.hpp"
 #include "util.hpp"
 
+#include <string>
 #include <string_view>
 #include <unordered_map>
+#include <utility>
+
+class PlaybackEngine;
+struct Control;
 
 struct Command
 {
@@ -37,6 +42,25 @@ struct Command
 
     virtual bool execute(std::string_view) = 0;
     [[nodiscard]] virtual bool complete(std::vector<std::uint32_t> &) const = 0;
+
+    // What the last successful execute() has to show on the command line
+    [[nodiscard]] virtual std::string takeReport()
+    { return {}; }
+};
+
+// Commands that hand a Control to the playback side. Neither a full queue
+// nor nothing playing is the user's fault, the command is dropped and
+// that is what gets reported.
+struct ControlCommand : public Command
+{
+    [[nodiscard]] std::string takeReport() override
+    { return std::exchange(m_report, {}); }
+
+protected:
+    bool push(const Control&);
+
+private:
+    std::string m_report;
 };
 
 struct SearchCommand : public Command
@@ -80,21 +104,21 @@ private:
     std::shared_ptr<ListView> m_SongView;
 };
 
-struct Pause : public Command
+struct Pause : public ControlCommand
 {
     bool execute(std::string_view) override;
     [[nodiscard]] bool complete(std::vector<std::uint32_t>&) const override
     { return false; }
 };
 
-struct Volup : public Command
+struct Volup : public ControlCommand
 {
     bool execute(std::string_view) override;
     [[nodiscard]] bool complete(std::vector<std::uint32_t>&) const override
     { return false; }
 };
 
-struct Voldown : public Command
+struct Voldown : public ControlCommand
 {
     bool execute(std::string_view) override;
     [[nodiscard]] bool complete(std::vector<std::uint32_t>&) const override
@@ -154,7 +178,7 @@ struct HelloWorld : public Command
 
 struct Clear : public Command
 {
-    explicit Clear(std::shared_ptr<ListView>, std::shared_ptr<ListView>);
+    explicit Clear(std::shared_ptr<ListView>, std::shared_ptr<ListView>, std::weak_ptr<PlaybackEngine>);
     bool execute(std::string_view) override;
 
     [[nodiscard]] bool complete(std::vector<std::uint32_t>&) const noexcept override
@@ -165,6 +189,7 @@ struct Clear : public Command
 private:
     std::shared_ptr<ListView> m_ListView;
     std::shared_ptr<ListView> m_SongView;
+    std::weak_ptr<PlaybackEngine> m_engine;
 };
 
 struct Up : public Command
@@ -193,7 +218,7 @@ private:
     std::shared_ptr<ListView> m_SongView;
 };
 
-struct SeekForwards : public Command
+struct SeekForwards : public ControlCommand
 {
     explicit SeekForwards(std::shared_ptr<ListView>, std::shared_ptr<ListView>);
     bool execute(std::string_view) override;
@@ -205,7 +230,7 @@ private:
     std::shared_ptr<ListView> m_SongView;
 };
 
-struct SeekBackwards : public Command
+struct SeekBackwards : public ControlCommand
 {
     explicit SeekBackwards(std::shared_ptr<ListView>, std::shared_ptr<ListView>);
     bool execute(std::string_view) override;
@@ -217,6 +242,28 @@ private:
     std::shared_ptr<ListView> m_SongView;
 };
 
+// seek 1:23.5 | +30 | -5 | 42%
+struct Seek : public ControlCommand
+{
+    bool execute(std::string_view) override;
+    [[nodiscard]] bool complete(std::vector<std::uint32_t>&) const noexcept override
+    { return false; }
+};
+
+// The stats view, every thread with the CPUs it may run on
+struct Threads : public Command
+{
+    bool execute(std::string_view) override;
+    [[nodiscard]] bool complete(std::vector<std::uint32_t>&) const noexcept override
+    { return false; }
+
+    [[nodiscard]] std::string takeReport() override
+    { return std::exchange(m_report, {}); }
+
+private:
+    std::string m_report;
+};
+
 struct CommandProcessor
 {
 public:
@@ -224,6 +271,10 @@ public:
 
     std::shared_ptr<Command> findCommand(std::string_view cmd) const;
     std::optional<std::string> processCommand(std::string_view CMD);
+
+    // What the last command that was processed reported, if anything
+    [[nodiscard]] std::string takeReport() noexcept
+    { return std::exchange(m_report, {}); }
     std::optional<std::shared_ptr<Command>> getCommandByName(std::string_view);
 
     [[nodiscard]] std::string getCommandName(std::string_view) const noexcept;
@@ -231,6 +282,7 @@ public:
 
 private:
     std::unordered_map<std::string_view, std::shared_ptr<Command>> m_Commands;
+    std::string m_report;
 
     using StrPair = std::pair<std::string, std::string>;
     [[nodiscard]] StrPair processArguments(std::string_view) const noexcept;
@@ -235,6 +235,11 @@ void CommandView::ProcessCommand(std::string str)
     }
 
     clearCommand();
+
+    if (const auto report = m_cmdProc->takeReport(); not report.empty())
+    {
+        ReportInfo(report);
+    }
 }
 
 void CommandView::ReportError(std::string_view error) noexcept
@@ -257,6 +262,18 @@ void CommandView::ReportError(std::string_view error) noexcept
     m_commandBuffer.push_back(':');
 }
 
+void CommandView::ReportInfo(std::string_view info) noexcept
+{
+    m_ncp.cursor_move(0, 0);
+    m_ncp.set_channels((std::uint64_t)ncchannels_bchannel(m_textColor) << 32u | ncchannels_fchannel(m_textColor));
+
+    // Stays on the command line until the next command, cut at its width
+    for (const auto c : info | std::views::take(m_dimx - 1))
+    {
+        m_ncp.putc(c);
+    }
+}
+
 std::string CommandView::u32vecToString(const std::vector<std::uint32_t>& vec) const noexcept
 {
     std::string str;
@@ -32,6 +32,7 @@ public:
     void search(std::string str);
     bool handle_input(const ncinput&) noexcept;
     void ReportError(std::string_view error) noexcept;
+    void ReportInfo(std::string_view info) noexcept;
 
     [[nodiscard]] bool isFocused() const noexcept
     { return m_focus; }
@@ -20,7 +20,9 @@
 #include "Config.hpp"
 #include "util.hpp"
 
+#include <algorithm>
 #include <string>
+#include <variant>
 
 namespace fs = std::filesystem;
 
@@ -98,8 +100,136 @@ void Config::ParseConfig()
 
     for (const auto& [key, value] : parser["Audio"])
     {
+        if (key == "profile")
+        {
+            const auto name = value.as<std::string>();
+            if (m_profile = FindLatencyProfile(name); m_profile == nullptr)
+            {
+                throw std::runtime_error(std::format("Unknown latency profile '{}' in config", name));
+            }
+
+            util::Log(color::green, "Latency profile: {}\n", name);
+            continue;
+        }
+
         m_audioSection[key] = value.as<int>();
     }
+
+    if (not parser.contains("Affinity"))
+        return;
+
+    for (const auto& [key, value] : parser["Affinity"])
+    {
+        if (key == "isolate")
+        {
+            m_isolate = value.as<int>() != 0;
+            continue;
+        }
+
+        rt::CpuSet* cpus = key == "ui"       ? &m_affinity.ui
+                         : key == "control"  ? &m_affinity.control
+                         : key == "producer" ? &m_affinity.producer
+                         : key == "pipewire" ? &m_affinity.pipewire
+                         : key == "output"   ? &m_affinity.output
+                         : nullptr;
+        if (cpus == nullptr)
+        {
+            throw std::runtime_error(std::format("Unknown thread '{}' in [Affinity]", key));
+        }
+
+        // A single CPU comes out of the parser as a number
+        const auto& v = value.GetValue();
+        const auto list = std::holds_alternative<int>(v)         ? std::to_string(std::get<int>(v))
+                        : std::holds_alternative<std::string>(v) ? std::get<std::string>(v)
+                        : std::string{};
+
+        const auto parsed = rt::ParseCpuList(list);
+        if (not parsed)
+        {
+            throw std::runtime_error(std::format("Bad CPU list '{}' for '{}' in [Affinity]", list, key));
+        }
+
+        *cpus = *parsed;
+        util::Log(color::green, "Affinity: {} on {}\n", key, rt::FormatCpuList(*cpus));
+    }
+}
+
+BufferSettings Config::GetBufferSettings() const noexcept
+{
+    BufferSettings settings
+    {
+        .high_watermark_ms = m_profile->high_watermark_ms,
+        .low_watermark_ms  = m_profile->low_watermark_ms,
+        .prebuffer_ms      = m_profile->prebuffer_ms,
+        .output            = m_profile->output,
+    };
+
+    if (auto it = m_audioSection.find("buffer_high_ms"); it != m_audioSection.end() && it->second > 0)
+    {
+        settings.high_watermark_ms = it->second;
+    }
+
+    if (auto it = m_audioSection.find("buffer_low_ms"); it != m_audioSection.end() && it->second >= 0)
+    {
+        settings.low_watermark_ms = it->second;
+    }
+
+    if (auto it = m_audioSection.find("seek_history_s"); it != m_audioSection.end() && it->second >= 0)
+    {
+        settings.seek_history_s = it->second;
+    }
+
+    if (auto it = m_audioSection.find("io_uring_depth"); it != m_audioSection.end() && it->second >= 0)
+    {
+        settings.read_ahead.uring_depth = it->second;
+    }
+
+    if (auto it = m_audioSection.find("io_uring_block_kb"); it != m_audioSection.end() && it->second > 0)
+    {
+        settings.read_ahead.uring_block_kb = it->second;
+    }
+
+    if (auto it = m_audioSection.find("prebuffer_ms"); it != m_audioSection.end() && it->second >= 0)
+    {
+        settings.prebuffer_ms = it->second;
+    }
+
+    if (auto it = m_audioSection.find("realtime"); it != m_audioSection.end())
+    {
+        settings.realtime.enabled = it->second != 0;
+    }
+
+    // The producer runs one below, so 1 is no good
+    if (auto it = m_audioSection.find("realtime_priority"); it != m_audioSection.end() && it->second > 1 && it->second < 100)
+    {
+        settings.realtime.priority = it->second;
+    }
+
+    settings.affinity = m_affinity;
+    if (settings.affinity.any())
+    {
+        // A new thread starts out with the set of the one that created it,
+        // the ones left unset get the original set back instead of a sibling's
+        auto rest = m_cpus;
+        if (m_isolate)
+        {
+            // Everything else keeps off the CPUs of the audio path
+            const auto shared = m_cpus & ~(settings.affinity.producer | settings.affinity.output);
+            if (shared.any())
+                rest = shared;
+        }
+
+        for (auto* cpus : { &settings.affinity.ui, &settings.affinity.control, &settings.affinity.producer,
+                            &settings.affinity.pipewire, &settings.affinity.output })
+        {
+            if (cpus->none())
+                *cpus = rest;
+        }
+    }
+
+    settings.low_watermark_ms = std::min(settings.low_watermark_ms, settings.high_watermark_ms);
+    settings.prebuffer_ms     = std::min(settings.prebuffer_ms, settings.high_watermark_ms);
+    return settings;
 }
 
 bool Config::ProcessKeybinding(ncinput ni)
@@ -24,6 +24,7 @@
 
 #include <notcurses/notcurses.h>
 
+#include "AudioSettings.hpp"
 #include "CommandProcessor.hpp"
 #include "IniParser.hpp"
 
@@ -44,6 +45,8 @@ struct Config
     [[nodiscard]] int GetVolume() noexcept
     { return m_audioSection["volume"]; }
 
+    [[nodiscard]] BufferSettings GetBufferSettings() const noexcept;
+
 private:
     void ParseConfig();
 
@@ -57,5 +60,12 @@ private:
 
     std::vector<Keybind> m_keybindingsSection;
     std::unordered_map<std::string, int> m_audioSection;
+    const LatencyProfile* m_profile{ FindLatencyProfile("balanced") };
+
+    AffinitySettings m_affinity{};
+    bool m_isolate{};
+
+    // What the process was started with, before any thread was pinned
+    rt::CpuSet m_cpus{ rt::Affinity(pthread_self()) };
     std::ifstream m_configFile;
 };
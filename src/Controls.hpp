@@ -19,29 +19,386 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <bitset>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <stop_token>
 #include <string>
+#include <string_view>
 
-struct Event
+// Where a seek should land: "1:23.5" is absolute, "+30" and "-5" are
+// relative to the current position and "42%" is a fraction of the track.
+struct SeekTarget
 {
-    enum class Action
+    enum class Kind
     {
-        UP_VOLUME = 0,
-        DOWN_VOLUME,
-        SEEK_FORWARDS,
-        SEEK_BACKWARDS,
+        ABSOLUTE = 0,
+        RELATIVE,
+        PERCENT,
+    };
+
+    Kind kind{ Kind::RELATIVE };
+    double value{};
+
+    [[nodiscard]] static std::optional<SeekTarget> Parse(std::string_view str) noexcept
+    {
+        while (not str.empty() and str.front() == ' ')
+            str.remove_prefix(1);
+        while (not str.empty() and str.back() == ' ')
+            str.remove_suffix(1);
+
+        if (str.empty())
+            return std::nullopt;
+
+        if (str.back() == '%')
+        {
+            const auto percent = ParseNumber(str.substr(0, str.size() - 1));
+            if (not percent or *percent > 100.0)
+                return std::nullopt;
+
+            return SeekTarget{ .kind = Kind::PERCENT, .value = *percent };
+        }
+
+        if (str.front() == '+' or str.front() == '-')
+        {
+            const auto offset = ParseTime(str.substr(1));
+            if (not offset)
+                return std::nullopt;
+
+            return SeekTarget{ .kind = Kind::RELATIVE, .value = str.front() == '-' ? -*offset : *offset };
+        }
+
+        const auto position = ParseTime(str);
+        if (not position)
+            return std::nullopt;
+
+        return SeekTarget{ .kind = Kind::ABSOLUTE, .value = *position };
+    }
+
+    // Target in seconds, duration is 0 when it isn't known
+    [[nodiscard]] std::optional<double> Resolve(double position, double duration) const noexcept
+    {
+        double target{};
+        switch (kind)
+        {
+        case Kind::ABSOLUTE:
+            target = value;
+            break;
+        case Kind::RELATIVE:
+            target = position + value;
+            break;
+        case Kind::PERCENT:
+            if (duration <= 0.0)
+                return std::nullopt;
+            target = duration * value / 100.0;
+            break;
+        }
+
+        target = std::max(target, 0.0);
+        return duration > 0.0 ? std::min(target, duration) : target;
+    }
+
+private:
+    [[nodiscard]] static std::optional<double> ParseNumber(std::string_view str) noexcept
+    {
+        double out{};
+        const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), out);
+        if (str.empty() or ec != std::errc{} or ptr != str.data() + str.size() or out < 0.0)
+            return std::nullopt;
+
+        return out;
+    }
+
+    // "[[h:]m:]s[.frac]", only the seconds may have a fraction
+    [[nodiscard]] static std::optional<double> ParseTime(std::string_view str) noexcept
+    {
+        double seconds{};
+        int fields{};
+
+        while (true)
+        {
+            const auto colon = str.find(':');
+            const auto part  = ParseNumber(str.substr(0, colon));
+            if (not part or ++fields > 3)
+                return std::nullopt;
+
+            // Everything after the leading field has to fit in a minute
+            if (fields > 1 and *part >= 60.0)
+                return std::nullopt;
+
+            if (colon == std::string_view::npos)
+                return seconds * 60.0 + *part;
+
+            if (*part != static_cast<double>(static_cast<long>(*part)))
+                return std::nullopt;
+
+            seconds = seconds * 60.0 + *part;
+            str.remove_prefix(colon + 1);
+        }
+    }
+};
+
+// What the interface asks of the playback loop
+struct Control
+{
+    enum class Kind : std::uint8_t
+    {
+        VOLUME = 0,
+        SEEK,
         PAUSE,
     };
 
-    void SetEvent(Action in) noexcept
+    Kind kind{ Kind::PAUSE };
+    float volume_delta{};
+    SeekTarget seek{};
+
+    [[nodiscard]] static Control Volume(float delta) noexcept
+    { return { .kind = Kind::VOLUME, .volume_delta = delta }; }
+
+    [[nodiscard]] static Control Seek(SeekTarget target) noexcept
+    { return { .kind = Kind::SEEK, .seek = target }; }
+
+    [[nodiscard]] static Control Pause() noexcept
+    { return { .kind = Kind::PAUSE }; }
+
+    // Folds next into this one when doing both comes down to doing one
+    [[nodiscard]] bool Absorb(const Control& next) noexcept
     {
-        act = in;
-        m_EventHappened = true;
+        using enum SeekTarget::Kind;
+
+        if (kind != next.kind)
+            return false;
+
+        switch (kind)
+        {
+        case Kind::VOLUME:
+            volume_delta += next.volume_delta;
+            return true;
+
+        case Kind::SEEK:
+            // Wherever this one lands, an absolute target or a fraction overrides it
+            if (next.seek.kind != RELATIVE)
+            {
+                seek = next.seek;
+                return true;
+            }
+
+            // A fraction needs the duration, only the loop knows it
+            if (seek.kind == PERCENT)
+                return false;
+
+            seek.value += next.seek.value;
+            return true;
+
+        case Kind::PAUSE:
+            return false;
+        }
+
+        return false;
     }
+};
+
+/*
+ * Bounded multi-producer, single-consumer queue of commands for the
+ * playback loop. Any thread may Push() without taking a lock, each cell
+ * carries a sequence number that tells whose turn it is. Only the loop
+ * drains it, it coalesces what it can on the way and keeps count of
+ * that and of what was dropped because the queue was full.
+ *
+ * While nothing is playing the queue is closed, a command has nothing to
+ * act on then and must not carry over to whatever is loaded next.
+ */
+class ControlQueue
+{
+public:
+    static constexpr std::size_t Capacity{ 64 };
+
+    struct Stats
+    {
+        std::uint64_t dropped{};
+        std::uint64_t coalesced{};
+        // Thrown away by Open(), queued just as the queue was closed
+        std::uint64_t stale{};
+    };
+
+    ControlQueue() noexcept
+    {
+        for (std::size_t i = 0; i < Capacity; i++)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ControlQueue(const ControlQueue&)            = delete;
+    ControlQueue(ControlQueue&&)                 = delete;
+    ControlQueue& operator=(const ControlQueue&) = delete;
+    ControlQueue& operator=(ControlQueue&&)      = delete;
+
+    // Any thread. False when the queue is full and command was dropped,
+    // or when it is closed.
+    bool Push(const Control& command) noexcept
+    {
+        if (not IsOpen())
+            return false;
+
+        auto pos = m_enqueue.load(std::memory_order_relaxed);
+        while (true)
+        {
+            auto& cell = m_cells[pos % Capacity];
+            const auto seq  = cell.sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::int64_t>(seq - pos);
+
+            if (diff == 0)
+            {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.command = command;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // The loop hasn't got to the command Capacity places back yet
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+
+        // Taking the lock orders us against a waiter that is just checking,
+        // so the wakeup can't slip in between its check and its wait.
+        {
+            std::scoped_lock lk{ m_mtx };
+        }
+        m_cv.notify_one();
+
+        return true;
+    }
+
+    // Consumer side. Takes commands from now on, whatever got in while the
+    // queue was being closed is thrown away.
+    void Open() noexcept
+    {
+        while (Pop())
+            m_stale.fetch_add(1, std::memory_order_relaxed);
+
+        m_open.store(true, std::memory_order_release);
+    }
+
+    // Any thread. Push() refuses everything until the next Open().
+    void Close() noexcept
+    { m_open.store(false, std::memory_order_release); }
+
+    [[nodiscard]] bool IsOpen() const noexcept
+    { return m_open.load(std::memory_order_acquire); }
+
+    // Consumer side. Hands every queued command to handle, in order, with
+    // neighbours that amount to one folded together first.
+    template <typename Handler>
+    void Drain(Handler&& handle)
+    {
+        std::array<Control, Capacity> batch{};
+        std::size_t count{ 0 };
+
+        while (count < Capacity)
+        {
+            const auto command = Pop();
+            if (not command)
+                break;
+
+            if (count > 0 and batch[count - 1].Absorb(*command))
+            {
+                m_coalesced.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            // Pausing twice is not pausing at all
+            if (count > 0 and command->kind == Control::Kind::PAUSE and batch[count - 1].kind == Control::Kind::PAUSE)
+            {
+                m_coalesced.fetch_add(2, std::memory_order_relaxed);
+                count--;
+                continue;
+            }
+
+            batch[count++] = *command;
+        }
+
+        for (std::size_t i = 0; i < count; i++)
+            handle(batch[i]);
+    }
+
+    // Consumer side. Blocks until something was queued or a stop is requested.
+    void Wait(std::stop_token st)
+    {
+        std::unique_lock lk{ m_mtx };
+        m_cv.wait(lk, st, [this] { return not empty(); });
+    }
+
+    // Same as Wait(), but gives up after timeout
+    template <typename Rep, typename Period>
+    void WaitFor(std::stop_token st, std::chrono::duration<Rep, Period> timeout)
+    {
+        std::unique_lock lk{ m_mtx };
+        m_cv.wait_for(lk, st, timeout, [this] { return not empty(); });
+    }
+
+    // Any thread
+    [[nodiscard]] Stats stats() const noexcept
+    {
+        return { .dropped   = m_dropped.load(std::memory_order_relaxed),
+                 .coalesced = m_coalesced.load(std::memory_order_relaxed),
+                 .stale     = m_stale.load(std::memory_order_relaxed) };
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::uint64_t> sequence{};
+        Control command{};
+    };
+
+    [[nodiscard]] bool empty() const noexcept
+    {
+        const auto pos = m_dequeue.load(std::memory_order_relaxed);
+        return m_cells[pos % Capacity].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    std::optional<Control> Pop() noexcept
+    {
+        const auto pos = m_dequeue.load(std::memory_order_relaxed);
+        auto& cell     = m_cells[pos % Capacity];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+            return std::nullopt;
+
+        const auto command = cell.command;
+
+        // The cell is free again for the push one lap ahead
+        cell.sequence.store(pos + Capacity, std::memory_order_release);
+        m_dequeue.store(pos + 1, std::memory_order_relaxed);
+        return command;
+    }
+
+    std::array<Cell, Capacity> m_cells{};
+    alignas(64) std::atomic<std::uint64_t> m_enqueue{ 0 };
+    alignas(64) std::atomic<std::uint64_t> m_dequeue{ 0 };
+
+    std::atomic<std::uint64_t> m_dropped{ 0 };
+    std::atomic<std::uint64_t> m_coalesced{ 0 };
+    std::atomic<std::uint64_t> m_stale{ 0 };
+    std::atomic<bool> m_open{ true };
 
-    std::atomic<bool> m_EventHappened;
-    std::atomic<Action> act;
+    std::mutex m_mtx;
+    std::condition_variable_any m_cv;
 };
 
 struct Completion
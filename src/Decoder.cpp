@@ -0,0 +1,684 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "Decoder.hpp"
+#include "MappedIO.hpp"
+#include "UringIO.hpp"
+#include "globals.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <limits>
+#include <ranges>
+#include <string_view>
+
+extern "C"
+{
+    #include <libavutil/intreadwrite.h>
+}
+
+// Decoded and dropped in front of an indexed seek target
+static constexpr std::int64_t SeekPreroll{ 4096 };
+
+AudioFileManager::AudioFileManager(const std::filesystem::path& filename, ContextData& ctx_data, ReadAheadSettings readAhead)
+    : m_ctx_data { &ctx_data }
+{
+    using clock = std::chrono::steady_clock;
+
+    auto start = clock::now();
+    open_and_setup(filename, readAhead);
+    auto done = clock::now();
+    m_timings.open = done - start;
+
+    start = done;
+    find_stream();
+    done = clock::now();
+    m_timings.probe = done - start;
+
+    start = done;
+    stream_open();
+    m_timings.codec = clock::now() - start;
+}
+
+// The AVIOContext for filename together with whatever owns it, empty when
+// libavformat should open the file with its own I/O.
+static std::pair<AVIOContext*, std::shared_ptr<void>> OpenIO(const std::filesystem::path& filename, ReadAheadSettings readAhead)
+{
+    // Slow and network mounted storage is read ahead through io_uring when asked for
+    if (readAhead.uring_depth > 0)
+    {
+        const auto block = static_cast<std::size_t>(readAhead.uring_block_kb) * 1024;
+        if (auto io = UringIO::Open(filename, readAhead.uring_depth, block))
+            return { io->get(), std::move(io) };
+    }
+
+    // Local files are demuxed straight out of a mapping
+    if (auto io = MappedIO::Open(filename))
+        return { io->get(), std::move(io) };
+
+    return {};
+}
+
+void AudioFileManager::open_and_setup(const std::filesystem::path& filename, ReadAheadSettings readAhead)
+{
+    AVDictionary* opt{};
+    av_dict_set(&opt, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
+
+    auto [pb, io] = OpenIO(filename, readAhead);
+
+    AVFormatContext* ctx = avformat_alloc_context();
+    if (not ctx)
+    {
+        av_dict_free(&opt);
+        throw std::runtime_error("Failed to allocate AVFormatContext");
+    }
+
+    if (pb)
+        ctx->pb = pb;
+
+    // Frees ctx on failure
+    int err = avformat_open_input(&ctx, filename.c_str(), nullptr, &opt);
+    if (err < 0)
+    {
+        av_dict_free(&opt);
+        std::array<char, AV_ERROR_MAX_STRING_SIZE> errBuff { 0 };
+
+        util::Log(color::yellow, "avformat_open_input: error code: {}, filename: {}, error msg: {}, errno: {}\n",
+                  err, filename.string(), av_make_error_string(errBuff.data(), AV_ERROR_MAX_STRING_SIZE, err), strerror(errno));
+
+        throw std::runtime_error(std::format("Error avformat_open_input, with code: {}, filename: {}, errmsg: {}", err, filename.string(), errBuff.data()));
+    }
+    av_dict_free(&opt);
+
+    // The I/O goes away together with the last reference to the context
+    m_ctx_data->format_ctx = std::shared_ptr<AVFormatContext>(ctx, [io = std::move(io)](AVFormatContext* ptr) mutable
+    {
+        avformat_close_input(&ptr);
+        io.reset();
+    });
+
+    m_ctx_data->format_ctx->interrupt_callback.callback = +[]([[maybe_unused]] void*)
+    {
+        return static_cast<int>(Globals::stop_request);
+    };
+    m_ctx_data->format_ctx->interrupt_callback.opaque = nullptr;
+
+    av_format_inject_global_side_data(m_ctx_data->format_ctx.get());
+}
+
+void AudioFileManager::find_stream()
+{
+    int err = avformat_find_stream_info(m_ctx_data->format_ctx.get(), nullptr);
+    if (err < 0)
+    {
+        throw std::runtime_error("Failed: avformat_find_stream_info");
+    }
+
+    if (m_ctx_data->format_ctx->pb)
+        m_ctx_data->format_ctx->pb->eof_reached = 0;
+
+    m_streamIndex = av_find_best_stream(m_ctx_data->format_ctx.get(), AVMEDIA_TYPE_AUDIO, m_streamIndex - 1, m_streamIndex, nullptr, 0);
+
+#ifdef DEBUG
+    av_dump_format(m_ctx_data->format_ctx.get(), m_streamIndex, m_ctx_data->format_ctx->url, 0);
+#endif
+
+    if (AVERROR_STREAM_NOT_FOUND == m_streamIndex)
+    {
+        throw std::runtime_error(std::format("No streams found in {}\n", m_ctx_data->format_ctx->url));
+    }
+    else if (AVERROR_DECODER_NOT_FOUND == m_streamIndex)
+    {
+        throw std::runtime_error(std::format("Decoder not found in {}\n", m_ctx_data->format_ctx->url));
+    }
+
+    if (m_streamIndex < 0)
+    {
+        throw std::runtime_error("Stream index < 0\n");
+    }
+}
+
+void AudioFileManager::stream_open()
+{
+    m_ctx_data->codec_ctx = std::shared_ptr<AVCodecContext> { avcodec_alloc_context3(nullptr), [](::AVCodecContext* p) { ::avcodec_free_context(&p); } };
+
+    int ret = avcodec_parameters_to_context(m_ctx_data->codec_ctx.get(), m_ctx_data->format_ctx->streams[m_streamIndex]->codecpar);
+    if (ret < 0)
+    {
+        throw std::runtime_error(std::format("avcodec_parameters_to_context failed with code: {}", ret));
+    }
+
+    m_ctx_data->codec_ctx->pkt_timebase = m_ctx_data->format_ctx->streams[m_streamIndex]->time_base;
+
+    const auto* codec = avcodec_find_decoder(m_ctx_data->codec_ctx->codec_id);
+    if (!codec)
+    {
+        throw std::runtime_error(std::format("Failed to find decoder for {} codec_id", static_cast<int>(m_ctx_data->codec_ctx->codec_id)));
+    }
+
+    // TODO: This line seems redundant
+    m_ctx_data->codec_ctx->codec_id = codec->id;
+
+    // Encoder delay and padding are trimmed by the Decoder, ask libavcodec
+    // to export them as frame side data instead of dropping them itself.
+    m_ctx_data->codec_ctx->flags2 |= AV_CODEC_FLAG2_SKIP_MANUAL;
+
+    ret = avcodec_open2(m_ctx_data->codec_ctx.get(), codec, nullptr);
+    if (ret < 0)
+    {
+        throw std::runtime_error("Failed to open codec");
+    }
+
+    if (m_ctx_data->codec_ctx->codec_type != AVMEDIA_TYPE_AUDIO)
+    {
+        throw std::runtime_error("Codec is of wrong type");
+    }
+
+    m_ctx_data->format_ctx->streams[m_streamIndex]->discard = AVDISCARD_DEFAULT;
+}
+
+// Codecs without a fixed frame size rarely go above this, FLAC's
+// default block is 4608 samples and Opus' longest frame 5760.
+static constexpr int VariableFrameSamples{ 8192 };
+
+static int OutputBufferSize(const AVCodecContext& cc, const AudioSettings& settings)
+{
+    // A whole quantum, plus the frame that completes it
+    const auto frame_samples = std::max(cc.frame_size, VariableFrameSamples);
+    return (QuantumFrames(settings) + frame_samples) * settings.ch_layout.nb_channels * av_get_bytes_per_sample(settings.fmt);
+}
+
+Decoder::Decoder(const std::filesystem::path& path, Wrap::AvPools& pools, ReadAheadSettings readAhead)
+    : m_path         { path }
+    , m_ctx_data     {}
+    , m_manager      { path, m_ctx_data, readAhead }
+    , m_swr          { *m_ctx_data.codec_ctx }
+    , m_capacity     { OutputBufferSize(*m_ctx_data.codec_ctx, *m_swr.getAudioSettings()) }
+    , m_produced_buf { Wrap::make_aligned_buffer(static_cast<std::size_t>(m_capacity)) }
+    , m_block_bytes  { QuantumFrames(*m_swr.getAudioSettings()) * m_swr.getAudioSettings()->ch_layout.nb_channels *
+                       av_get_bytes_per_sample(m_swr.getAudioFormat()) }
+    , m_frame        { pools.frames.acquire() }
+    , m_packet       { pools.packets.acquire() }
+{
+    ReadGaplessInfo();
+    StartIndexer();
+}
+
+void Decoder::ReadGaplessInfo()
+{
+    const auto* stream = m_ctx_data.format_ctx->streams[m_manager.getStreamIndex()];
+
+    m_fallback_skip = stream->codecpar->initial_padding;
+
+    // iTunes stores the encoder delay, padding and the real sample count as
+    // " 00000000 00000840 000001CA 00000000003F31F6 ..." in hex.
+    const AVDictionaryEntry* tag = av_dict_get(stream->metadata, "iTunSMPB", nullptr, AV_DICT_IGNORE_SUFFIX);
+    if (not tag)
+        tag = av_dict_get(m_ctx_data.format_ctx->metadata, "iTunSMPB", nullptr, AV_DICT_IGNORE_SUFFIX);
+
+    if (not tag or not tag->value)
+        return;
+
+    std::array<std::int64_t, 4> fields{};
+    std::size_t found{ 0 };
+
+    for (const auto word : std::string_view{ tag->value } | std::views::split(' '))
+    {
+        if (word.empty())
+            continue;
+
+        if (found == fields.size())
+            break;
+
+        const std::string_view hex{ word.begin(), word.end() };
+        if (std::from_chars(hex.data(), hex.data() + hex.size(), fields[found], 16).ec != std::errc{})
+            return;
+
+        found++;
+    }
+
+    if (found < fields.size())
+        return;
+
+    util::Log(color::aqua, "iTunSMPB delay: {}, padding: {}, samples: {}\n", fields[1], fields[2], fields[3]);
+
+    m_fallback_skip = fields[1];
+    m_samples_left  = fields[3];
+    m_total_samples = fields[3];
+}
+
+double Decoder::SecondsLeft() const noexcept
+{
+    const auto* format_ctx = m_ctx_data.format_ctx.get();
+    if (format_ctx->duration == AV_NOPTS_VALUE or m_last_pts == AV_NOPTS_VALUE)
+        return 0.0;
+
+    const auto* stream  = format_ctx->streams[m_manager.getStreamIndex()];
+    const auto duration = static_cast<double>(format_ctx->duration) / AV_TIME_BASE;
+    const auto position = static_cast<double>(m_last_pts) * av_q2d(stream->time_base);
+
+    return std::max(duration - position, 0.0);
+}
+
+double Decoder::Duration() const noexcept
+{
+    const auto* format_ctx = m_ctx_data.format_ctx.get();
+    if (format_ctx->duration == AV_NOPTS_VALUE)
+        return 0.0;
+
+    return static_cast<double>(format_ctx->duration) / AV_TIME_BASE;
+}
+
+void Decoder::TrimFrame(const AVFrame* frame, int& offset, int& nb_samples) noexcept
+{
+    // The demuxer knows about LAME/Info tags and edit lists, if it tells us
+    // what to skip, that's the only source we trust.
+    if (const auto* sd = av_frame_get_side_data(frame, AV_FRAME_DATA_SKIP_SAMPLES); sd and sd->size >= 10)
+    {
+        const auto skip    = static_cast<int>(std::min<std::uint32_t>(AV_RL32(sd->data), static_cast<std::uint32_t>(nb_samples)));
+        const auto discard = static_cast<int>(std::min<std::uint32_t>(AV_RL32(sd->data + 4), static_cast<std::uint32_t>(nb_samples - skip)));
+
+        offset     += skip;
+        nb_samples -= skip + discard;
+
+        m_first_frame = false;
+    }
+
+    if (m_first_frame)
+    {
+        m_first_frame = false;
+        m_skip_front  = m_fallback_skip;
+    }
+
+    if (m_skip_front > 0)
+    {
+        const auto skip = static_cast<int>(std::min<std::int64_t>(m_skip_front, nb_samples));
+        offset       += skip;
+        nb_samples   -= skip;
+        m_skip_front -= skip;
+    }
+
+    // Everything past the real sample count is encoder padding
+    if (m_samples_left >= 0)
+    {
+        nb_samples      = static_cast<int>(std::min<std::int64_t>(nb_samples, m_samples_left));
+        m_samples_left -= nb_samples;
+    }
+}
+
+void Decoder::DiscardToSeekTarget(const AVFrame* frame, int& offset, int& nb_samples) noexcept
+{
+    if (m_seek_target < 0 and not m_sample_cursor)
+        return;
+
+    const auto* stream    = m_ctx_data.format_ctx->streams[m_manager.getStreamIndex()];
+    const auto start_time = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+    std::int64_t first{};
+    if (m_sample_cursor)
+    {
+        // After a seek by byte offset the timestamps are made up, the samples are counted instead
+        first             = *m_sample_cursor + offset;
+        *m_sample_cursor += frame->nb_samples;
+        m_last_pts        = start_time + av_rescale_q(*m_sample_cursor, AVRational{ 1, frame->sample_rate }, stream->time_base);
+
+        if (m_seek_target < 0)
+            return;
+    }
+    else
+    {
+        const auto pts = frame->best_effort_timestamp != AV_NOPTS_VALUE ? frame->best_effort_timestamp : frame->pts;
+
+        // Nothing to line up against, play from wherever the demuxer landed
+        if (pts == AV_NOPTS_VALUE)
+        {
+            m_seek_target = -1;
+            return;
+        }
+
+        first = av_rescale_q(pts - start_time, stream->time_base, AVRational{ 1, frame->sample_rate }) + offset;
+    }
+
+    const auto skip = static_cast<int>(std::clamp<std::int64_t>(m_seek_target - first, 0, nb_samples));
+
+    offset     += skip;
+    nb_samples -= skip;
+
+    // Still short of the target, the next frame carries on
+    if (nb_samples == 0 and first + skip < m_seek_target)
+        return;
+
+    if (m_total_samples >= 0)
+        m_samples_left = std::max<std::int64_t>(m_total_samples + m_fallback_skip - (first + skip), 0);
+
+    m_seek_target = -1;
+}
+
+bool Decoder::SeekIndexed(std::int64_t target)
+{
+    if (not m_index_ready.load(std::memory_order_acquire))
+        return false;
+
+    auto* format_ctx = m_ctx_data.format_ctx.get();
+    auto* stream     = format_ctx->streams[m_manager.getStreamIndex()];
+
+    if (m_index->GetKind() == SeekIndex::Kind::CONTAINER)
+    {
+        // libavformat starts its bisection from the closest of these
+        if (not std::exchange(m_index_applied, true))
+        {
+            for (const auto& entry : m_index->entries())
+            {
+                av_add_index_entry(stream, entry.offset, entry.time, 0, 0, AVINDEX_KEYFRAME);
+            }
+        }
+
+        return false;
+    }
+
+    const auto rate         = m_ctx_data.codec_ctx->sample_rate;
+    const auto start_time   = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    const auto start_sample = av_rescale_q(start_time, stream->time_base, AVRational{ 1, rate });
+
+    // Decoders need a few frames to settle after a jump, the bit reservoir and the overlap
+    const auto from  = std::max<std::int64_t>(start_sample + target - SeekPreroll, 0);
+    const auto entry = m_index->Find(av_rescale(from, m_index->rate(), rate));
+    if (not entry)
+        return false;
+
+    if (avformat_seek_file(format_ctx, -1, entry->offset, entry->offset, entry->offset, AVSEEK_FLAG_BYTE) < 0)
+        return false;
+
+    m_sample_cursor = av_rescale(entry->time, rate, m_index->rate()) - start_sample;
+    return true;
+}
+
+void Decoder::StartIndexer()
+{
+    const auto kind = SeekIndex::KindFor(m_ctx_data.format_ctx.get());
+    if (not kind)
+        return;
+
+    if (auto cached = SeekIndex::Load(m_path))
+    {
+        m_index = std::move(cached);
+        m_index_ready.store(true, std::memory_order_release);
+        return;
+    }
+
+    m_indexer = std::jthread{ [this, kind = *kind](std::stop_token st)
+    {
+        auto built = SeekIndex::Build(m_path, kind, st);
+        if (not built)
+            return;
+
+        try
+        {
+            built->Save();
+        }
+        catch (const std::exception& e)
+        {
+            util::Log(color::yellow, "Seek index for {} not cached: {}\n", m_path.string(), e.what());
+        }
+
+        m_index = std::move(built);
+        m_index_ready.store(true, std::memory_order_release);
+    } };
+}
+
+int Decoder::ConvertFrame(const AVFrame* frame, int offset, int nb_samples, std::uint8_t* out)
+{
+    constexpr int MaxPlanes{ 64 };
+
+    const auto channels = frame->ch_layout.nb_channels;
+    const auto format   = static_cast<AVSampleFormat>(frame->format);
+    const auto planar   = av_sample_fmt_is_planar(format);
+    const auto skip     = offset * av_get_bytes_per_sample(format) * (planar ? 1 : channels);
+
+    std::array<std::uint8_t*, MaxPlanes> planes{};
+    for (int i = 0; i < std::min(planar ? channels : 1, MaxPlanes); i++)
+    {
+        planes[i] = frame->extended_data[i] + skip;
+    }
+
+    if (m_swr)
+    {
+        const auto ret = m_swr.convert(&out, nb_samples, planes.data(), nb_samples);
+        return ret * channels * av_get_bytes_per_sample(m_swr.getAudioFormat());
+    }
+
+    int buffer_used_len = av_samples_get_buffer_size(nullptr, channels, nb_samples, m_swr.getAudioFormat(), 1);
+    if (buffer_used_len < 0)
+    {
+        std::array<char, 128> errbuf{};
+        av_strerror(buffer_used_len, errbuf.data(), errbuf.size());
+        util::Log("av_samples_get_buffer_size failed with: {}\n", errbuf.data());
+        return 0;
+    }
+
+    memcpy(out, planes[0], buffer_used_len);
+    return buffer_used_len;
+}
+
+void Decoder::Prime()
+{
+    int ret{ 0 };
+    while (ret == 0)
+    {
+        ret = Decode();
+    }
+
+    m_primed = std::max(ret, 0);
+}
+
+bool Decoder::FeedDecoder()
+{
+    auto* cc  = m_ctx_data.codec_ctx.get();
+    auto* pkt = m_packet.get();
+
+    if (not m_packet_pending)
+    {
+        av_packet_unref(pkt);
+
+        if (int ret = av_read_frame(m_ctx_data.format_ctx.get(), pkt); ret < 0)
+        {
+            if (ret != AVERROR_EOF)
+            {
+                std::array<char, 128> buf{};
+                int error_ret = av_strerror(ret, buf.data(), buf.size());
+                if (error_ret == 0)
+                    throw std::runtime_error(std::format("Error: {}\n", buf.data()));
+                else
+                    throw std::runtime_error("Failed abtain erorr from av_strerorr");
+            }
+
+            // Drain the frames the decoder is still holding on to
+            if (not m_draining)
+            {
+                util::Log("av_read_frame: EOF\n");
+                avcodec_send_packet(cc, nullptr);
+                m_draining = true;
+            }
+
+            return false;
+        }
+
+        // read_frame() likes to return other stream's
+        // like mp3's stream which contains album art
+        if (pkt->stream_index != m_manager.getStreamIndex())
+            return true;
+
+        if (pkt->pts != AV_NOPTS_VALUE and not m_sample_cursor)
+            m_last_pts = pkt->pts;
+
+        m_packet_pending = true;
+    }
+
+    // The decoder is full, the packet stays pending until its frames are received
+    int ret = avcodec_send_packet(cc, pkt);
+    if (ret == AVERROR(EAGAIN))
+        return true;
+
+    if (ret < 0 && ret != AVERROR_EOF)
+    {
+        util::Log("send_packet error {}\n", ret);
+        handle_error(ret);
+    }
+
+    m_packet_pending = false;
+    return true;
+}
+
+int Decoder::Decode()
+{
+    if (m_primed > 0)
+    {
+        return std::exchange(m_primed, 0);
+    }
+
+    auto* cc    = m_ctx_data.codec_ctx.get();
+    auto* frame = m_frame.get();
+
+    const auto out_frame_size = m_swr.getAudioSettings()->ch_layout.nb_channels * av_get_bytes_per_sample(m_swr.getAudioFormat());
+
+    int produced{ 0 };
+    while (produced < m_block_bytes)
+    {
+        if (not m_frame_ready)
+        {
+            int ret = avcodec_receive_frame(cc, frame);
+            if (ret == AVERROR_EOF)
+            {
+                if (produced > 0)
+                    break;
+
+                util::Log(color::beige, "End of file reached\n");
+                return -1;
+            }
+
+            if (ret == AVERROR(EAGAIN))
+            {
+                // The decoder wants more input
+                FeedDecoder();
+                continue;
+            }
+
+            if (ret < 0)
+            {
+                std::array<char, 128> error_buf{};
+                av_strerror(ret, error_buf.data(), error_buf.size());
+
+                if (ret == AVERROR(EINVAL))
+                {
+                    throw std::runtime_error(std::format("Codec is not open: {}", error_buf.data()));
+                }
+
+                util::Log("avcodec_receive_frame: {}\n", error_buf.data());
+                FeedDecoder();
+                continue;
+            }
+
+            m_frame_offset  = 0;
+            m_frame_samples = frame->nb_samples;
+            TrimFrame(frame, m_frame_offset, m_frame_samples);
+            DiscardToSeekTarget(frame, m_frame_offset, m_frame_samples);
+
+            // The whole frame was encoder delay or padding
+            if (m_frame_samples <= 0)
+            {
+                av_frame_unref(frame);
+                continue;
+            }
+
+            m_frame_ready = true;
+        }
+
+        // Doesn't fit behind what we have, it starts the next block instead
+        if (const auto needed = m_frame_samples * out_frame_size; produced + needed > m_capacity)
+        {
+            if (produced > 0)
+                break;
+
+            // Bigger than the codec let us expect, the buffer is empty so nothing has to be kept
+            util::Log(color::yellow, "Growing the conversion buffer for a frame of {} samples\n", m_frame_samples);
+            m_buffer_lock  = {};
+            m_capacity     = needed;
+            m_produced_buf = Wrap::make_aligned_buffer(static_cast<std::size_t>(m_capacity));
+
+            if (m_lock_buffer)
+                m_buffer_lock = rt::MemoryLock{ m_produced_buf.get(), BufferCapacity() };
+        }
+
+        produced += ConvertFrame(frame, m_frame_offset, m_frame_samples, m_produced_buf.get() + produced);
+
+        av_frame_unref(frame);
+        m_frame_ready = false;
+    }
+
+    return produced;
+}
+
+void Decoder::LockBuffer() noexcept
+{
+    if (m_lock_buffer)
+        return;
+
+    m_lock_buffer = true;
+    m_buffer_lock = rt::MemoryLock{ m_produced_buf.get(), BufferCapacity() };
+}
+
+void Decoder::Seek(std::int64_t sample)
+{
+    avcodec_flush_buffers(m_ctx_data.codec_ctx.get());
+
+    // iTunSMPB counts its delay as part of the stream, the position doesn't
+    const auto* stream    = m_ctx_data.format_ctx->streams[m_manager.getStreamIndex()];
+    const auto start_time = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    const auto target     = std::max<std::int64_t>(sample, 0) + m_fallback_skip;
+    const auto target_pts = start_time + av_rescale_q(target, AVRational{ 1, m_ctx_data.codec_ctx->sample_rate }, stream->time_base);
+
+    // Land on the last keyframe at or before the target, the rest is decoded and dropped
+    m_sample_cursor.reset();
+    if (not SeekIndexed(target))
+    {
+        const auto seek_min = std::numeric_limits<std::int64_t>::min();
+        int ret = avformat_seek_file(m_ctx_data.format_ctx.get(), m_manager.getStreamIndex(), seek_min, target_pts, target_pts, 0);
+        if (ret < 0)
+        {
+            util::Log(color::red, "Seek failed\n");
+        }
+    }
+
+    // Whatever was demuxed or decoded before the seek is stale
+    av_frame_unref(m_frame.get());
+    av_packet_unref(m_packet.get());
+    m_frame_ready    = false;
+    m_packet_pending = false;
+    m_draining       = false;
+
+    // The encoder delay is behind us, the padding is worked out once the target is reached
+    m_primed       = 0;
+    m_first_frame  = false;
+    m_skip_front   = 0;
+    m_samples_left = -1;
+    m_seek_target  = target;
+    m_last_pts     = target_pts;
+}
@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "Wrapper.hpp"
+#include "ContextData.hpp"
+#include "AudioSettings.hpp"
+#include "Realtime.hpp"
+#include "SampleConvert.hpp"
+#include "SeekIndex.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <thread>
+#include <utility>
+
+extern "C"
+{
+    #include <libavformat/avformat.h>
+    #include <libavcodec/avcodec.h>
+    #include <libswresample/swresample.h>
+}
+
+inline const auto handle_error = [](int ret)
+{
+    if (ret != AVERROR(EAGAIN))
+    {
+        constexpr int bufSize{ 64 };
+        std::array<char, bufSize> errBuff { 0 };
+        int r = av_strerror(ret, errBuff.data(), bufSize);
+
+        if (r < 0)
+            throw std::runtime_error("av_strerror failed or did not find a description for error\n");
+        else
+            throw std::runtime_error(std::format("Error {}\n", errBuff.data()));
+    }
+};
+
+// This function comaprers wheather ffmpeg's format is the same as pipewires
+inline bool DoesPipewireSupportFormat(AVSampleFormat fmt) noexcept
+{
+    switch (fmt)
+    {
+    case AV_SAMPLE_FMT_U8:  [[fallthrough]];
+    case AV_SAMPLE_FMT_S16: [[fallthrough]];
+    case AV_SAMPLE_FMT_S32: [[fallthrough]];
+    case AV_SAMPLE_FMT_FLT: [[fallthrough]];
+    case AV_SAMPLE_FMT_DBL:
+        return true;
+
+    case AV_SAMPLE_FMT_NONE: [[fallthrough]];
+    default:
+        return false;
+    }
+}
+
+// The closest format Pipewire takes without losing precision. Planar
+// formats only need interleaving, 24-bit sources already arrive as S32.
+inline AVSampleFormat NativeOutputFormat(AVSampleFormat fmt) noexcept
+{
+    switch (fmt)
+    {
+    case AV_SAMPLE_FMT_S64:  [[fallthrough]];
+    case AV_SAMPLE_FMT_S64P:
+        return AV_SAMPLE_FMT_DBL;
+
+    default:
+        return av_get_packed_sample_fmt(fmt);
+    }
+}
+
+class Resample
+{
+public:
+    Resample(const Resample&) = delete;
+    Resample(Resample&&) = delete;
+    Resample& operator=(const Resample&) = delete;
+    Resample& operator=(Resample&&) = delete;
+
+    Resample(AVCodecContext &cc)
+        : m_audioSettings{ std::make_shared<AudioSettings>() }
+    {
+        // The rate is left alone, if the graph runs at a different one
+        // Pipewire's adapter resamples, and only then.
+        if (not DoesPipewireSupportFormat(cc.sample_fmt))
+        {
+            const auto out_fmt = NativeOutputFormat(cc.sample_fmt);
+
+            util::Log(color::aqua, "Codec: {}, Desired format: {}, but going to use: {}, sample: {}\n", avcodec_get_name(cc.codec_id),
+                                                                                                        SampleFormatName(cc.sample_fmt),
+                                                                                                        SampleFormatName(out_fmt),
+                                                                                                        cc.sample_rate);
+
+            m_audioSettings->freq      = cc.sample_rate;
+            m_audioSettings->fmt       = out_fmt;
+            m_audioSettings->ch_layout = cc.ch_layout;
+
+            // Only the layout or the representation changes, no need for swr
+            if (Convert::Converter::Supported(cc.sample_fmt, out_fmt))
+            {
+                m_kernel.emplace(cc.sample_fmt, out_fmt, cc.ch_layout.nb_channels);
+                util::Log(color::aqua, "Using {} conversion kernels\n", Convert::ToString(m_kernel->GetIsa()));
+                return;
+            }
+
+            int ret = swr_alloc_set_opts2(&m_swr_ctx,
+                                       /* out_ch_layout  out_sample_fmt     out_sample_rate */
+                                          &cc.ch_layout, out_fmt,           cc.sample_rate,
+                                       /* in_ch_layout   in_sample_fmt      in_sample_rate */
+                                          &cc.ch_layout, cc.sample_fmt,     cc.sample_rate,
+                                          0, nullptr);
+            if (ret != 0)
+            {
+                handle_error(ret);
+            }
+
+            ret = swr_init(m_swr_ctx);
+            if (ret < 0)
+            {
+                swr_free(&m_swr_ctx);
+                util::Log("swr_init error\n");
+                handle_error(ret);
+            }
+        }
+        else
+        {
+            util::Log(color::aqua, "Codec: {}, format: {}, sample: {}, Not initializing SWR\n", avcodec_get_name(cc.codec_id),
+                                                                                                SampleFormatName(cc.sample_fmt),
+                                                                                                cc.sample_rate);
+
+            m_audioSettings->freq      = cc.sample_rate;
+            m_audioSettings->fmt       = cc.sample_fmt;
+            m_audioSettings->ch_layout = cc.ch_layout;
+        }
+    }
+
+    int convert(std::uint8_t** out, int out_count, std::uint8_t** in, int in_count)
+    {
+        if (m_kernel)
+        {
+            const auto count = std::min(out_count, in_count);
+            (*m_kernel)(out[0], in, count);
+            return count;
+        }
+
+        if (int ret = swr_convert(m_swr_ctx, out, out_count, const_cast<const std::uint8_t**>(in), in_count); ret >= 0)
+        {
+            return ret;
+        }
+
+        return 0;
+    }
+
+    ~Resample()
+    {
+        swr_free(&m_swr_ctx);
+    }
+
+    operator bool() const noexcept
+    {
+        return m_swr_ctx or m_kernel;
+    }
+
+    operator SwrContext*() const noexcept { return m_swr_ctx; }
+
+    [[nodiscard]] std::shared_ptr<AudioSettings> getAudioSettings() const noexcept
+    { return m_audioSettings; }
+
+    [[nodiscard]] AVSampleFormat getAudioFormat() const noexcept
+    { return m_audioSettings->fmt; }
+
+private:
+    std::shared_ptr<AudioSettings> m_audioSettings;
+    SwrContext* m_swr_ctx{};
+    std::optional<Convert::Converter> m_kernel{};
+};
+
+// How long each step of opening a file took
+struct OpenTimings
+{
+    std::chrono::nanoseconds open{};
+    std::chrono::nanoseconds probe{};
+    std::chrono::nanoseconds codec{};
+};
+
+class AudioFileManager
+{
+public:
+    explicit AudioFileManager(const std::filesystem::path& filename, ContextData&, ReadAheadSettings readAhead = {});
+
+    [[nodiscard]] int getStreamIndex() const noexcept
+    { return m_streamIndex; }
+
+    [[nodiscard]] const OpenTimings& getTimings() const noexcept
+    { return m_timings; }
+
+private:
+    void open_and_setup(const std::filesystem::path& filename, ReadAheadSettings readAhead);
+    void stream_open();
+    void find_stream();
+
+    ContextData* m_ctx_data{};
+    int m_streamIndex{};
+    OpenTimings m_timings{};
+};
+
+// Everything that is needed to turn one file into PCM in the output format.
+// It isn't locked, only one thread at a time may use it: the one preparing
+// it until it is handed over, then the producer that plays it.
+class Decoder
+{
+public:
+    // The packet and frame are borrowed from pools for as long as the decoder lives
+    explicit Decoder(const std::filesystem::path& path, Wrap::AvPools& pools, ReadAheadSettings readAhead = {});
+
+    Decoder(const Decoder&)            = delete;
+    Decoder(Decoder&&)                 = delete;
+    Decoder& operator=(const Decoder&) = delete;
+    Decoder& operator=(Decoder&&)      = delete;
+
+    // Decodes at least one output quantum into buffer(), fewer bytes only at the
+    // end of the file. Returns the length in bytes, 0 when nothing could be
+    // produced this time and -1 at the end of the file.
+    int Decode();
+
+    // Decodes the first chunk ahead of time, so that the next Decode() is free.
+    void Prime();
+
+    // Continues from sample, counted in frames of the decoded stream. Whatever
+    // the demuxer lands on before it is decoded and dropped, so the next
+    // Decode() starts exactly on the target.
+    void Seek(std::int64_t sample);
+
+    [[nodiscard]] const std::uint8_t* buffer() const noexcept
+    { return m_produced_buf.get(); }
+
+    // The most a single Decode() produces, unless a frame is larger than the codec announced
+    [[nodiscard]] std::size_t BufferCapacity() const noexcept
+    { return static_cast<std::size_t>(m_capacity); }
+
+    // Keeps buffer() resident from now on, the lock follows the buffer when
+    // a frame makes it grow and is let go of before the buffer is freed.
+    void LockBuffer() noexcept;
+
+    [[nodiscard]] std::size_t LockedBytes() const noexcept
+    { return m_buffer_lock.size(); }
+
+    [[nodiscard]] const ContextData& getContextData() const noexcept
+    { return m_ctx_data; }
+
+    [[nodiscard]] std::shared_ptr<AudioSettings> getAudioSettings() const noexcept
+    { return m_swr.getAudioSettings(); }
+
+    [[nodiscard]] const std::filesystem::path& getPath() const noexcept
+    { return m_path; }
+
+    [[nodiscard]] const OpenTimings& getOpenTimings() const noexcept
+    { return m_manager.getTimings(); }
+
+    // How much of the file is left to demux, 0 if the duration is unknown
+    [[nodiscard]] double SecondsLeft() const noexcept;
+
+    // Length of the file in seconds, 0 if unknown
+    [[nodiscard]] double Duration() const noexcept;
+
+private:
+    void ReadGaplessInfo();
+    void TrimFrame(const AVFrame* frame, int& offset, int& nb_samples) noexcept;
+    void DiscardToSeekTarget(const AVFrame* frame, int& offset, int& nb_samples) noexcept;
+
+    // Looks the file up in the cache or has it scanned in the background
+    void StartIndexer();
+    // Seeks through the index, false if the demuxer has to do it on its own
+    bool SeekIndexed(std::int64_t target);
+
+    int ConvertFrame(const AVFrame* frame, int offset, int nb_samples, std::uint8_t* out);
+
+    // Demuxes a packet and sends it, returns false once there are no more
+    bool FeedDecoder();
+
+    std::filesystem::path m_path;
+    ContextData m_ctx_data{};
+    AudioFileManager m_manager;
+    Resample m_swr;
+    int m_capacity{};
+    Wrap::align_buf_t m_produced_buf{};
+    int m_block_bytes{};
+
+    // Declared after the buffer, it goes first
+    rt::MemoryLock m_buffer_lock{};
+    bool m_lock_buffer{};
+
+    // A received frame that didn't fit the last block, and a packet
+    // the decoder refused with EAGAIN. Both are picked up next time.
+    Wrap::Pool<AVFrame>::Handle m_frame;
+    Wrap::Pool<AVPacket>::Handle m_packet;
+    bool m_frame_ready{};
+    bool m_packet_pending{};
+    bool m_draining{};
+    int m_frame_offset{};
+    int m_frame_samples{};
+
+    int m_primed{};
+    std::int64_t m_last_pts{ AV_NOPTS_VALUE };
+
+    // Gapless trimming, in samples of the decoded stream
+    bool m_first_frame{ true };
+    std::int64_t m_skip_front{};
+    std::int64_t m_fallback_skip{};
+    std::int64_t m_samples_left{ -1 };
+    std::int64_t m_total_samples{ -1 };
+
+    // Sample the last Seek() asked for, until a frame reaches it
+    std::int64_t m_seek_target{ -1 };
+
+    // Where the next frame starts after a seek through the index
+    std::optional<std::int64_t> m_sample_cursor{};
+
+    std::optional<SeekIndex> m_index{};
+    std::atomic<bool> m_index_ready{};
+    bool m_index_applied{};
+
+    // Last, so it is stopped before anything it writes to goes away
+    std::jthread m_indexer{};
+};
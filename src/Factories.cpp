@@ -139,24 +139,27 @@ std::tuple<ncpp::Plane, ncpp::Plane, ncpp::Plane> MakePlanes()
 }
 
 std::shared_ptr<CommandProcessor> MakeCommandProcessor(const std::shared_ptr<ListView>& albumViewPtr,
-                                                       const std::shared_ptr<ListView>& songViewPtr) noexcept
+                                                       const std::shared_ptr<ListView>& songViewPtr,
+                                                       std::weak_ptr<PlaybackEngine> engine) noexcept
 {
     auto com = std::make_shared<CommandProcessor>();
     com->registerCommand("/",            std::make_shared<SearchCommand>(albumViewPtr, songViewPtr)); // Special command
     com->registerCommand("add",          std::make_shared<Add>(albumViewPtr));
     com->registerCommand("hello",        std::make_shared<HelloWorld>());
-    com->registerCommand("clear",        std::make_shared<Clear>(albumViewPtr, songViewPtr));
+    com->registerCommand("clear",        std::make_shared<Clear>(albumViewPtr, songViewPtr, std::move(engine)));
     com->registerCommand("bind",         std::make_shared<BindCommand>());
     com->registerCommand("up",           std::make_shared<Up>(albumViewPtr, songViewPtr));
     com->registerCommand("down",         std::make_shared<Down>(albumViewPtr, songViewPtr));
     com->registerCommand("seekforward",  std::make_shared<SeekForwards>(albumViewPtr, songViewPtr));
     com->registerCommand("seekback",     std::make_shared<SeekBackwards>(albumViewPtr, songViewPtr));
+    com->registerCommand("seek",         std::make_shared<Seek>());
     com->registerCommand("quit",         std::make_shared<Quit>());
     com->registerCommand("cyclefocus",   std::make_shared<CycleFocus>(albumViewPtr, songViewPtr));
     com->registerCommand("play",         std::make_shared<Play>(albumViewPtr, songViewPtr));
     com->registerCommand("togglepause",  std::make_shared<Pause>());
     com->registerCommand("volup",        std::make_shared<Volup>());
     com->registerCommand("voldown",      std::make_shared<Voldown>());
+    com->registerCommand("threads",      std::make_shared<Threads>());
 
     return com;
 }
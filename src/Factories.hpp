@@ -37,7 +37,11 @@ std::tuple<ncpp::Plane, ncpp::Plane, ncpp::Plane> MakePlanes();
 
 std::unique_ptr<ncpp::Plane> MakeStatusPlane() noexcept;
 
-std::shared_ptr<CommandProcessor> MakeCommandProcessor(const std::shared_ptr<ListView>&, const std::shared_ptr<ListView>&) noexcept;
+class PlaybackEngine;
+
+// 'clear' stops what engine is playing, if there is one
+std::shared_ptr<CommandProcessor> MakeCommandProcessor(const std::shared_ptr<ListView>&, const std::shared_ptr<ListView>&,
+                                                       std::weak_ptr<PlaybackEngine> engine = {}) noexcept;
 
 using MakeViewFunc = std::function<ListView::ItemContainer(std::filesystem::path&&)>;
 ListView MakeView(ncpp::Plane&, MakeViewFunc);
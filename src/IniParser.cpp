@@ -181,6 +181,11 @@ const IniSection& IniParser::operator[](std::string_view index) const
     return *ret;
 }
 
+bool IniParser::contains(std::string_view index) const noexcept
+{
+    return rn::find(m_sections, index, &IniSection::section_name) != m_sections.end();
+}
+
 void IniParser::SaveToFile(std::string_view filename) const
 {
     std::fstream fs{ filename.data(), std::fstream::out };
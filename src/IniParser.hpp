@@ -86,6 +86,9 @@ public:
     [[nodiscard]] IniSection& operator[](std::string_view index);
     [[nodiscard]] const IniSection& operator[](std::string_view index) const;
 
+    // For the sections that may be left out, operator[] throws on those
+    [[nodiscard]] bool contains(std::string_view index) const noexcept;
+
     void SaveToFile(std::string_view filename) const;
 
 private:
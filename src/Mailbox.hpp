@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+/*
+ * Single slot for handing a value from one thread to another, the latest
+ * value posted wins. It is a triple buffer: the writer fills a slot of its
+ * own and swaps it with the shared middle one, the reader swaps the middle
+ * one with its own when it is marked fresh. Neither side ever waits.
+ */
+template<typename T>
+    requires std::is_trivially_copyable_v<T>
+class Mailbox
+{
+public:
+    Mailbox() = default;
+
+    Mailbox(const Mailbox&)            = delete;
+    Mailbox(Mailbox&&)                 = delete;
+    Mailbox& operator=(const Mailbox&) = delete;
+    Mailbox& operator=(Mailbox&&)      = delete;
+
+    // Writer side. Replaces whatever the reader hasn't taken yet.
+    void post(const T& value) noexcept
+    {
+        m_slots[m_back] = value;
+        m_back = m_middle.exchange(m_back | Fresh, std::memory_order_acq_rel) & Index;
+    }
+
+    // Reader side. The value posted last, if anything was posted since the last take().
+    [[nodiscard]] std::optional<T> take() noexcept
+    {
+        if (not (m_middle.load(std::memory_order_relaxed) & Fresh))
+            return std::nullopt;
+
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & Index;
+        return m_slots[m_front];
+    }
+
+private:
+    static constexpr std::uint8_t Index{ 0b011 };
+    static constexpr std::uint8_t Fresh{ 0b100 };
+
+    std::array<T, 3> m_slots{};
+    std::uint8_t m_back{ 0 };
+    std::atomic<std::uint8_t> m_middle{ 1 };
+    std::uint8_t m_front{ 2 };
+};
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "MappedIO.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+extern "C"
+{
+    #include <libavutil/error.h>
+    #include <libavutil/mem.h>
+}
+
+// What avio reads into for its own small reads, probing and headers
+static constexpr int IOBufferSize{ 64 * 1024 };
+
+// How far ahead of the read position the kernel is asked to fault pages in
+static constexpr std::size_t ReadAhead{ 2 * 1024 * 1024 };
+
+std::shared_ptr<MappedIO> MappedIO::Open(const std::filesystem::path& path) noexcept
+{
+    // Non-blocking, a FIFO would otherwise wait for a writer right here
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 or not S_ISREG(st.st_mode) or st.st_size <= 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    const auto size = static_cast<std::size_t>(st.st_size);
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if (data == MAP_FAILED)
+    {
+        util::Log(color::yellow, "mmap of {} failed: {}\n", path.string(), std::strerror(errno));
+        close(fd);
+        return nullptr;
+    }
+
+    // The descriptor stays open to notice the file shrinking
+    try
+    {
+        return std::shared_ptr<MappedIO>(new MappedIO{ fd, static_cast<const std::uint8_t*>(data), size });
+    }
+    catch (const std::exception& e)
+    {
+        util::Log(color::yellow, "Mapped I/O for {}: {}\n", path.string(), e.what());
+        munmap(data, size);
+        close(fd);
+        return nullptr;
+    }
+}
+
+MappedIO::MappedIO(int fd, const std::uint8_t* data, std::size_t size)
+    : m_fd     { fd }
+    , m_data   { data }
+    , m_mapped { size }
+    , m_size   { size }
+{
+    auto* buffer = static_cast<std::uint8_t*>(av_malloc(IOBufferSize));
+    if (not buffer)
+    {
+        throw std::runtime_error("Failed to allocate the I/O buffer");
+    }
+
+    m_avio = avio_alloc_context(buffer, IOBufferSize, 0, this, read_packet, nullptr, seek);
+    if (not m_avio)
+    {
+        av_free(buffer);
+        throw std::runtime_error("Failed to allocate the AVIOContext");
+    }
+
+    // Large reads go straight from the mapping into the caller's buffer and
+    // seeks aren't second guessed, both are free here.
+    m_avio->direct = 1;
+
+    madvise(const_cast<std::uint8_t*>(m_data), m_mapped, MADV_SEQUENTIAL);
+    advise();
+}
+
+MappedIO::~MappedIO()
+{
+    av_freep(&m_avio->buffer);
+    avio_context_free(&m_avio);
+    munmap(const_cast<std::uint8_t*>(m_data), m_mapped);
+    close(m_fd);
+}
+
+void MappedIO::advise() noexcept
+{
+    // Until the reader is past the middle of the window or jumps out of it
+    if (m_pos >= m_window_begin and m_pos + ReadAhead / 2 < m_window_end)
+        return;
+
+    // Past the new end the pages fault, the file ends where it ends now
+    if (struct stat st{}; fstat(m_fd, &st) == 0 and static_cast<std::size_t>(std::max<off_t>(st.st_size, 0)) < m_size)
+    {
+        util::Log(color::yellow, "Mapped file shrank from {} to {} bytes\n", m_size, st.st_size);
+        m_size = static_cast<std::size_t>(std::max<off_t>(st.st_size, 0));
+    }
+
+    const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+
+    m_window_begin = m_pos / page * page;
+    m_window_end   = std::min(m_pos + ReadAhead, m_size);
+
+    if (m_window_end > m_window_begin)
+        madvise(const_cast<std::uint8_t*>(m_data) + m_window_begin, m_window_end - m_window_begin, MADV_WILLNEED);
+}
+
+int MappedIO::read_packet(void* opaque, std::uint8_t* buf, int buf_size) noexcept
+{
+    auto* self = static_cast<MappedIO*>(opaque);
+    self->advise();
+
+    // Never past the window the size was checked for
+    const auto end = std::max(self->m_pos, std::min(self->m_window_end, self->m_size));
+    const auto n   = std::min(static_cast<std::size_t>(std::max(buf_size, 0)), end - self->m_pos);
+    if (n == 0)
+        return AVERROR_EOF;
+
+    std::memcpy(buf, self->m_data + self->m_pos, n);
+    self->m_pos += n;
+
+    return static_cast<int>(n);
+}
+
+std::int64_t MappedIO::seek(void* opaque, std::int64_t offset, int whence) noexcept
+{
+    auto* self = static_cast<MappedIO*>(opaque);
+
+    std::int64_t pos{};
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return static_cast<std::int64_t>(self->m_size);
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = static_cast<std::int64_t>(self->m_pos) + offset;
+        break;
+    case SEEK_END:
+        pos = static_cast<std::int64_t>(self->m_size) + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (pos < 0 or pos > static_cast<std::int64_t>(self->m_size))
+        return AVERROR(EINVAL);
+
+    self->m_pos = static_cast<std::size_t>(pos);
+    self->advise();
+
+    return pos;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+extern "C"
+{
+    #include <libavformat/avio.h>
+}
+
+/*
+ * AVIOContext over a memory mapped local file. The demuxer reads straight
+ * out of the mapping without a syscall per read, the page cache does the
+ * read-ahead and a seek is nothing more than a new offset.
+ *
+ * Touching a page past the end of a file that shrank raises SIGBUS, e.g.
+ * after a tagger rewrote it in place or another host changed it over NFS.
+ * The size is checked again whenever the read-ahead window moves and
+ * reads never go past the window, so a file that shrank ends there like
+ * it does for read(). What is left is a truncation that cuts into the
+ * current window after it was checked.
+ */
+class MappedIO
+{
+public:
+    MappedIO(const MappedIO&)            = delete;
+    MappedIO(MappedIO&&)                 = delete;
+    MappedIO& operator=(const MappedIO&) = delete;
+    MappedIO& operator=(MappedIO&&)      = delete;
+
+    // nullptr for pipes, devices, empty files and anything that can't be
+    // mapped, libavformat opens those with its own I/O then.
+    [[nodiscard]] static std::shared_ptr<MappedIO> Open(const std::filesystem::path& path) noexcept;
+
+    ~MappedIO();
+
+    // Has to outlive the AVFormatContext it is handed to
+    [[nodiscard]] AVIOContext* get() const noexcept
+    { return m_avio; }
+
+    // Less than the mapping once the file was seen to shrink
+    [[nodiscard]] std::size_t size() const noexcept
+    { return m_size; }
+
+private:
+    MappedIO(int fd, const std::uint8_t* data, std::size_t size);
+
+    static int read_packet(void* opaque, std::uint8_t* buf, int buf_size) noexcept;
+    static std::int64_t seek(void* opaque, std::int64_t offset, int whence) noexcept;
+
+    // Asks the kernel to start reading the window ahead of m_pos, the
+    // size of the file is checked again every time the window moves
+    void advise() noexcept;
+
+    int m_fd;
+    const std::uint8_t* m_data;
+    const std::size_t m_mapped;
+    std::size_t m_size;
+    std::size_t m_pos{};
+    std::size_t m_window_begin{};
+    std::size_t m_window_end{};
+    AVIOContext* m_avio{};
+};
@@ -18,9 +18,14 @@
  */
 
 #include "Pipewire.hpp"
+#include "Realtime.hpp"
 #include "util.hpp"
 
-#include <cmath>
+#include <array>
+#include <cerrno>
+#include <format>
+#include <limits>
+#include <thread>
 #include <utility>
 
 #define PW_KEY_NODE_RATE "node.rate"
@@ -45,8 +50,9 @@ enum
     FMT_S24_3LE,
     FMT_S24_3BE,
     FMT_U24_3LE,
-    FMT_U24_3BE
-}; /* packed in 3 bytes */
+    FMT_U24_3BE, /* packed in 3 bytes */
+    FMT_DOUBLE
+};
 
 // Convert ffmpegs format to pipewires format. If conversion is not possible default to FMT_S16_LE.
 static int ConvertFFMPEGFormatToPipewire(enum AVSampleFormat format)
@@ -60,13 +66,14 @@ static int ConvertFFMPEGFormatToPipewire(enum AVSampleFormat format)
     case AV_SAMPLE_FMT_S16:
         return FMT_S16_LE;
 
-    // This should work in the future.
-    // case AV_SAMPLE_FMT_S32:
-    //     return FMT_S32_LE;
+    // 24-bit sources are decoded into the upper bits of S32
+    case AV_SAMPLE_FMT_S32:
+        return FMT_S32_LE;
     case AV_SAMPLE_FMT_FLT:
         return FMT_FLOAT;
+    case AV_SAMPLE_FMT_DBL:
+        return FMT_DOUBLE;
 
-    case AV_SAMPLE_FMT_S32:  [[fallthrough]];
     case AV_SAMPLE_FMT_S16P: [[fallthrough]];
     case AV_SAMPLE_FMT_S32P: [[fallthrough]];
     case AV_SAMPLE_FMT_FLTP: [[fallthrough]];
@@ -74,7 +81,6 @@ static int ConvertFFMPEGFormatToPipewire(enum AVSampleFormat format)
     case AV_SAMPLE_FMT_S64:  [[fallthrough]];
     case AV_SAMPLE_FMT_S64P: [[fallthrough]];
     case AV_SAMPLE_FMT_U8P:  [[fallthrough]];
-    case AV_SAMPLE_FMT_DBL:  [[fallthrough]];
     case AV_SAMPLE_FMT_NB:   [[fallthrough]];
     default:
         return FMT_S16_LE;
@@ -83,73 +89,79 @@ static int ConvertFFMPEGFormatToPipewire(enum AVSampleFormat format)
     throw std::runtime_error(std::format("Failed to find convert ffmpeg's format {}", static_cast<int>(format)));
 }
 
-Pipewire::Pipewire(std::shared_ptr<AudioSettings> audioSettings)
-    : m_audioSettings{ std::move(audioSettings) }
+static int FmtSizeof(int f) noexcept
 {
-    InitPipewire();
+    if (f == FMT_DOUBLE)
+        return static_cast<int>(sizeof (double));
+    else if (f >= FMT_S24_3LE)
+        return 3;
+    else if (f >= FMT_S24_LE)
+        return 4;
+    else if (f >= FMT_S16_LE)
+        return 2;
+    else if (f >= FMT_S8)
+        return 1;
+    return static_cast<int>(sizeof (float));
+}
 
-    if (not m_inited or not m_has_sinks)
+static spa_audio_format ToSpaFormat(int fmt) noexcept
+{
+    switch (fmt)
     {
-        throw std::runtime_error("Unable to initilaize loop\n");
+    case FMT_FLOAT:   return SPA_AUDIO_FORMAT_F32_LE;
+    case FMT_DOUBLE:  return SPA_AUDIO_FORMAT_F64_LE;
+
+    case FMT_S8:      return SPA_AUDIO_FORMAT_S8;
+    case FMT_U8:      return SPA_AUDIO_FORMAT_U8;
+
+    case FMT_S16_LE:  return SPA_AUDIO_FORMAT_S16_LE;
+    case FMT_S16_BE:  return SPA_AUDIO_FORMAT_S16_BE;
+    case FMT_U16_LE:  return SPA_AUDIO_FORMAT_U16_LE;
+    case FMT_U16_BE:  return SPA_AUDIO_FORMAT_U16_BE;
+
+    case FMT_S24_LE:  return SPA_AUDIO_FORMAT_S24_32_LE;
+    case FMT_S24_BE:  return SPA_AUDIO_FORMAT_S24_32_BE;
+    case FMT_U24_LE:  return SPA_AUDIO_FORMAT_U24_32_LE;
+    case FMT_U24_BE:  return SPA_AUDIO_FORMAT_U24_32_BE;
+
+    case FMT_S24_3LE: return SPA_AUDIO_FORMAT_S24_LE;
+    case FMT_S24_3BE: return SPA_AUDIO_FORMAT_S24_BE;
+    case FMT_U24_3LE: return SPA_AUDIO_FORMAT_U24_LE;
+    case FMT_U24_3BE: return SPA_AUDIO_FORMAT_U24_BE;
+
+    case FMT_S32_LE:  return SPA_AUDIO_FORMAT_S32_LE;
+    case FMT_S32_BE:  return SPA_AUDIO_FORMAT_S32_BE;
+    case FMT_U32_LE:  return SPA_AUDIO_FORMAT_U32_LE;
+    case FMT_U32_BE:  return SPA_AUDIO_FORMAT_U32_BE;
+
+    default:          return SPA_AUDIO_FORMAT_UNKNOWN;
     }
+}
 
-    constexpr auto FMT_SIZEOF = [](int f)
-    {
-        if (f >= FMT_S24_3LE)
-            return 3;
-        else if (f >= FMT_S24_LE)
-            return 4;
-        else if (f >= FMT_S16_LE)
-            return 2;
-        else if (f >= FMT_S8)
-            return 1;
-        return static_cast<int>(sizeof (float));
-    };
+static bool SameFormat(const AudioSettings& a, const AudioSettings& b) noexcept
+{
+    return a.freq == b.freq and a.fmt == b.fmt and av_channel_layout_compare(&a.ch_layout, &b.ch_layout) == 0;
+}
+
+Pipewire::Pipewire(std::shared_ptr<AudioSettings> audioSettings, OutputSettings output)
+    : m_audioSettings { std::move(audioSettings) }
+    , m_output        { output }
+{
+    InitPipewire();
 
-    auto ConvertFmtToStr = [](AVSampleFormat fmt)
+    if (not m_inited or not m_has_sinks)
     {
-        switch (fmt)
-        {
-        case AV_SAMPLE_FMT_U8:
-            return "U8";
-        case AV_SAMPLE_FMT_S16:
-            return "S16";
-        case AV_SAMPLE_FMT_S32:
-            return "S32";
-        case AV_SAMPLE_FMT_FLT:
-            return "FLT";
-        case AV_SAMPLE_FMT_DBL:
-            return "DBL";
-
-        case AV_SAMPLE_FMT_U8P:
-            return "U8P";
-        case AV_SAMPLE_FMT_S16P:
-            return "S16P";
-        case AV_SAMPLE_FMT_S32P:
-            return "S32P";
-        case AV_SAMPLE_FMT_FLTP:
-            return "FLTP";
-        case AV_SAMPLE_FMT_DBLP:
-            return "DBLP";
-        case AV_SAMPLE_FMT_S64:
-            return "S64";
-        case AV_SAMPLE_FMT_S64P:
-            return "S64P";
-
-        default:
-            std::unreachable();
-        };
-    };
+        throw std::runtime_error("Unable to initilaize loop\n");
+    }
 
-    util::Log(color::green, "Pipewire init [fmt][freq][nb_ch]: [{}][{}][{}]\n", ConvertFmtToStr(m_audioSettings->fmt), m_audioSettings->freq, m_audioSettings->ch_layout.nb_channels);
+    util::Log(color::green, "Pipewire init [fmt][freq][nb_ch]: [{}][{}][{}]\n", SampleFormatName(m_audioSettings->fmt), m_audioSettings->freq, m_audioSettings->ch_layout.nb_channels);
 
-    m_stride      = FMT_SIZEOF(ConvertFFMPEGFormatToPipewire(m_audioSettings->fmt)) * m_audioSettings->ch_layout.nb_channels;
-    m_frames      = std::clamp<int>(64, static_cast<int>(std::ceil(static_cast<float>(2048 * m_audioSettings->freq) / 48000.f)), 8192);
-    m_buffer_size = m_frames * m_stride;
-    m_buffer      = new unsigned char[m_buffer_size];
+    update_layout();
+    util::Log(color::green, "Pipewire quantum: {} frames, {} buffers of {} quanta\n", m_frames, m_output.buffers, m_output.buffer_quanta);
 
     stream_events.version       = PW_VERSION_STREAM_EVENTS;
     stream_events.state_changed = on_state_changed;
+    stream_events.param_changed = on_param_changed;
     stream_events.process       = on_process;
     stream_events.drained       = on_drained;
     pw_thread_loop_lock(m_loop);
@@ -174,44 +186,11 @@ Pipewire::Pipewire(std::shared_ptr<AudioSettings> audioSettings)
         throw std::runtime_error("Failed to create stream");
     }
 
-    set_volume(0.3f);
+    set_volume(m_volume);
 
     pw_stream_add_listener(m_stream, &m_stream_listener, &stream_events, this);
 
-    auto to_spa_pipewire_format = [](int fmt)
-    {
-        switch (fmt)
-        {
-        case FMT_FLOAT:   return SPA_AUDIO_FORMAT_F32_LE;
-
-        case FMT_S8:      return SPA_AUDIO_FORMAT_S8;
-        case FMT_U8:      return SPA_AUDIO_FORMAT_U8;
-
-        case FMT_S16_LE:  return SPA_AUDIO_FORMAT_S16_LE;
-        case FMT_S16_BE:  return SPA_AUDIO_FORMAT_S16_BE;
-        case FMT_U16_LE:  return SPA_AUDIO_FORMAT_U16_LE;
-        case FMT_U16_BE:  return SPA_AUDIO_FORMAT_U16_BE;
-
-        case FMT_S24_LE:  return SPA_AUDIO_FORMAT_S24_32_LE;
-        case FMT_S24_BE:  return SPA_AUDIO_FORMAT_S24_32_BE;
-        case FMT_U24_LE:  return SPA_AUDIO_FORMAT_U24_32_LE;
-        case FMT_U24_BE:  return SPA_AUDIO_FORMAT_U24_32_BE;
-
-        case FMT_S24_3LE: return SPA_AUDIO_FORMAT_S24_LE;
-        case FMT_S24_3BE: return SPA_AUDIO_FORMAT_S24_BE;
-        case FMT_U24_3LE: return SPA_AUDIO_FORMAT_U24_LE;
-        case FMT_U24_3BE: return SPA_AUDIO_FORMAT_U24_BE;
-
-        case FMT_S32_LE:  return SPA_AUDIO_FORMAT_S32_LE;
-        case FMT_S32_BE:  return SPA_AUDIO_FORMAT_S32_BE;
-        case FMT_U32_LE:  return SPA_AUDIO_FORMAT_U32_LE;
-        case FMT_U32_BE:  return SPA_AUDIO_FORMAT_U32_BE;
-
-        default:          return SPA_AUDIO_FORMAT_UNKNOWN;
-        }
-    };
-
-    auto pw_format = to_spa_pipewire_format(ConvertFFMPEGFormatToPipewire(m_audioSettings->fmt));
+    auto pw_format = ToSpaFormat(ConvertFFMPEGFormatToPipewire(m_audioSettings->fmt));
     if (pw_format == SPA_AUDIO_FORMAT_UNKNOWN)
     {
         pw_thread_loop_unlock(m_loop);
@@ -225,6 +204,7 @@ Pipewire::Pipewire(std::shared_ptr<AudioSettings> audioSettings)
     }
 
     pw_stream_set_active(m_stream, true);
+    m_active = true;
     float volume{ 0.3f };
     pw_stream_set_control(m_stream, SPA_PROP_volume, 0, &volume, 1);
     pw_thread_loop_unlock(m_loop);
@@ -264,11 +244,6 @@ Pipewire::~Pipewire()
     {
         pw_thread_loop_destroy(m_loop);
     }
-
-    if (m_buffer)
-    {
-        delete[] m_buffer;
-    }
 }
 
 void Pipewire::on_core_event (void* data, std::uint32_t id, int seq) noexcept
@@ -318,6 +293,8 @@ void Pipewire::on_state_changed(void* data, [[maybe_unused]] enum pw_stream_stat
     case PW_STREAM_STATE_PAUSED:
     case PW_STREAM_STATE_STREAMING:
         pw_thread_loop_signal(o->m_loop, false);
+        if (state == PW_STREAM_STATE_STREAMING and o->m_streaming_ns.load(std::memory_order_relaxed) == 0)
+            o->m_streaming_ns.store(util::NowNs(), std::memory_order_release);
     default:
         break;
     }
@@ -325,45 +302,151 @@ void Pipewire::on_state_changed(void* data, [[maybe_unused]] enum pw_stream_stat
     util::Log("State changed from: {} to: {}\n", pw_stream_state_as_string(old), pw_stream_state_as_string(state));
 }
 
-void Pipewire::on_process(void* data)
+Quantum FillQuantum(RingBuffer* source, PlaybackClock& clock, std::uint8_t* dst, std::uint64_t n_frames,
+                    std::uint32_t stride, std::uint8_t silence, std::int64_t now_ns, std::uint64_t latency) noexcept
 {
-    auto* o = std::bit_cast<Pipewire*>(data);
+    Quantum quantum{ .wanted = static_cast<std::size_t>(n_frames) * stride };
 
-    if (not o->m_buffer_at)
+    if (now_ns > 0)
+        clock.update(now_ns, latency);
+
+    std::uint64_t position{ 0 };
+    if (source)
     {
-        pw_thread_loop_signal(o->m_loop, false);
-        return;
+        // Only whole frames, a partial one would shift every following sample
+        quantum.available = source->size() / stride * stride;
+        quantum.got       = source->read(dst, std::min(quantum.wanted, quantum.available));
+        position          = source->read_position() - quantum.got;
     }
 
+    clock.append(position, quantum.got / stride, n_frames);
+
+    if (quantum.got < quantum.wanted)
+    {
+        memset(dst + quantum.got, silence, quantum.wanted - quantum.got);
+    }
+
+    return quantum;
+}
+
+void Pipewire::on_process(void* data)
+{
+    // Runs every quantum on the realtime thread, nothing in here may block
+    const rt::Section section;
+    auto* o = std::bit_cast<Pipewire*>(data);
+
     pw_buffer* b{};
     if (b = pw_stream_dequeue_buffer(o->m_stream); not b)
     {
-        util::Log("pipewire: out of buffers\n");
+        // The graph gets nothing from us this cycle
+        if (o->m_source.load() and not o->m_paused.load(std::memory_order_acquire))
+            o->m_underruns.fetch_add(1, std::memory_order_relaxed);
+
         return;
     }
 
     spa_buffer* buf = b->buffer;
 
-    void* dst{};
-    if (dst = buf->datas[0].data; not dst)
+    std::uint8_t* dst{};
+    if (dst = static_cast<std::uint8_t*>(buf->datas[0].data); not dst)
     {
-        util::Log("pipewire: no data pointer\n");
+        // Not mapped, there is nowhere to put anything
+        o->m_underruns.fetch_add(1, std::memory_order_relaxed);
+        pw_stream_queue_buffer(o->m_stream, b);
         return;
     }
 
-    auto size = std::min<std::uint32_t>(buf->datas[0].maxsize, o->m_buffer_at);
-    memcpy(dst, o->m_buffer, size);
-    o->m_buffer_at -= size;
-    memmove(o->m_buffer, o->m_buffer + size, o->m_buffer_at);
+    const auto stride = o->m_stride.load(std::memory_order_acquire);
+
+    // Fill exactly what the graph asked for, straight from the decode ring
+    std::uint64_t n_frames = buf->datas[0].maxsize / stride;
+    if (b->requested)
+        n_frames = std::min(b->requested, n_frames);
+
+    // Detach() waits for m_in_process to drop before the ring goes away
+    o->m_in_process.store(true);
+
+    // Configure() bumps the generation before it attaches, so a new
+    // source always comes with its own generation.
+    auto* source = o->m_source.load();
+    if (const auto generation = o->m_generation.load(std::memory_order_acquire); generation != o->m_clock.generation())
+    {
+        // Renegotiated before the bump, the layout is the new one by now
+        const auto frame = o->m_stride.load(std::memory_order_acquire);
+        const auto rate  = static_cast<std::uint64_t>(o->m_rate.load(std::memory_order_relaxed));
+        o->m_clock.restart(generation, frame, rate * frame);
+    }
+
+    // How much of what was handed out before is still on its way to the speakers
+    pw_time time{};
+    std::int64_t now_ns{ 0 };
+    std::uint64_t latency{ 0 };
+    if (pw_stream_get_time_n(o->m_stream, &time, sizeof time) == 0 and time.now > 0 and time.rate.denom > 0)
+    {
+        const auto rate  = static_cast<std::int64_t>(o->m_rate.load(std::memory_order_relaxed));
+        const auto delay = std::max<std::int64_t>(time.delay, 0) * time.rate.num * rate / time.rate.denom;
+        latency = static_cast<std::uint64_t>(delay) + time.queued + time.buffered;
+        now_ns  = time.now;
+    }
 
-    b->buffer->datas[0].chunk->offset = 0;
-    b->buffer->datas[0].chunk->size   = o->m_buffer_size;
-    b->buffer->datas[0].chunk->stride = o->m_stride;
+    // Taken before the flag, a pause that comes in between stores a new time
+    const auto paused_at = o->m_paused_at_ns.load(std::memory_order_acquire);
+    const bool playing   = source and not o->m_paused.load(std::memory_order_acquire);
 
+    const auto quantum = FillQuantum(playing ? source : nullptr, o->m_clock, dst, n_frames, stride,
+                                     o->m_silence.load(std::memory_order_relaxed), now_ns, latency);
+    o->m_in_process.store(false, std::memory_order_release);
+
+    // What the clock published before the pause would run on by the time it
+    // lasted, the position is let go of once this cycle published a new one
+    if (playing and paused_at != 0 and now_ns > 0)
+    {
+        auto expected = paused_at;
+        o->m_paused_at_ns.compare_exchange_strong(expected, 0, std::memory_order_acq_rel);
+    }
+
+    if (playing)
+    {
+        if (quantum.got < quantum.wanted)
+            o->m_underruns.fetch_add(1, std::memory_order_relaxed);
+        else if (quantum.available - quantum.got < quantum.wanted)
+            o->m_near_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // The first real sample of this ring comes out after everything queued
+    if (quantum.got > 0 and o->m_first_audible_ns.load(std::memory_order_relaxed) == 0)
+    {
+        const auto rate = std::max<std::uint64_t>(static_cast<std::uint64_t>(o->m_rate.load(std::memory_order_relaxed)), 1);
+        o->m_first_audible_ns.store(util::NowNs() + static_cast<std::int64_t>(latency * 1'000'000'000 / rate), std::memory_order_release);
+    }
+
+    buf->datas[0].chunk->offset = 0;
+    buf->datas[0].chunk->size   = static_cast<std::uint32_t>(quantum.wanted);
+    buf->datas[0].chunk->stride = static_cast<std::int32_t>(stride);
+
+    // In frames, so the stream reports what is queued in frames too
+    b->size = n_frames;
     pw_stream_queue_buffer(o->m_stream, b);
-    pw_thread_loop_signal(o->m_loop, false);
 };
 
+void Pipewire::on_param_changed(void* data, std::uint32_t id, const spa_pod* param)
+{
+    auto* o = std::bit_cast<Pipewire*>(data);
+
+    if (id != SPA_PARAM_Format or not param)
+        return;
+
+    // The buffers are sized for the stride of the format that was just set
+    std::uint8_t buffer[256];
+    spa_pod_builder b = make_builder(buffer, sizeof buffer);
+    const spa_pod* params[1];
+    params[0] = o->build_buffers(&b);
+    pw_stream_update_params(o->m_stream, params, 1);
+
+    o->m_format_changed = true;
+    pw_thread_loop_signal(o->m_loop, false);
+}
+
 void Pipewire::on_drained(void* data)
 {
     auto* o = std::bit_cast<Pipewire*>(data);
@@ -371,26 +454,242 @@ void Pipewire::on_drained(void* data)
     util::Log("Events drain\n");
 };
 
-void Pipewire::period_wait() noexcept
+void Pipewire::set_paused(bool paused) noexcept
 {
-    if (m_buffer_at != m_buffer_size)
+    // Silence for a cycle that still runs before the graph notices
+    m_paused.store(paused, std::memory_order_release);
+
+    // Resuming keeps the position where it stood until the realtime thread
+    // has published one from after the pause
+    if (paused)
+        m_paused_at_ns.store(util::NowNs(), std::memory_order_release);
+
+    set_active(not paused);
+}
+
+void Pipewire::set_active(bool active) noexcept
+{
+    if (not m_loop or not m_stream)
         return;
 
     pw_thread_loop_lock(m_loop);
-    pw_thread_loop_timed_wait(m_loop, 1);
+    if (m_active != active)
+    {
+        pw_stream_set_active(m_stream, active);
+        m_active = active;
+    }
     pw_thread_loop_unlock(m_loop);
 }
 
-std::size_t Pipewire::write_audio(const void *data, std::size_t length) noexcept
+void Pipewire::Configure(std::shared_ptr<AudioSettings> audioSettings, RingBuffer& source)
 {
+    Detach();
+
+    m_paused.store(false, std::memory_order_release);
+    m_paused_at_ns.store(0, std::memory_order_release);
+
+    if (not SameFormat(*m_audioSettings, *audioSettings))
+    {
+        // Renegotiating needs a stream the graph is running
+        set_active(true);
+
+        util::Log(color::green, "Pipewire renegotiate [fmt][freq][nb_ch]: [{}][{}][{}]\n", SampleFormatName(audioSettings->fmt), audioSettings->freq, audioSettings->ch_layout.nb_channels);
+        renegotiate(std::move(audioSettings));
+
+        set_active(false);
+    }
+
+    m_streaming_ns.store(0, std::memory_order_release);
+    m_first_audible_ns.store(0, std::memory_order_release);
+    m_underruns.store(0, std::memory_order_relaxed);
+    m_near_misses.store(0, std::memory_order_relaxed);
+
+    m_generation.fetch_add(1, std::memory_order_release);
+    m_source.store(&source);
+}
+
+void Pipewire::Start() noexcept
+{
+    set_active(true);
+}
+
+Pipewire::Health Pipewire::health() const noexcept
+{
+    return { .underruns   = m_underruns.load(std::memory_order_relaxed),
+             .near_misses = m_near_misses.load(std::memory_order_relaxed) };
+}
+
+void Pipewire::set_latency_scale(int scale)
+{
+    if (not m_loop or not m_stream)
+        return;
+
+    pw_thread_loop_lock(m_loop);
+    if (scale == m_latency_scale)
+    {
+        pw_thread_loop_unlock(m_loop);
+        return;
+    }
+
+    m_latency_scale = scale;
+    update_layout();
+
+    const auto latency = std::format("{}/{}", m_frames, m_audioSettings->freq);
+    const spa_dict_item item{ .key = PW_KEY_NODE_LATENCY, .value = latency.c_str() };
+    const spa_dict props{ .flags = 0, .n_items = 1, .items = &item };
+    pw_stream_update_properties(m_stream, &props);
+
+    // Buffers sized for the old quantum would cut the longer cycles short
+    std::uint8_t buffer[256];
+    spa_pod_builder b = make_builder(buffer, sizeof buffer);
+    const spa_pod* params[1];
+    params[0] = build_buffers(&b);
+    pw_stream_update_params(m_stream, params, 1);
+
+    pw_thread_loop_unlock(m_loop);
+
+    util::Log(color::yellow, "Pipewire latency: {}\n", latency);
+}
+
+bool Pipewire::AcquireRealtime(pthread_t thread, int priority) noexcept
+{
+    // Straight away where RLIMIT_RTPRIO allows it, through rtkit otherwise
+    if (rt::Promote(thread, priority))
+        return true;
+
+    return pw_thread_utils_acquire_rt(std::bit_cast<spa_thread*>(thread), priority) == 0;
+}
+
+bool Pipewire::PromoteOutput(int priority) noexcept
+{
+    // The process callback runs on the data loop of the context
+    pw_data_loop* data_loop = pw_context_get_data_loop(m_context);
+    spa_thread* thread      = data_loop ? pw_data_loop_get_thread(data_loop) : nullptr;
+    if (not thread)
+        return false;
+
+    // module-rt usually got to it first, at a priority of its own choosing
+    const auto handle = std::bit_cast<pthread_t>(thread);
+    return rt::IsRealtime(handle) or AcquireRealtime(handle, priority);
+}
+
+bool Pipewire::PinThreads(const rt::CpuSet& main_loop, const rt::CpuSet& output) noexcept
+{
+    bool pinned{ true };
+
+    if (main_loop.any())
+    {
+        // The thread loop doesn't hand out its thread, the pin is done from
+        // within it. It must not be locked here, the call blocks on it.
+        auto pin = +[](spa_loop*, bool, std::uint32_t, const void*, std::size_t, void* user_data) -> int
+        {
+            return rt::Pin(pthread_self(), *static_cast<const rt::CpuSet*>(user_data)) ? 0 : -EINVAL;
+        };
+
+        auto cpus = main_loop;
+        pinned = pw_loop_invoke(pw_thread_loop_get_loop(m_loop), pin, SPA_ID_INVALID, nullptr, 0, true, &cpus) == 0;
+    }
+
+    if (output.any())
+    {
+        pw_data_loop* data_loop = pw_context_get_data_loop(m_context);
+        spa_thread* thread      = data_loop ? pw_data_loop_get_thread(data_loop) : nullptr;
+        pinned &= thread and rt::Pin(std::bit_cast<pthread_t>(thread), output);
+    }
+
+    return pinned;
+}
+
+Pipewire::Startup Pipewire::startup() const noexcept
+{
+    return { .streaming_ns     = m_streaming_ns.load(std::memory_order_acquire),
+             .first_audible_ns = m_first_audible_ns.load(std::memory_order_acquire) };
+}
+
+std::uint64_t Pipewire::audible_position() const noexcept
+{
+    const auto paused_at = m_paused_at_ns.load(std::memory_order_acquire);
+    const auto now_ns = paused_at ? paused_at : util::NowNs();
+
+    // Nothing of the attached ring was heard yet
+    return m_clock.position(m_generation.load(std::memory_order_acquire), now_ns).value_or(0);
+}
+
+void Pipewire::Detach() noexcept
+{
+    m_source.store(nullptr);
+
+    // A process callback that already picked up the old ring finishes
+    // within one quantum, it never blocks.
+    while (m_in_process.load())
+        std::this_thread::yield();
+
+    set_active(false);
+}
+
+void Pipewire::update_layout() noexcept
+{
+    m_stride.store(static_cast<unsigned>(FmtSizeof(ConvertFFMPEGFormatToPipewire(m_audioSettings->fmt)) * m_audioSettings->ch_layout.nb_channels), std::memory_order_release);
+    m_rate.store(m_audioSettings->freq, std::memory_order_relaxed);
+    m_frames  = static_cast<unsigned>(QuantumFrames(*m_audioSettings, m_output.quantum * m_latency_scale));
+    m_silence = m_audioSettings->fmt == AV_SAMPLE_FMT_U8 ? 0x80 : 0x00;
+}
+
+void Pipewire::renegotiate(std::shared_ptr<AudioSettings> audioSettings)
+{
+    const auto pw_format = ToSpaFormat(ConvertFFMPEGFormatToPipewire(audioSettings->fmt));
+    if (pw_format == SPA_AUDIO_FORMAT_UNKNOWN)
+    {
+        throw std::runtime_error("Unknown audio format");
+    }
+
     pw_thread_loop_lock(m_loop);
 
-    auto size = std::min<std::size_t>(m_buffer_size - m_buffer_at, length);
-    memcpy(m_buffer + m_buffer_at, data, size);
-    m_buffer_at += static_cast<int>(size);
+    // Nothing is attached, the process callback only outputs silence
+    // while the layout is swapped underneath it.
+    m_audioSettings = std::move(audioSettings);
+    update_layout();
+
+    const auto rate    = std::format("1/{}", m_audioSettings->freq);
+    const auto latency = std::format("{}/{}", m_frames, m_audioSettings->freq);
+
+    const std::array items
+    {
+        spa_dict_item{ .key = PW_KEY_NODE_RATE,    .value = rate.c_str() },
+        spa_dict_item{ .key = PW_KEY_NODE_LATENCY, .value = latency.c_str() },
+    };
+
+    const spa_dict props{ .flags = 0, .n_items = items.size(), .items = items.data() };
+    pw_stream_update_properties(m_stream, &props);
+
+    std::uint8_t buffer[1024];
+    spa_pod_builder b = make_builder(buffer, sizeof buffer);
+    const spa_pod* params[1];
+    params[0] = build_format(&b, pw_format);
+
+    m_format_changed = false;
+    const int res = pw_stream_update_params(m_stream, params, 1);
+
+    // The graph answers with a new Format param once it has reconfigured
+    while (res == 0 and not m_format_changed)
+    {
+        if (pw_thread_loop_timed_wait(m_loop, 1) != 0)
+        {
+            util::Log(color::yellow, "Pipewire didn't confirm the new format in time\n");
+            break;
+        }
+    }
+
+    std::array<float, 8> volume{};
+    volume.fill(m_volume);
+    pw_stream_set_control(m_stream, SPA_PROP_channelVolumes, m_audioSettings->ch_layout.nb_channels, volume.data(), nullptr);
 
     pw_thread_loop_unlock(m_loop);
-    return size;
+
+    if (res < 0)
+    {
+        throw std::runtime_error(std::format("Failed to renegotiate the stream format: {}", spa_strerror(res)));
+    }
 }
 
 void Pipewire::set_volume(float percent) noexcept
@@ -402,6 +701,7 @@ void Pipewire::set_volume(float percent) noexcept
     volume.fill(percent);
 
     pw_thread_loop_lock(m_loop);
+    m_volume = percent;
     pw_stream_set_control(m_stream, SPA_PROP_channelVolumes, m_audioSettings->ch_layout.nb_channels, volume.data(), nullptr);
     pw_thread_loop_unlock(m_loop);
 }
@@ -481,17 +781,19 @@ void Pipewire::set_channel_map(spa_audio_info_raw* info, int channels) noexcept
     }
 }
 
-bool Pipewire::connect_stream(enum spa_audio_format format) noexcept
+spa_pod_builder Pipewire::make_builder(std::uint8_t* buffer, std::uint32_t size) noexcept
 {
-    std::uint8_t buffer[1024];
-    spa_pod_builder b = {
+    return {
         .data = buffer,
-        .size = sizeof buffer,
+        .size = size,
         ._padding = 0,
         .state = {.offset = 0, .flags = 0, .frame = nullptr},
         .callbacks = { nullptr, nullptr },
     };
+}
 
+const spa_pod* Pipewire::build_format(spa_pod_builder* b, enum spa_audio_format format) noexcept
+{
     spa_audio_info_raw audio_info
     {
         .format   = format,
@@ -502,8 +804,30 @@ bool Pipewire::connect_stream(enum spa_audio_format format) noexcept
     };
 
     set_channel_map(&audio_info, m_audioSettings->ch_layout.nb_channels);
+    return spa_format_audio_raw_build(b, SPA_PARAM_EnumFormat, &audio_info);
+}
+
+const spa_pod* Pipewire::build_buffers(spa_pod_builder* b) noexcept
+{
+    const auto stride  = static_cast<int>(m_stride.load(std::memory_order_acquire));
+    const auto quantum = static_cast<int>(m_frames) * stride;
+
+    // A graph that runs longer cycles than we asked for can still pick larger ones
+    return static_cast<const spa_pod*>(spa_pod_builder_add_object(b,
+        SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+        SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(m_output.buffers, 1, 64),
+        SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(1),
+        SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(quantum * m_output.buffer_quanta, quantum, std::numeric_limits<std::int32_t>::max()),
+        SPA_PARAM_BUFFERS_stride,  SPA_POD_Int(stride)));
+}
+
+bool Pipewire::connect_stream(enum spa_audio_format format) noexcept
+{
+    std::uint8_t buffer[1024];
+    spa_pod_builder b = make_builder(buffer, sizeof buffer);
+
     const spa_pod* params[1];
-    params[0] = spa_format_audio_raw_build(&b, SPA_PARAM_EnumFormat, &audio_info);
+    params[0] = build_format(&b, format);
 
     auto stream_flags = static_cast<pw_stream_flags>(PW_STREAM_FLAG_AUTOCONNECT |
                                                         PW_STREAM_FLAG_MAP_BUFFERS |
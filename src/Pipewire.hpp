@@ -19,9 +19,12 @@
 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <memory>
 
+#include <pthread.h>
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wconversion"
 #pragma GCC diagnostic ignored "-Wpedantic"
@@ -29,6 +32,7 @@
 
 #include <pipewire/pipewire.h>
 #include <spa/param/audio/format-utils.h>
+#include <spa/param/buffers.h>
 #include <spa/param/props.h>
 
 #pragma GCC diagnostic pop
@@ -38,6 +42,24 @@ extern "C"
 }
 
 #include "AudioSettings.hpp"
+#include "PlaybackClock.hpp"
+#include "RingBuffer.hpp"
+
+// What a quantum asked for and took out of the ring, in bytes
+struct Quantum
+{
+    std::size_t wanted{};
+    std::size_t got{};
+    std::size_t available{};
+};
+
+// The part of a process cycle that moves audio, the stream around it only
+// hands over the buffer and the timing. Passes the latency on to the clock
+// when now_ns is known, reads whole frames from source into dst, pads the
+// rest with silence and accounts for the cycle. Without a source, paused
+// or nothing attached, the whole quantum is silence.
+Quantum FillQuantum(RingBuffer* source, PlaybackClock& clock, std::uint8_t* dst, std::uint64_t n_frames,
+                    std::uint32_t stride, std::uint8_t silence, std::int64_t now_ns, std::uint64_t latency) noexcept;
 
 class Pipewire
 {
@@ -48,22 +70,89 @@ public:
     Pipewire &operator=(const Pipewire &) = delete;
     Pipewire &operator=(Pipewire &&) = delete;
 
-    explicit Pipewire(std::shared_ptr<AudioSettings> audioSettings);
+    // Connects to the daemon and creates the stream once, it outputs
+    // silence until a ring is attached through Configure(). The quantum and
+    // buffers asked for stay the same for every format that follows.
+    explicit Pipewire(std::shared_ptr<AudioSettings> audioSettings, OutputSettings output = {});
     ~Pipewire();
 
-    void period_wait() noexcept;
-    std::size_t write_audio(const void *data, std::size_t length) noexcept;
+    // Attaches source, the stream pulls its audio straight out of it from the
+    // realtime thread. A different format is renegotiated on the live stream.
+    void Configure(std::shared_ptr<AudioSettings> audioSettings, RingBuffer& source);
+
+    // Once this returns the realtime thread no longer touches the ring. The
+    // stream is deactivated until the next Start(), an idle player doesn't
+    // wake up once per quantum only to output silence.
+    void Detach() noexcept;
+
     void set_volume(float percent) noexcept;
 
+    // Pausing deactivates the stream, whatever is buffered stays in the ring
+    // and resuming carries on from it right away.
+    void set_paused(bool paused) noexcept;
+
+    // Configure() leaves the stream inactive, it starts pulling from the
+    // ring only once the caller has buffered enough to keep it fed.
+    void Start() noexcept;
+
+    // Steady clock nanoseconds of when the stream of the attached ring went
+    // streaming and when its first real sample is expected out of the
+    // speakers, 0 until then.
+    struct Startup
+    {
+        std::int64_t streaming_ns{};
+        std::int64_t first_audible_ns{};
+    };
+    [[nodiscard]] Startup startup() const noexcept;
+
+    // Cycles the attached ring couldn't fill, and ones it could only just
+    // fill with less than another cycle left behind, counted per Configure().
+    struct Health
+    {
+        std::uint64_t underruns{};
+        std::uint64_t near_misses{};
+    };
+    [[nodiscard]] Health health() const noexcept;
+
+    // SCHED_FIFO at priority for thread, through rtkit when the process
+    // isn't allowed to on its own. False if neither worked.
+    static bool AcquireRealtime(pthread_t thread, int priority) noexcept;
+
+    // The same for the thread the process callback runs on, unless it
+    // already runs with a realtime policy
+    bool PromoteOutput(int priority) noexcept;
+
+    // Pins the thread of the main loop and the one the process callback
+    // runs on, an empty set leaves that one alone. False if a pin failed.
+    bool PinThreads(const rt::CpuSet& main_loop, const rt::CpuSet& output) noexcept;
+
+    // Asks the graph for scale times the quantum of the OutputSettings,
+    // the buffers are renegotiated to hold it.
+    void set_latency_scale(int scale);
+
+    // Position in the attached ring that is coming out of the speakers
+    // right now, the graph and device latency taken into account.
+    [[nodiscard]] std::uint64_t audible_position() const noexcept;
+
 private:
 
     void InitPipewire();
     void set_channel_map(spa_audio_info_raw* info, int channels) noexcept;
     bool connect_stream(enum spa_audio_format format) noexcept;
+    void update_layout() noexcept;
+    void renegotiate(std::shared_ptr<AudioSettings> audioSettings);
+    void set_active(bool active) noexcept;
+
+    static spa_pod_builder make_builder(std::uint8_t* buffer, std::uint32_t size) noexcept;
+    const spa_pod* build_format(spa_pod_builder* b, enum spa_audio_format format) noexcept;
+    const spa_pod* build_buffers(spa_pod_builder* b) noexcept;
 
     void open_audio(enum AVSampleFormat format, int rate, int channels);
 
     std::shared_ptr<AudioSettings> m_audioSettings;
+    const OutputSettings m_output;
+    std::atomic<RingBuffer*> m_source{};
+    std::atomic<bool> m_in_process{};
 
     pw_core_events core_events
     {
@@ -98,14 +187,31 @@ private:
     bool m_inited{};
     bool m_has_sinks{};
     bool m_ignore_state_change{};
+    bool m_format_changed{};
+    bool m_active{};
 
     int m_core_init_seq{};
 
-    unsigned char* m_buffer{};
-    unsigned m_buffer_at{};
-    unsigned m_buffer_size{};
     unsigned m_frames{};
-    unsigned m_stride{};
+    std::atomic<unsigned> m_stride{};
+    std::atomic<int> m_rate{};
+    std::atomic<std::uint8_t> m_silence{};
+    float m_volume{ 0.3f };
+
+    std::atomic<bool> m_paused{};
+
+    // The audible position stands still at this time while paused and after
+    // resuming until the process callback published a new one, 0 otherwise
+    std::atomic<std::int64_t> m_paused_at_ns{};
+
+    // Bumped for every ring that is attached, the clock starts over with it
+    std::atomic<std::uint32_t> m_generation{};
+    std::atomic<std::int64_t> m_streaming_ns{};
+    std::atomic<std::int64_t> m_first_audible_ns{};
+    std::atomic<std::uint64_t> m_underruns{};
+    std::atomic<std::uint64_t> m_near_misses{};
+    int m_latency_scale{ 1 };
+    PlaybackClock m_clock{};
 
     spa_hook m_core_listener{};
     spa_hook m_stream_listener{};
@@ -116,6 +222,7 @@ private:
                                          const char* type, [[maybe_unused]] std::uint32_t version, const spa_dict* props);
     static void on_state_changed(void* data, [[maybe_unused]] enum pw_stream_state old,
                                  enum pw_stream_state state, [[maybe_unused]] const char* error);
+    static void on_param_changed(void* data, std::uint32_t id, const spa_pod* param);
     static void on_process(void* data);
     static void on_drained(void* data);
 };
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+/*
+ * Which byte of the source ring is being heard right now.
+ *
+ * The realtime thread records every block it hands to the graph: where in
+ * the ring its audio came from and where it sits on a 64-bit frame clock
+ * that counts everything handed out, silence included. Once per cycle the
+ * graph tells how many frames are still ahead of the speaker, that is
+ * turned back into a ring position through the recorded blocks and
+ * published together with the time it was true at. Readers move it forward
+ * by the time passed since, never beyond the audio that was handed out.
+ */
+class PlaybackClock
+{
+public:
+    PlaybackClock() = default;
+
+    PlaybackClock(const PlaybackClock&)            = delete;
+    PlaybackClock(PlaybackClock&&)                 = delete;
+    PlaybackClock& operator=(const PlaybackClock&) = delete;
+    PlaybackClock& operator=(PlaybackClock&&)      = delete;
+
+    // Realtime thread. Forgets the blocks of the previous source, what is
+    // published from now on belongs to generation.
+    void restart(std::uint32_t generation, std::uint32_t stride, std::uint64_t bytes_per_second) noexcept
+    {
+        m_generation       = generation;
+        m_stride           = std::max(stride, 1u);
+        m_bytes_per_second = bytes_per_second;
+        m_count            = 0;
+    }
+
+    [[nodiscard]] std::uint32_t generation() const noexcept
+    { return m_generation; }
+
+    // Realtime thread. At now_ns the graph still has latency frames to play
+    // before the next frame handed to it is heard.
+    void update(std::int64_t now_ns, std::uint64_t latency) noexcept
+    {
+        if (m_count == 0)
+            return;
+
+        const auto audible = m_frames - std::min(latency, m_frames);
+
+        // Newest block that started playing already
+        std::size_t at = m_count - 1;
+        while (at > 0 and block(at).start > audible)
+            at--;
+
+        const auto& b = block(at);
+        const auto offset = std::min(audible - std::min(audible, b.start), b.real);
+
+        // Audio handed out in one piece from here on, the clock may run up to its end
+        auto limit = b.position + b.real * m_stride;
+        for (auto next = at + 1; next < m_count and b.real == b.frames; next++)
+        {
+            const auto& n = block(next);
+            if (n.position != limit)
+                break;
+
+            limit += n.real * m_stride;
+            if (n.real != n.frames)
+                break;
+        }
+
+        publish({ .position = b.position + offset * m_stride, .limit = limit, .now_ns = now_ns });
+    }
+
+    // Realtime thread. frames were handed to the graph, the first real of
+    // them came out of the source starting at ring position, the rest is silence.
+    void append(std::uint64_t position, std::uint64_t real, std::uint64_t frames) noexcept
+    {
+        // Silence doesn't move through the source
+        if (real == 0 and m_count > 0)
+        {
+            const auto& last = block(m_count - 1);
+            position = last.position + last.real * m_stride;
+        }
+
+        if (m_count == Blocks)
+        {
+            m_first = (m_first + 1) % Blocks;
+            m_count--;
+        }
+
+        m_blocks[(m_first + m_count) % Blocks] = { .start = m_frames, .position = position, .real = real, .frames = frames };
+        m_count++;
+        m_frames += frames;
+    }
+
+    // Any thread. nullopt until the realtime thread has published
+    // anything for this generation.
+    [[nodiscard]] std::optional<std::uint64_t> position(std::uint32_t generation, std::int64_t now_ns) const noexcept
+    {
+        Snapshot s{};
+        std::uint32_t seq{};
+        do
+        {
+            seq = m_seq.load(std::memory_order_acquire);
+            s.generation       = m_published.generation.load(std::memory_order_relaxed);
+            s.position         = m_published.position.load(std::memory_order_relaxed);
+            s.limit            = m_published.limit.load(std::memory_order_relaxed);
+            s.now_ns           = m_published.now_ns.load(std::memory_order_relaxed);
+            s.stride           = m_published.stride.load(std::memory_order_relaxed);
+            s.bytes_per_second = m_published.bytes_per_second.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) or seq != m_seq.load(std::memory_order_relaxed));
+
+        if (seq == 0 or s.generation != generation)
+            return std::nullopt;
+
+        const auto elapsed = static_cast<std::uint64_t>(std::max<std::int64_t>(now_ns - s.now_ns, 0));
+        const auto moved   = static_cast<std::uint64_t>(static_cast<double>(elapsed) * static_cast<double>(s.bytes_per_second) / 1e9);
+
+        return std::min(s.position + moved / s.stride * s.stride, std::max(s.limit, s.position));
+    }
+
+private:
+    static constexpr std::size_t Blocks{ 32 };
+
+    struct Block
+    {
+        std::uint64_t start{};      // on the frame clock
+        std::uint64_t position{};   // in the ring, bytes
+        std::uint64_t real{};
+        std::uint64_t frames{};
+    };
+
+    struct Snapshot
+    {
+        std::uint32_t generation{};
+        std::uint64_t position{};
+        std::uint64_t limit{};
+        std::int64_t now_ns{};
+        std::uint64_t stride{};
+        std::uint64_t bytes_per_second{};
+    };
+
+    [[nodiscard]] const Block& block(std::size_t i) const noexcept
+    { return m_blocks[(m_first + i) % Blocks]; }
+
+    void publish(Snapshot s) noexcept
+    {
+        s.generation       = m_generation;
+        s.stride           = m_stride;
+        s.bytes_per_second = m_bytes_per_second;
+
+        // Sequence lock, a reader that saw it odd or changed reads again
+        const auto seq = m_seq.load(std::memory_order_relaxed);
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_published.generation.store(s.generation, std::memory_order_relaxed);
+        m_published.position.store(s.position, std::memory_order_relaxed);
+        m_published.limit.store(s.limit, std::memory_order_relaxed);
+        m_published.now_ns.store(s.now_ns, std::memory_order_relaxed);
+        m_published.stride.store(s.stride, std::memory_order_relaxed);
+        m_published.bytes_per_second.store(s.bytes_per_second, std::memory_order_relaxed);
+
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // Realtime thread only
+    std::array<Block, Blocks> m_blocks{};
+    std::size_t m_first{};
+    std::size_t m_count{};
+    std::uint64_t m_frames{};
+    std::uint32_t m_generation{};
+    std::uint64_t m_stride{ 1 };
+    std::uint64_t m_bytes_per_second{};
+
+    std::atomic<std::uint32_t> m_seq{ 0 };
+    struct
+    {
+        std::atomic<std::uint32_t> generation{};
+        std::atomic<std::uint64_t> position{};
+        std::atomic<std::uint64_t> limit{};
+        std::atomic<std::int64_t> now_ns{};
+        std::atomic<std::uint64_t> stride{ 1 };
+        std::atomic<std::uint64_t> bytes_per_second{};
+    } m_published;
+};
@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "PlaybackEngine.hpp"
+#include "AudioLoop.hpp"
+#include "globals.hpp"
+#include "util.hpp"
+
+#include <exception>
+#include <utility>
+
+PlaybackEngine::PlaybackEngine()
+    : m_retirer { [this](std::stop_token st) { retire_loop(st); } }
+    , m_control { [this](std::stop_token st) { control_loop(st); } }
+{
+    pthread_setname_np(m_retirer.native_handle(), "Retirer");
+    pthread_setname_np(m_control.native_handle(), "Control loop");
+}
+
+void PlaybackEngine::Configure(BufferSettings bufferSettings)
+{
+    if (bufferSettings.affinity.control.any())
+    {
+        rt::Pin(m_control.native_handle(), bufferSettings.affinity.control);
+        rt::Pin(m_retirer.native_handle(), bufferSettings.affinity.control);
+    }
+
+    std::scoped_lock lk{ m_load_mtx };
+    m_bufferSettings = std::move(bufferSettings);
+}
+
+void PlaybackEngine::SetErrorHandler(std::function<void(std::string_view)> handler)
+{
+    std::scoped_lock lk{ m_load_mtx };
+    m_on_error = std::move(handler);
+}
+
+void PlaybackEngine::Load(std::filesystem::path path, std::vector<std::filesystem::path> upcoming)
+{
+    {
+        std::scoped_lock lk{ m_load_mtx };
+        m_pending = LoadRequest{ .path = std::move(path), .upcoming = std::move(upcoming) };
+        m_playing.request_stop();
+    }
+
+    m_load_cv.notify_one();
+}
+
+void PlaybackEngine::Stop()
+{
+    std::scoped_lock lk{ m_load_mtx };
+    m_pending.reset();
+    m_playing.request_stop();
+}
+
+Pipewire& PlaybackEngine::Output(const std::shared_ptr<AudioSettings>& audioSettings, OutputSettings output)
+{
+    std::scoped_lock lk{ m_mtx };
+
+    if (not m_pipewire)
+    {
+        util::Log(color::green, "Connecting the output stream\n");
+        m_pipewire = std::make_unique<Pipewire>(audioSettings, output);
+    }
+
+    return *m_pipewire;
+}
+
+StatusView& PlaybackEngine::Status()
+{
+    std::scoped_lock lk{ m_mtx };
+
+    if (not m_status)
+    {
+        m_status = std::make_unique<StatusView>();
+    }
+
+    return *m_status;
+}
+
+void PlaybackEngine::Retire(std::unique_ptr<Decoder> decoder)
+{
+    if (not decoder)
+        return;
+
+    {
+        std::scoped_lock lk{ m_retired_mtx };
+        m_retired.push_back(std::move(decoder));
+    }
+
+    m_retired_cv.notify_one();
+}
+
+void PlaybackEngine::Retire(std::future<std::unique_ptr<Decoder>> pending)
+{
+    if (not pending.valid())
+        return;
+
+    {
+        std::scoped_lock lk{ m_retired_mtx };
+        m_retired_pending.push_back(std::move(pending));
+    }
+
+    m_retired_cv.notify_one();
+}
+
+void PlaybackEngine::retire_loop(std::stop_token st)
+{
+    while (true)
+    {
+        std::vector<std::unique_ptr<Decoder>> retired;
+        std::vector<std::future<std::unique_ptr<Decoder>>> pending;
+
+        {
+            std::unique_lock lk{ m_retired_mtx };
+            m_retired_cv.wait(lk, st, [this] { return not m_retired.empty() or not m_retired_pending.empty(); });
+
+            retired = std::exchange(m_retired, {});
+            pending = std::exchange(m_retired_pending, {});
+        }
+
+        // Only then can nothing be retired anymore, whatever is left goes first
+        if (retired.empty() and pending.empty())
+            return;
+
+        for (auto& next : pending)
+        {
+            try
+            {
+                retired.push_back(next.get());
+            }
+            catch (const std::exception& e)
+            {
+                util::Log(color::yellow, "A track that was never played failed to open: {}\n", e.what());
+            }
+        }
+
+        util::Log(color::aqua, "Retiring {} decoders\n", retired.size());
+    }
+}
+
+void PlaybackEngine::report(std::string_view error)
+{
+    util::Log(color::red, "Runtime error: {}\n", error);
+
+    std::function<void(std::string_view)> handler;
+    {
+        std::scoped_lock lk{ m_load_mtx };
+        handler = m_on_error;
+    }
+
+    if (handler)
+        handler(error);
+}
+
+void PlaybackEngine::control_loop(std::stop_token st)
+{
+    // Whatever is playing stops along with the engine
+    std::stop_callback stop_playing{ st, [this]
+    {
+        std::scoped_lock lk{ m_load_mtx };
+        m_playing.request_stop();
+    } };
+
+    // Nothing to pause or seek in until something plays
+    Globals::controls.Close();
+
+    while (true)
+    {
+        LoadRequest request{};
+        BufferSettings bufferSettings{};
+        std::stop_token playing{};
+
+        {
+            std::unique_lock lk{ m_load_mtx };
+            if (not m_load_cv.wait(lk, st, [this] { return m_pending.has_value(); }))
+                break;
+
+            request = std::move(*m_pending);
+            m_pending.reset();
+
+            m_playing      = std::stop_source{};
+            playing        = m_playing.get_token();
+            bufferSettings = m_bufferSettings;
+        }
+
+        play(std::move(request), bufferSettings, playing);
+
+        bool idle{};
+        {
+            std::scoped_lock lk{ m_load_mtx };
+            idle = not m_pending.has_value();
+        }
+
+        // Unless the next track is about to set its own
+        if (idle)
+            Status().Clear();
+    }
+}
+
+void PlaybackEngine::play(LoadRequest request, const BufferSettings& bufferSettings, std::stop_token st)
+{
+    auto current = std::move(request.path);
+    auto queue   = std::move(request.upcoming);
+
+    // Open for as long as one track follows the other
+    Globals::controls.Open();
+
+    while (true)
+    {
+        try
+        {
+            AudioLoop loop{ current, *this, std::exchange(queue, {}), bufferSettings };
+            loop.control_loop(st);
+            queue = loop.TakeUpcoming();
+        }
+        catch (const std::exception& e)
+        {
+            report(e.what());
+        }
+        catch (...)
+        {
+            report("Unhandled exception");
+        }
+
+        // Whatever couldn't be spliced gaplessly gets a loop of its own
+        if (st.stop_requested() or Globals::stop_request or queue.empty())
+            break;
+
+        current = queue.front();
+        queue.erase(queue.begin());
+    }
+
+    Globals::controls.Close();
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "AudioSettings.hpp"
+#include "Decoder.hpp"
+#include "Pipewire.hpp"
+#include "StatusView.hpp"
+#include "Worker.hpp"
+#include "Wrapper.hpp"
+
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/*
+ * Owns what outlives a single AudioLoop. Connecting to the daemon and
+ * creating a stream takes a registry round trip and a new realtime thread,
+ * so it is done once and every following track only attaches its ring.
+ *
+ * The control loop, the producer and the status line stay as well. The
+ * interface only ever posts Load() and Stop() requests, switching tracks
+ * never has it wait for the old one to wind down, and what the old track
+ * leaves behind is freed on a thread of its own.
+ */
+class PlaybackEngine
+{
+public:
+    PlaybackEngine();
+
+    PlaybackEngine(const PlaybackEngine&)            = delete;
+    PlaybackEngine(PlaybackEngine&&)                 = delete;
+    PlaybackEngine& operator=(const PlaybackEngine&) = delete;
+    PlaybackEngine& operator=(PlaybackEngine&&)      = delete;
+
+    // The settings every track loaded from now on is played with. The
+    // control loop and the retiring thread are pinned to the CPUs they
+    // give the control loop.
+    void Configure(BufferSettings bufferSettings);
+
+    // Where the errors of the control loop are reported, besides the log
+    void SetErrorHandler(std::function<void(std::string_view)> handler);
+
+    // Any thread. Plays path and then upcoming, gaplessly where it can,
+    // instead of whatever is playing. Returns right away, a request the
+    // control loop didn't get to yet is replaced.
+    void Load(std::filesystem::path path, std::vector<std::filesystem::path> upcoming = {});
+
+    // Any thread. Stops playing without waiting for it.
+    void Stop();
+
+    // The first call connects the output using audioSettings as its
+    // initial format and output for the graph, later calls return the same stream.
+    [[nodiscard]] Pipewire& Output(const std::shared_ptr<AudioSettings>& audioSettings, OutputSettings output = {});
+
+    // The first call creates the status line, later calls return the same one
+    [[nodiscard]] StatusView& Status();
+
+    // The thread every AudioLoop runs its producer on, one loop at a time
+    [[nodiscard]] Worker& Producer() noexcept
+    { return m_producer; }
+
+    [[nodiscard]] Wrap::AvPools& Pools() noexcept
+    { return m_pools; }
+
+    // Closing the file and freeing the codec of a decoder that is done is
+    // left to the retiring thread, a pending one is waited for there too.
+    void Retire(std::unique_ptr<Decoder> decoder);
+    void Retire(std::future<std::unique_ptr<Decoder>> pending);
+
+private:
+    struct LoadRequest
+    {
+        std::filesystem::path path{};
+        std::vector<std::filesystem::path> upcoming{};
+    };
+
+    void control_loop(std::stop_token st);
+    void play(LoadRequest request, const BufferSettings& bufferSettings, std::stop_token st);
+    void retire_loop(std::stop_token st);
+    void report(std::string_view error);
+
+    // Declared first, every decoder returns its packet and frame here
+    Wrap::AvPools m_pools{};
+
+    std::mutex m_mtx{};
+    std::unique_ptr<Pipewire> m_pipewire{};
+    std::unique_ptr<StatusView> m_status{};
+
+    std::mutex m_retired_mtx{};
+    std::condition_variable_any m_retired_cv{};
+    std::vector<std::unique_ptr<Decoder>> m_retired{};
+    std::vector<std::future<std::unique_ptr<Decoder>>> m_retired_pending{};
+    std::jthread m_retirer;
+
+    Worker m_producer{ "Producer" };
+
+    // The request that is up next, and the stop of the one that is playing
+    std::mutex m_load_mtx{};
+    std::condition_variable_any m_load_cv{};
+    std::optional<LoadRequest> m_pending{};
+    std::stop_source m_playing{};
+    BufferSettings m_bufferSettings{};
+    std::function<void(std::string_view)> m_on_error{};
+
+    // Declared last, it is stopped first and nothing it uses is gone by then
+    std::jthread m_control;
+};
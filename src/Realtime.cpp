@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "Realtime.hpp"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <ranges>
+#include <utility>
+
+void rt::Violation(const char* what) noexcept
+{
+    constexpr const char prefix[] = "tMus: realtime section entered ";
+    [[maybe_unused]] auto r = ::write(STDERR_FILENO, prefix, sizeof prefix - 1);
+    r = ::write(STDERR_FILENO, what, std::strlen(what));
+    r = ::write(STDERR_FILENO, "\n", 1);
+    std::abort();
+}
+
+bool rt::Promote(pthread_t thread, int priority) noexcept
+{
+    const sched_param param{ .sched_priority = priority };
+
+    // Children of a realtime thread shouldn't inherit the policy
+    return pthread_setschedparam(thread, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) == 0;
+}
+
+bool rt::IsRealtime(pthread_t thread) noexcept
+{
+    int policy{};
+    sched_param param{};
+    if (pthread_getschedparam(thread, &policy, &param) != 0)
+        return false;
+
+    policy &= ~SCHED_RESET_ON_FORK;
+    return policy == SCHED_FIFO or policy == SCHED_RR;
+}
+
+std::optional<rt::CpuSet> rt::ParseCpuList(std::string_view list) noexcept
+{
+    const auto number = [](std::string_view str) -> std::optional<std::size_t>
+    {
+        std::size_t n{};
+        const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), n);
+        if (ec != std::errc{} or end != str.data() + str.size() or n >= CPU_SETSIZE)
+            return {};
+
+        return n;
+    };
+
+    CpuSet cpus{};
+    for (const auto part : list | std::views::split(','))
+    {
+        const std::string_view item{ part.begin(), part.end() };
+        const auto dash = item.find('-');
+
+        const auto first = number(item.substr(0, dash));
+        const auto last  = dash == std::string_view::npos ? first : number(item.substr(dash + 1));
+        if (not first or not last or *first > *last)
+            return {};
+
+        for (auto cpu = *first; cpu <= *last; cpu++)
+            cpus.set(cpu);
+    }
+
+    if (cpus.none())
+        return {};
+
+    return cpus;
+}
+
+std::string rt::FormatCpuList(const CpuSet& cpus)
+{
+    std::string list;
+
+    for (std::size_t cpu = 0; cpu < cpus.size(); cpu++)
+    {
+        if (not cpus.test(cpu))
+            continue;
+
+        auto last = cpu;
+        while (last + 1 < cpus.size() and cpus.test(last + 1))
+            last++;
+
+        list += list.empty() ? "" : ",";
+        list += last == cpu ? std::format("{}", cpu) : std::format("{}-{}", cpu, last);
+        cpu = last;
+    }
+
+    return list;
+}
+
+bool rt::Pin(pthread_t thread, const CpuSet& cpus) noexcept
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (std::size_t cpu = 0; cpu < cpus.size(); cpu++)
+    {
+        if (cpus.test(cpu))
+            CPU_SET(cpu, &set);
+    }
+
+    return pthread_setaffinity_np(thread, sizeof set, &set) == 0;
+}
+
+rt::CpuSet rt::Affinity(pthread_t thread) noexcept
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    CpuSet cpus{};
+    if (pthread_getaffinity_np(thread, sizeof set, &set) != 0)
+        return cpus;
+
+    for (std::size_t cpu = 0; cpu < cpus.size(); cpu++)
+    {
+        if (CPU_ISSET(cpu, &set))
+            cpus.set(cpu);
+    }
+
+    return cpus;
+}
+
+rt::MemoryLock::MemoryLock(const void* data, std::size_t size) noexcept
+{
+    if (data and size > 0 and mlock(data, size) == 0)
+    {
+        m_data = data;
+        m_size = size;
+    }
+}
+
+rt::MemoryLock::~MemoryLock()
+{
+    unlock();
+}
+
+rt::MemoryLock::MemoryLock(MemoryLock&& other) noexcept
+    : m_data { std::exchange(other.m_data, nullptr) }
+    , m_size { std::exchange(other.m_size, 0) }
+{ }
+
+rt::MemoryLock& rt::MemoryLock::operator=(MemoryLock&& other) noexcept
+{
+    if (this != &other)
+    {
+        unlock();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+    }
+
+    return *this;
+}
+
+void rt::MemoryLock::unlock() noexcept
+{
+    // Pages of the heap that are handed back to the allocator stay locked,
+    // the owner of the range has to outlive its lock
+    if (m_data)
+        munlock(m_data, m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace rt
+{
+    namespace internal
+    {
+        inline thread_local bool in_section{ false };
+    }
+
+    // Marks the steady state of a realtime callback. Nothing inside may
+    // allocate, take a lock or do file I/O, debug builds abort when the
+    // allocation hook or util::Log is reached from within.
+    class Section
+    {
+    public:
+        Section() noexcept
+            : m_outer{ internal::in_section }
+        { internal::in_section = true; }
+
+        ~Section()
+        { internal::in_section = m_outer; }
+
+        Section(const Section&)            = delete;
+        Section(Section&&)                 = delete;
+        Section& operator=(const Section&) = delete;
+        Section& operator=(Section&&)      = delete;
+
+    private:
+        const bool m_outer;
+    };
+
+    [[nodiscard]] inline bool InSection() noexcept
+    { return internal::in_section; }
+
+    // Writes what was attempted straight to stderr and aborts, no
+    // allocation and no logger on the way.
+    [[noreturn]] void Violation(const char* what) noexcept;
+
+    // SCHED_FIFO at priority, false when RLIMIT_RTPRIO doesn't allow it
+    bool Promote(pthread_t thread, int priority) noexcept;
+
+    // Whether thread already runs with a realtime policy
+    [[nodiscard]] bool IsRealtime(pthread_t thread) noexcept;
+
+    // One bit per CPU, as many as the kernel's cpu_set_t holds
+    using CpuSet = std::bitset<CPU_SETSIZE>;
+
+    // "3", "0,2" or "1-3,6" as in isolcpus= or taskset -c, nothing for
+    // anything else or a list without a single CPU in it
+    [[nodiscard]] std::optional<CpuSet> ParseCpuList(std::string_view list) noexcept;
+
+    // The other way around, ranges are folded back into "1-3"
+    [[nodiscard]] std::string FormatCpuList(const CpuSet& cpus);
+
+    // Restricts thread to cpus, threads it creates afterwards start out
+    // with the same set. False if none of them are online or allowed.
+    bool Pin(pthread_t thread, const CpuSet& cpus) noexcept;
+
+    // What thread is allowed to run on right now, empty on failure
+    [[nodiscard]] CpuSet Affinity(pthread_t thread) noexcept;
+
+    // Keeps the pages of a range resident for as long as it lives, so the
+    // realtime threads never take a page fault on them. It stays empty
+    // when RLIMIT_MEMLOCK doesn't allow it.
+    class MemoryLock
+    {
+    public:
+        MemoryLock() = default;
+        MemoryLock(const void* data, std::size_t size) noexcept;
+        ~MemoryLock();
+
+        MemoryLock(const MemoryLock&)            = delete;
+        MemoryLock& operator=(const MemoryLock&) = delete;
+
+        MemoryLock(MemoryLock&& other) noexcept;
+        MemoryLock& operator=(MemoryLock&& other) noexcept;
+
+        [[nodiscard]] std::size_t size() const noexcept
+        { return m_size; }
+
+    private:
+        void unlock() noexcept;
+
+        const void* m_data{};
+        std::size_t m_size{};
+    };
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+
+/*
+ * Fixed capacity single producer / single consumer byte ring.
+ *
+ * Read and write positions are free running 64-bit counters, the storage
+ * index is obtained by masking, so the capacity is always a power of two.
+ * Each counter lives on its own cache line, as do the repositioning
+ * requests and the wakeup epoch, so no two sides write to the same line.
+ *
+ * On top of what is queued the ring can hold on to the most recently read
+ * bytes, the producer never overwrites them, so the consumer can be sent
+ * back over them with rewind() without anything being produced again.
+ */
+class RingBuffer
+{
+public:
+    static constexpr std::size_t CacheLine{ 64 };
+
+    RingBuffer(const RingBuffer&)            = delete;
+    RingBuffer(RingBuffer&&)                 = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    RingBuffer& operator=(RingBuffer&&)      = delete;
+
+    // capacity is what can be queued, history comes on top of it
+    explicit RingBuffer(std::size_t capacity, std::size_t high_watermark, std::size_t low_watermark, std::size_t history = 0)
+        : m_capacity       { std::bit_ceil(std::max<std::size_t>(capacity + history, CacheLine)) }
+        , m_mask           { m_capacity - 1 }
+        , m_history        { history }
+        , m_high_watermark { std::min(high_watermark, m_capacity - m_history) }
+        , m_low_watermark  { std::min(low_watermark, m_high_watermark.load()) }
+        , m_data           { std::make_unique<std::uint8_t[]>(m_capacity) }
+    { }
+
+    // Producer side. Returns how many bytes were actually stored.
+    std::size_t write(const std::uint8_t* data, std::size_t length) noexcept
+    {
+        const auto w = m_write.load(std::memory_order_relaxed);
+
+        length = std::min(length, free_space(w, writable_from()));
+        if (length == 0)
+            return 0;
+
+        const auto at    = static_cast<std::size_t>(w & m_mask);
+        const auto first = std::min(length, m_capacity - at);
+
+        std::memcpy(m_data.get() + at, data, first);
+        std::memcpy(m_data.get(), data + first, length - first);
+
+        m_write.store(w + length, std::memory_order_release);
+        return length;
+    }
+
+    // Consumer side. Contiguous readable region, may be shorter than size()
+    // when the readable data wraps around the end of the storage.
+    [[nodiscard]] std::span<const std::uint8_t> peek() noexcept
+    {
+        // Announced before looking for a discard, see writable_from()
+        m_reading.store(true, std::memory_order_seq_cst);
+
+        const auto r = apply_reposition();
+        const auto w = m_write.load(std::memory_order_acquire);
+
+        const auto at = static_cast<std::size_t>(r & m_mask);
+        const std::span<const std::uint8_t> chunk{ m_data.get() + at, std::min(static_cast<std::size_t>(w - r), m_capacity - at) };
+
+        if (chunk.empty())
+            m_reading.store(false, std::memory_order_release);
+
+        return chunk;
+    }
+
+    // Consumer side. Releases bytes previously obtained through peek().
+    void consume(std::size_t length) noexcept
+    {
+        const auto r = m_read.load(std::memory_order_relaxed);
+        const auto w = m_write.load(std::memory_order_acquire);
+        m_read.store(r + std::min<std::uint64_t>(length, w - r), std::memory_order_release);
+        m_reading.store(false, std::memory_order_release);
+    }
+
+    // Consumer side. Copies up to length bytes out of the ring, wakes the
+    // producer once the ring is drained down to the low watermark.
+    std::size_t read(std::uint8_t* data, std::size_t length) noexcept
+    {
+        const bool was_above_low = not below_low_watermark();
+
+        std::size_t done{ 0 };
+        while (done < length)
+        {
+            const auto chunk = peek();
+            if (chunk.empty())
+                break;
+
+            const auto n = std::min(chunk.size(), length - done);
+            std::memcpy(data + done, chunk.data(), n);
+            consume(n);
+            done += n;
+        }
+
+        if (was_above_low and below_low_watermark())
+            wake_producer();
+
+        return done;
+    }
+
+    // Any thread. Drops everything that is queued at the time of the call,
+    // the consumer skips over it on its next peek() or read(). The space is
+    // free for the producer right away unless the consumer is in the middle
+    // of reading. Returns the write position the consumer will continue from.
+    std::uint64_t discard() noexcept
+    {
+        const auto w = m_write.load(std::memory_order_acquire);
+        m_history_from.store(w, std::memory_order_release);
+        m_discard_to.store(w, std::memory_order_seq_cst);
+        return w;
+    }
+
+    // Any thread. Sends the consumer back by up to length bytes it has already
+    // read, applied on its next peek() or read(). It never goes further back
+    // than the history kept or the last discard(), whichever is closer.
+    void rewind(std::uint64_t length) noexcept
+    { m_rewind.store(length, std::memory_order_release); }
+
+    // How far back a rewind() issued now can go
+    [[nodiscard]] std::uint64_t history() const noexcept
+    { return history_at(m_read.load(std::memory_order_acquire)); }
+
+    // Total bytes ever written and read, including discarded ones
+    [[nodiscard]] std::uint64_t write_position() const noexcept
+    { return m_write.load(std::memory_order_acquire); }
+
+    [[nodiscard]] std::uint64_t read_position() const noexcept
+    { return m_read.load(std::memory_order_acquire); }
+
+    // The producer takes the epoch before checking its conditions and then
+    // blocks in wait_producer() until the epoch changes, so a wakeup that
+    // happens in between is never lost.
+    [[nodiscard]] std::uint32_t producer_epoch() const noexcept
+    { return m_wakeups.load(std::memory_order_acquire); }
+
+    void wait_producer(std::uint32_t epoch) const noexcept
+    { m_wakeups.wait(epoch, std::memory_order_acquire); }
+
+    void wake_producer() noexcept
+    {
+        m_wakeups.fetch_add(1, std::memory_order_release);
+        m_wakeups.notify_all();
+    }
+
+    // What is queued, a discard() counts even before the consumer applied it
+    [[nodiscard]] std::size_t size() const noexcept
+    {
+        const auto r = std::max(m_read.load(std::memory_order_acquire), m_discard_to.load(std::memory_order_acquire));
+        return static_cast<std::size_t>(m_write.load(std::memory_order_acquire) - r);
+    }
+
+    [[nodiscard]] std::size_t space() const noexcept
+    {
+        return free_space(m_write.load(std::memory_order_acquire), writable_from());
+    }
+
+    [[nodiscard]] bool empty() const noexcept
+    { return size() == 0; }
+
+    [[nodiscard]] std::size_t capacity() const noexcept
+    { return m_capacity; }
+
+    // All of the storage, history included, e.g. to lock it in memory
+    [[nodiscard]] std::span<const std::uint8_t> storage() const noexcept
+    { return { m_data.get(), m_capacity }; }
+
+    [[nodiscard]] bool above_high_watermark() const noexcept
+    { return size() >= m_high_watermark.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] bool below_low_watermark() const noexcept
+    { return size() <= m_low_watermark.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] std::size_t high_watermark() const noexcept
+    { return m_high_watermark.load(std::memory_order_relaxed); }
+
+    // Any thread. Moves both watermarks, capped at what can be queued. The
+    // producer is woken up, it may have to fill up to the new ones.
+    void set_watermarks(std::size_t high, std::size_t low) noexcept
+    {
+        high = std::min(high, m_capacity - m_history);
+        m_high_watermark.store(high, std::memory_order_relaxed);
+        m_low_watermark.store(std::min(low, high), std::memory_order_relaxed);
+        wake_producer();
+    }
+
+private:
+    // Right after a rewind the queue may reach into the kept history
+    [[nodiscard]] std::size_t free_space(std::uint64_t w, std::uint64_t r) const noexcept
+    {
+        const auto used = static_cast<std::size_t>(w - r) + m_history;
+        return used < m_capacity ? m_capacity - used : 0;
+    }
+
+    // The position the producer may fill up to the capacity from. Discarded
+    // bytes are handed over before the consumer skips them, unless it may
+    // still be copying them out of a peek() from before the discard. The
+    // consumer sets m_reading before it looks at m_discard_to, so if the
+    // flag reads clear here its next peek() sees this discard or a later one.
+    [[nodiscard]] std::uint64_t writable_from() const noexcept
+    {
+        const auto r = m_read.load(std::memory_order_acquire);
+        const auto d = m_discard_to.load(std::memory_order_seq_cst);
+
+        return d > r and not m_reading.load(std::memory_order_seq_cst) ? d : r;
+    }
+
+    [[nodiscard]] std::uint64_t history_at(std::uint64_t r) const noexcept
+    {
+        const auto from = m_history_from.load(std::memory_order_acquire);
+        return r > from ? std::min<std::uint64_t>(r - from, m_history) : 0;
+    }
+
+    std::uint64_t apply_reposition() noexcept
+    {
+        auto r = m_read.load(std::memory_order_relaxed);
+        const auto before = r;
+
+        if (const auto d = m_discard_to.load(std::memory_order_seq_cst); d > r)
+        {
+            r = d;
+        }
+
+        // Looked at first, the exchange would take the line on every peek()
+        if (m_rewind.load(std::memory_order_relaxed) > 0)
+        {
+            const auto back = m_rewind.exchange(0, std::memory_order_acq_rel);
+            r -= std::min(back, history_at(r));
+        }
+
+        if (r != before)
+        {
+            m_read.store(r, std::memory_order_release);
+        }
+
+        return r;
+    }
+
+    const std::size_t m_capacity;
+    const std::size_t m_mask;
+    const std::size_t m_history;
+    std::atomic<std::size_t> m_high_watermark;
+    std::atomic<std::size_t> m_low_watermark;
+    std::unique_ptr<std::uint8_t[]> m_data;
+
+    // Written by the producer
+    alignas(CacheLine) std::atomic<std::uint64_t> m_write{ 0 };
+
+    // Written by the consumer, m_reading is set from peek() to consume()
+    alignas(CacheLine) std::atomic<std::uint64_t> m_read{ 0 };
+    std::atomic<bool> m_reading{ false };
+
+    // Written by whoever repositions the consumer, it only reads them
+    alignas(CacheLine) std::atomic<std::uint64_t> m_discard_to{ 0 };
+    std::atomic<std::uint64_t> m_history_from{ 0 };
+    std::atomic<std::uint64_t> m_rewind{ 0 };
+
+    // Bumped from any side, the producer sleeps on it
+    alignas(CacheLine) std::atomic<std::uint32_t> m_wakeups{ 0 };
+};
@@ -0,0 +1,846 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SampleConvert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define TMUS_X86
+    #include <immintrin.h>
+#endif
+
+namespace Convert
+{
+
+namespace
+{
+    using InterleaveFn = void (*)(void* out, const void* left, const void* right, std::size_t n) noexcept;
+    using ConvertFn    = void (*)(void* out, const void* in, std::size_t n) noexcept;
+
+    // Frames per step when planar input also changes format
+    constexpr std::size_t Block{ 256 };
+
+    // Every variant uses the same constants and the same clamping order,
+    // so all of them produce bit identical output.
+    constexpr float S16Scale{ 32768.f };
+    constexpr float S32Scale{ 2147483648.f };
+    constexpr float S32Max  { 2147483520.f }; // largest float below 2^31
+
+    struct Kernels
+    {
+        InterleaveFn interleave16;
+        InterleaveFn interleave32;
+        InterleaveFn interleave64;
+
+        ConvertFn f64_to_f32;
+        ConvertFn f32_to_s16;
+        ConvertFn f32_to_s32;
+        ConvertFn s16_to_f32;
+        ConvertFn s32_to_f32;
+    };
+
+    // Scalar, also used for whatever is left after the vector loops
+
+    inline float ClampUnit(float v) noexcept
+    {
+        return std::min(1.f, std::max(-1.f, v));
+    }
+
+    template <typename T>
+    void Interleave2Scalar(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<T*>(out);
+        const auto* l = static_cast<const T*>(left);
+        const auto* r = static_cast<const T*>(right);
+
+        for (std::size_t i = 0; i < n; i++)
+        {
+            o[2 * i]     = l[i];
+            o[2 * i + 1] = r[i];
+        }
+    }
+
+    template <typename T>
+    void InterleaveN(std::uint8_t* out, const std::uint8_t* const* in, int channels, std::size_t offset, std::size_t n) noexcept
+    {
+        auto* o = reinterpret_cast<T*>(out);
+
+        for (std::size_t i = offset; i < offset + n; i++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                *o++ = reinterpret_cast<const T*>(in[c])[i];
+            }
+        }
+    }
+
+    void F64ToF32Scalar(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const double*>(in);
+
+        for (std::size_t i = 0; i < n; i++)
+            o[i] = static_cast<float>(s[i]);
+    }
+
+    void F32ToS16Scalar(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int16_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        for (std::size_t i = 0; i < n; i++)
+            o[i] = static_cast<std::int16_t>(std::clamp(std::lrint(ClampUnit(s[i]) * S16Scale), -32768l, 32767l));
+    }
+
+    void F32ToS32Scalar(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int32_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        for (std::size_t i = 0; i < n; i++)
+            o[i] = static_cast<std::int32_t>(std::lrint(std::min(ClampUnit(s[i]) * S32Scale, S32Max)));
+    }
+
+    void S16ToF32Scalar(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int16_t*>(in);
+
+        for (std::size_t i = 0; i < n; i++)
+            o[i] = static_cast<float>(s[i]) * (1.f / S16Scale);
+    }
+
+    void S32ToF32Scalar(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int32_t*>(in);
+
+        for (std::size_t i = 0; i < n; i++)
+            o[i] = static_cast<float>(s[i]) * (1.f / S32Scale);
+    }
+
+    constexpr Kernels ScalarKernels
+    {
+        .interleave16 = Interleave2Scalar<std::uint16_t>,
+        .interleave32 = Interleave2Scalar<std::uint32_t>,
+        .interleave64 = Interleave2Scalar<std::uint64_t>,
+        .f64_to_f32   = F64ToF32Scalar,
+        .f32_to_s16   = F32ToS16Scalar,
+        .f32_to_s32   = F32ToS32Scalar,
+        .s16_to_f32   = S16ToF32Scalar,
+        .s32_to_f32   = S32ToF32Scalar,
+    };
+
+#ifdef TMUS_X86
+
+    // SSE2, 128-bit
+
+    [[gnu::target("sse2")]] void Interleave16SSE2(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int16_t*>(out);
+        const auto* l = static_cast<const std::int16_t*>(left);
+        const auto* r = static_cast<const std::int16_t*>(right);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(l + i));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i),     _mm_unpacklo_epi16(a, b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i + 8), _mm_unpackhi_epi16(a, b));
+        }
+
+        Interleave2Scalar<std::int16_t>(o + 2 * i, l + i, r + i, n - i);
+    }
+
+    [[gnu::target("sse2")]] void Interleave32SSE2(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int32_t*>(out);
+        const auto* l = static_cast<const std::int32_t*>(left);
+        const auto* r = static_cast<const std::int32_t*>(right);
+
+        std::size_t i{ 0 };
+        for (; i + 4 <= n; i += 4)
+        {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(l + i));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i),     _mm_unpacklo_epi32(a, b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i + 4), _mm_unpackhi_epi32(a, b));
+        }
+
+        Interleave2Scalar<std::int32_t>(o + 2 * i, l + i, r + i, n - i);
+    }
+
+    [[gnu::target("sse2")]] void Interleave64SSE2(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int64_t*>(out);
+        const auto* l = static_cast<const std::int64_t*>(left);
+        const auto* r = static_cast<const std::int64_t*>(right);
+
+        std::size_t i{ 0 };
+        for (; i + 2 <= n; i += 2)
+        {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(l + i));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i),     _mm_unpacklo_epi64(a, b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i + 2), _mm_unpackhi_epi64(a, b));
+        }
+
+        Interleave2Scalar<std::int64_t>(o + 2 * i, l + i, r + i, n - i);
+    }
+
+    [[gnu::target("sse2")]] void F64ToF32SSE2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const double*>(in);
+
+        std::size_t i{ 0 };
+        for (; i + 4 <= n; i += 4)
+        {
+            const auto a = _mm_cvtpd_ps(_mm_loadu_pd(s + i));
+            const auto b = _mm_cvtpd_ps(_mm_loadu_pd(s + i + 2));
+            _mm_storeu_ps(o + i, _mm_movelh_ps(a, b));
+        }
+
+        F64ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("sse2")]] void F32ToS16SSE2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int16_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        const auto lo    = _mm_set1_ps(-1.f);
+        const auto hi    = _mm_set1_ps(1.f);
+        const auto scale = _mm_set1_ps(S16Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto a = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(s + i))), scale);
+            const auto b = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(s + i + 4))), scale);
+
+            // packs saturates +32768 down to 32767
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+        }
+
+        F32ToS16Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("sse2")]] void F32ToS32SSE2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int32_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        const auto lo    = _mm_set1_ps(-1.f);
+        const auto hi    = _mm_set1_ps(1.f);
+        const auto scale = _mm_set1_ps(S32Scale);
+        const auto max   = _mm_set1_ps(S32Max);
+
+        std::size_t i{ 0 };
+        for (; i + 4 <= n; i += 4)
+        {
+            const auto a = _mm_mul_ps(_mm_min_ps(hi, _mm_max_ps(lo, _mm_loadu_ps(s + i))), scale);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(o + i), _mm_cvtps_epi32(_mm_min_ps(a, max)));
+        }
+
+        F32ToS32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("sse2")]] void S16ToF32SSE2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int16_t*>(in);
+
+        const auto scale = _mm_set1_ps(1.f / S16Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+
+            // Duplicate every sample into a 32-bit lane and shift it back down to sign extend
+            const auto a = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            const auto b = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+
+            _mm_storeu_ps(o + i,     _mm_mul_ps(_mm_cvtepi32_ps(a), scale));
+            _mm_storeu_ps(o + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), scale));
+        }
+
+        S16ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("sse2")]] void S32ToF32SSE2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int32_t*>(in);
+
+        const auto scale = _mm_set1_ps(1.f / S32Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 4 <= n; i += 4)
+        {
+            const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            _mm_storeu_ps(o + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+        }
+
+        S32ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    constexpr Kernels SSE2Kernels
+    {
+        .interleave16 = Interleave16SSE2,
+        .interleave32 = Interleave32SSE2,
+        .interleave64 = Interleave64SSE2,
+        .f64_to_f32   = F64ToF32SSE2,
+        .f32_to_s16   = F32ToS16SSE2,
+        .f32_to_s32   = F32ToS32SSE2,
+        .s16_to_f32   = S16ToF32SSE2,
+        .s32_to_f32   = S32ToF32SSE2,
+    };
+
+    // AVX2, 256-bit. Unpacking works within each 128-bit lane,
+    // the halves are put back in order with a cross lane permute.
+
+    [[gnu::target("avx2")]] void Interleave16AVX2(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int16_t*>(out);
+        const auto* l = static_cast<const std::int16_t*>(left);
+        const auto* r = static_cast<const std::int16_t*>(right);
+
+        std::size_t i{ 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            const auto a  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(l + i));
+            const auto b  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i));
+            const auto lo = _mm256_unpacklo_epi16(a, b);
+            const auto hi = _mm256_unpackhi_epi16(a, b);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i),      _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+
+        Interleave2Scalar<std::int16_t>(o + 2 * i, l + i, r + i, n - i);
+    }
+
+    [[gnu::target("avx2")]] void Interleave32AVX2(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int32_t*>(out);
+        const auto* l = static_cast<const std::int32_t*>(left);
+        const auto* r = static_cast<const std::int32_t*>(right);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto a  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(l + i));
+            const auto b  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i));
+            const auto lo = _mm256_unpacklo_epi32(a, b);
+            const auto hi = _mm256_unpackhi_epi32(a, b);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i),     _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+
+        Interleave2Scalar<std::int32_t>(o + 2 * i, l + i, r + i, n - i);
+    }
+
+    [[gnu::target("avx2")]] void Interleave64AVX2(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int64_t*>(out);
+        const auto* l = static_cast<const std::int64_t*>(left);
+        const auto* r = static_cast<const std::int64_t*>(right);
+
+        std::size_t i{ 0 };
+        for (; i + 4 <= n; i += 4)
+        {
+            const auto a  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(l + i));
+            const auto b  = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(r + i));
+            const auto lo = _mm256_unpacklo_epi64(a, b);
+            const auto hi = _mm256_unpackhi_epi64(a, b);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i),     _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+
+        Interleave2Scalar<std::int64_t>(o + 2 * i, l + i, r + i, n - i);
+    }
+
+    [[gnu::target("avx2")]] void F64ToF32AVX2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const double*>(in);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto a = _mm256_cvtpd_ps(_mm256_loadu_pd(s + i));
+            const auto b = _mm256_cvtpd_ps(_mm256_loadu_pd(s + i + 4));
+            _mm256_storeu_ps(o + i, _mm256_insertf128_ps(_mm256_castps128_ps256(a), b, 1));
+        }
+
+        F64ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx2")]] void F32ToS16AVX2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int16_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        const auto lo    = _mm256_set1_ps(-1.f);
+        const auto hi    = _mm256_set1_ps(1.f);
+        const auto scale = _mm256_set1_ps(S16Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            const auto a = _mm256_mul_ps(_mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_loadu_ps(s + i))), scale);
+            const auto b = _mm256_mul_ps(_mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_loadu_ps(s + i + 8))), scale);
+
+            const auto packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i), _mm256_permute4x64_epi64(packed, 0xD8));
+        }
+
+        F32ToS16Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx2")]] void F32ToS32AVX2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int32_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        const auto lo    = _mm256_set1_ps(-1.f);
+        const auto hi    = _mm256_set1_ps(1.f);
+        const auto scale = _mm256_set1_ps(S32Scale);
+        const auto max   = _mm256_set1_ps(S32Max);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto a = _mm256_mul_ps(_mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_loadu_ps(s + i))), scale);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i), _mm256_cvtps_epi32(_mm256_min_ps(a, max)));
+        }
+
+        F32ToS32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx2")]] void S16ToF32AVX2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int16_t*>(in);
+
+        const auto scale = _mm256_set1_ps(1.f / S16Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i)));
+            _mm256_storeu_ps(o + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+        }
+
+        S16ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx2")]] void S32ToF32AVX2(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int32_t*>(in);
+
+        const auto scale = _mm256_set1_ps(1.f / S32Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            const auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+            _mm256_storeu_ps(o + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+        }
+
+        S32ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    constexpr Kernels AVX2Kernels
+    {
+        .interleave16 = Interleave16AVX2,
+        .interleave32 = Interleave32AVX2,
+        .interleave64 = Interleave64AVX2,
+        .f64_to_f32   = F64ToF32AVX2,
+        .f32_to_s16   = F32ToS16AVX2,
+        .f32_to_s32   = F32ToS32AVX2,
+        .s16_to_f32   = S16ToF32AVX2,
+        .s32_to_f32   = S32ToF32AVX2,
+    };
+
+    // AVX-512, 512-bit. Two source permutes interleave across the whole register.
+
+    alignas(64) constexpr std::array<std::uint16_t, 64> Interleave16Index = []
+    {
+        std::array<std::uint16_t, 64> idx{};
+        for (std::uint16_t i = 0; i < 32; i++)
+        {
+            idx[2 * i]     = i;
+            idx[2 * i + 1] = static_cast<std::uint16_t>(i + 32);
+        }
+        return idx;
+    }();
+
+    alignas(64) constexpr std::array<std::uint32_t, 32> Interleave32Index = []
+    {
+        std::array<std::uint32_t, 32> idx{};
+        for (std::uint32_t i = 0; i < 16; i++)
+        {
+            idx[2 * i]     = i;
+            idx[2 * i + 1] = i + 16;
+        }
+        return idx;
+    }();
+
+    alignas(64) constexpr std::array<std::uint64_t, 16> Interleave64Index = []
+    {
+        std::array<std::uint64_t, 16> idx{};
+        for (std::uint64_t i = 0; i < 8; i++)
+        {
+            idx[2 * i]     = i;
+            idx[2 * i + 1] = i + 8;
+        }
+        return idx;
+    }();
+
+    template <typename T, std::size_t N>
+    [[gnu::target("avx512f,avx512bw")]] void Interleave2AVX512(void* out, const void* left, const void* right, std::size_t n,
+                                                              const std::array<T, N>& index) noexcept
+    {
+        constexpr std::size_t Lanes{ 64 / sizeof (T) };
+
+        auto* o       = static_cast<T*>(out);
+        const auto* l = static_cast<const T*>(left);
+        const auto* r = static_cast<const T*>(right);
+
+        const auto idx_lo = _mm512_load_si512(index.data());
+        const auto idx_hi = _mm512_load_si512(index.data() + Lanes);
+
+        std::size_t i{ 0 };
+        for (; i + Lanes <= n; i += Lanes)
+        {
+            const auto a = _mm512_loadu_si512(l + i);
+            const auto b = _mm512_loadu_si512(r + i);
+
+            if constexpr (sizeof (T) == 2)
+            {
+                _mm512_storeu_si512(o + 2 * i,         _mm512_permutex2var_epi16(a, idx_lo, b));
+                _mm512_storeu_si512(o + 2 * i + Lanes, _mm512_permutex2var_epi16(a, idx_hi, b));
+            }
+            else if constexpr (sizeof (T) == 4)
+            {
+                _mm512_storeu_si512(o + 2 * i,         _mm512_permutex2var_epi32(a, idx_lo, b));
+                _mm512_storeu_si512(o + 2 * i + Lanes, _mm512_permutex2var_epi32(a, idx_hi, b));
+            }
+            else
+            {
+                _mm512_storeu_si512(o + 2 * i,         _mm512_permutex2var_epi64(a, idx_lo, b));
+                _mm512_storeu_si512(o + 2 * i + Lanes, _mm512_permutex2var_epi64(a, idx_hi, b));
+            }
+        }
+
+        Interleave2Scalar<T>(o + 2 * i, l + i, r + i, n - i);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void Interleave16AVX512(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        Interleave2AVX512(out, left, right, n, Interleave16Index);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void Interleave32AVX512(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        Interleave2AVX512(out, left, right, n, Interleave32Index);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void Interleave64AVX512(void* out, const void* left, const void* right, std::size_t n) noexcept
+    {
+        Interleave2AVX512(out, left, right, n, Interleave64Index);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void F64ToF32AVX512(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const double*>(in);
+
+        std::size_t i{ 0 };
+        for (; i + 8 <= n; i += 8)
+        {
+            _mm256_storeu_ps(o + i, _mm512_cvtpd_ps(_mm512_loadu_pd(s + i)));
+        }
+
+        F64ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void F32ToS16AVX512(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int16_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        const auto lo    = _mm512_set1_ps(-1.f);
+        const auto hi    = _mm512_set1_ps(1.f);
+        const auto scale = _mm512_set1_ps(S16Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            const auto a = _mm512_mul_ps(_mm512_min_ps(hi, _mm512_max_ps(lo, _mm512_loadu_ps(s + i))), scale);
+
+            // Saturating narrow, +32768 ends up as 32767
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + i), _mm512_cvtsepi32_epi16(_mm512_cvtps_epi32(a)));
+        }
+
+        F32ToS16Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void F32ToS32AVX512(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<std::int32_t*>(out);
+        const auto* s = static_cast<const float*>(in);
+
+        const auto lo    = _mm512_set1_ps(-1.f);
+        const auto hi    = _mm512_set1_ps(1.f);
+        const auto scale = _mm512_set1_ps(S32Scale);
+        const auto max   = _mm512_set1_ps(S32Max);
+
+        std::size_t i{ 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            const auto a = _mm512_mul_ps(_mm512_min_ps(hi, _mm512_max_ps(lo, _mm512_loadu_ps(s + i))), scale);
+            _mm512_storeu_si512(o + i, _mm512_cvtps_epi32(_mm512_min_ps(a, max)));
+        }
+
+        F32ToS32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void S16ToF32AVX512(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int16_t*>(in);
+
+        const auto scale = _mm512_set1_ps(1.f / S16Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            const auto v = _mm512_cvtepi16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i)));
+            _mm512_storeu_ps(o + i, _mm512_mul_ps(_mm512_cvtepi32_ps(v), scale));
+        }
+
+        S16ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    [[gnu::target("avx512f,avx512bw")]] void S32ToF32AVX512(void* out, const void* in, std::size_t n) noexcept
+    {
+        auto* o       = static_cast<float*>(out);
+        const auto* s = static_cast<const std::int32_t*>(in);
+
+        const auto scale = _mm512_set1_ps(1.f / S32Scale);
+
+        std::size_t i{ 0 };
+        for (; i + 16 <= n; i += 16)
+        {
+            _mm512_storeu_ps(o + i, _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_loadu_si512(s + i)), scale));
+        }
+
+        S32ToF32Scalar(o + i, s + i, n - i);
+    }
+
+    constexpr Kernels AVX512Kernels
+    {
+        .interleave16 = Interleave16AVX512,
+        .interleave32 = Interleave32AVX512,
+        .interleave64 = Interleave64AVX512,
+        .f64_to_f32   = F64ToF32AVX512,
+        .f32_to_s16   = F32ToS16AVX512,
+        .f32_to_s32   = F32ToS32AVX512,
+        .s16_to_f32   = S16ToF32AVX512,
+        .s32_to_f32   = S32ToF32AVX512,
+    };
+
+#endif // TMUS_X86
+
+    const Kernels& KernelsFor(Isa isa) noexcept
+    {
+        switch (isa)
+        {
+#ifdef TMUS_X86
+        case Isa::SSE2:   return SSE2Kernels;
+        case Isa::AVX2:   return AVX2Kernels;
+        case Isa::AVX512: return AVX512Kernels;
+#endif
+        default:          return ScalarKernels;
+        }
+    }
+
+    // Kernel turning packed 'in' samples into 'out' ones, nullptr if there is none
+    ConvertFn FindConvert(const Kernels& kernels, AVSampleFormat in, AVSampleFormat out) noexcept
+    {
+        if (in == AV_SAMPLE_FMT_DBL and out == AV_SAMPLE_FMT_FLT)
+            return kernels.f64_to_f32;
+        if (in == AV_SAMPLE_FMT_FLT and out == AV_SAMPLE_FMT_S16)
+            return kernels.f32_to_s16;
+        if (in == AV_SAMPLE_FMT_FLT and out == AV_SAMPLE_FMT_S32)
+            return kernels.f32_to_s32;
+        if (in == AV_SAMPLE_FMT_S16 and out == AV_SAMPLE_FMT_FLT)
+            return kernels.s16_to_f32;
+        if (in == AV_SAMPLE_FMT_S32 and out == AV_SAMPLE_FMT_FLT)
+            return kernels.s32_to_f32;
+
+        return nullptr;
+    }
+
+    InterleaveFn FindInterleave(const Kernels& kernels, std::size_t sample_size) noexcept
+    {
+        switch (sample_size)
+        {
+        case 1:  return Interleave2Scalar<std::uint8_t>;
+        case 2:  return kernels.interleave16;
+        case 4:  return kernels.interleave32;
+        case 8:  return kernels.interleave64;
+        default: return nullptr;
+        }
+    }
+}
+
+Isa Detect() noexcept
+{
+#ifdef TMUS_X86
+    static const Isa isa = []
+    {
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512bw"))
+            return Isa::AVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::AVX2;
+        if (__builtin_cpu_supports("sse2"))
+            return Isa::SSE2;
+
+        return Isa::Scalar;
+    }();
+
+    return isa;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+std::string_view ToString(Isa isa) noexcept
+{
+    switch (isa)
+    {
+    case Isa::Scalar: return "scalar";
+    case Isa::SSE2:   return "SSE2";
+    case Isa::AVX2:   return "AVX2";
+    case Isa::AVX512: return "AVX-512";
+    }
+
+    return "unknown";
+}
+
+bool Converter::Supported(AVSampleFormat in, AVSampleFormat out) noexcept
+{
+    if (in == AV_SAMPLE_FMT_NONE or out == AV_SAMPLE_FMT_NONE or av_sample_fmt_is_planar(out))
+        return false;
+
+    const auto packed = av_get_packed_sample_fmt(in);
+    if (packed == out)
+        return av_sample_fmt_is_planar(in);
+
+    return FindConvert(ScalarKernels, packed, out) != nullptr;
+}
+
+Converter::Converter(AVSampleFormat in, AVSampleFormat out, int channels, Isa isa)
+    : m_isa      { isa }
+    , m_channels { channels }
+    , m_planar   { av_sample_fmt_is_planar(in) != 0 }
+    , m_in_size  { static_cast<std::size_t>(av_get_bytes_per_sample(in)) }
+    , m_out_size { static_cast<std::size_t>(av_get_bytes_per_sample(out)) }
+{
+    if (not Supported(in, out) or channels < 1)
+    {
+        throw std::runtime_error(std::format("No conversion kernel for {} -> {} with {} channels",
+                                             static_cast<int>(in), static_cast<int>(out), channels));
+    }
+
+    if (m_isa > Detect())
+    {
+        throw std::runtime_error(std::format("{} is not supported by this CPU", ToString(m_isa)));
+    }
+
+    const auto& kernels = KernelsFor(m_isa);
+
+    m_interleave2 = FindInterleave(kernels, m_in_size);
+    m_convert     = FindConvert(kernels, av_get_packed_sample_fmt(in), out);
+
+    if (m_planar and m_convert)
+    {
+        m_scratch.resize(Block * static_cast<std::size_t>(m_channels) * m_in_size);
+    }
+}
+
+void Converter::interleave(std::uint8_t* out, const std::uint8_t* const* in, std::size_t offset, std::size_t samples) noexcept
+{
+    if (m_channels == 2 and m_interleave2)
+    {
+        m_interleave2(out, in[0] + offset * m_in_size, in[1] + offset * m_in_size, samples);
+        return;
+    }
+
+    switch (m_in_size)
+    {
+    case 1: InterleaveN<std::uint8_t> (out, in, m_channels, offset, samples); break;
+    case 2: InterleaveN<std::uint16_t>(out, in, m_channels, offset, samples); break;
+    case 4: InterleaveN<std::uint32_t>(out, in, m_channels, offset, samples); break;
+    case 8: InterleaveN<std::uint64_t>(out, in, m_channels, offset, samples); break;
+    default: break;
+    }
+}
+
+void Converter::operator()(std::uint8_t* out, const std::uint8_t* const* in, int samples) noexcept
+{
+    const auto n        = static_cast<std::size_t>(std::max(samples, 0));
+    const auto channels = static_cast<std::size_t>(m_channels);
+
+    if (not m_planar)
+    {
+        m_convert(out, in[0], n * channels);
+        return;
+    }
+
+    if (not m_convert)
+    {
+        interleave(out, in, 0, n);
+        return;
+    }
+
+    for (std::size_t done = 0; done < n; done += Block)
+    {
+        const auto count = std::min(Block, n - done);
+
+        interleave(m_scratch.data(), in, done, count);
+        m_convert(out + done * channels * m_out_size, m_scratch.data(), count * channels);
+    }
+}
+
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+extern "C"
+{
+    #include <libavutil/samplefmt.h>
+}
+
+/*
+ * Interleaving and sample format conversion for the cases where only the
+ * layout or the representation changes, not the rate. Most lossy decoders
+ * output planar float, going through libswresample for that is mostly
+ * overhead. The kernels are picked once at startup for the best
+ * instruction set the CPU supports.
+ */
+namespace Convert
+{
+    enum class Isa
+    {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512,
+    };
+
+    // Best instruction set both the build and the running CPU support
+    [[nodiscard]] Isa Detect() noexcept;
+    [[nodiscard]] std::string_view ToString(Isa isa) noexcept;
+
+    class Converter
+    {
+    public:
+        Converter(const Converter&)            = delete;
+        Converter(Converter&&)                 = default;
+        Converter& operator=(const Converter&) = delete;
+        Converter& operator=(Converter&&)      = default;
+
+        // Throws when Supported(in, out) is false or isa isn't available
+        Converter(AVSampleFormat in, AVSampleFormat out, int channels, Isa isa = Detect());
+
+        // in has one pointer per channel for planar formats, a single one otherwise.
+        // out is always interleaved and has to hold samples * channels samples.
+        void operator()(std::uint8_t* out, const std::uint8_t* const* in, int samples) noexcept;
+
+        // Whether in -> out is handled here. The output is always packed.
+        [[nodiscard]] static bool Supported(AVSampleFormat in, AVSampleFormat out) noexcept;
+
+        [[nodiscard]] Isa GetIsa() const noexcept
+        { return m_isa; }
+
+    private:
+        using InterleaveFn = void (*)(void* out, const void* left, const void* right, std::size_t n) noexcept;
+        using ConvertFn    = void (*)(void* out, const void* in, std::size_t n) noexcept;
+
+        void interleave(std::uint8_t* out, const std::uint8_t* const* in, std::size_t offset, std::size_t samples) noexcept;
+
+        Isa m_isa;
+        int m_channels;
+        bool m_planar;
+        std::size_t m_in_size;
+        std::size_t m_out_size;
+
+        InterleaveFn m_interleave2{};
+        ConvertFn m_convert{};
+
+        // Planar input that also changes format is interleaved here block by block
+        std::vector<std::uint8_t> m_scratch{};
+    };
+}
@@ -0,0 +1,620 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "SeekIndex.hpp"
+#include "SampleConvert.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define TMUS_X86
+    #include <immintrin.h>
+#endif
+
+namespace
+{
+    constexpr std::array<char, 4> Magic{ 't', 'M', 'S', 'I' };
+    constexpr std::uint32_t Version{ 1 };
+
+    // Roughly how far apart the entries are, in seconds of audio
+    constexpr int EntriesPerSecond{ 2 };
+
+    constexpr std::size_t ChunkSize{ 1 << 20 };
+
+    struct FrameHeader
+    {
+        int length{};
+        int samples{};
+        int rate{};
+        bool adts{};
+        bool mono{};
+        bool layer3{};
+        bool lsf{};
+    };
+
+    std::optional<FrameHeader> ParseAdts(const std::uint8_t* h) noexcept
+    {
+        static constexpr std::array<int, 13> Rates{ 96000, 88200, 64000, 48000, 44100, 32000,
+                                                    24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+
+        // 12 set bits and layer 00
+        if (h[0] != 0xFF or (h[1] & 0xF6) != 0xF0)
+            return std::nullopt;
+
+        const auto rate_index = (h[2] >> 2) & 0xF;
+        const auto length     = ((h[3] & 0x3) << 11) | (h[4] << 3) | (h[5] >> 5);
+        if (rate_index >= static_cast<int>(Rates.size()) or length < 7)
+            return std::nullopt;
+
+        return FrameHeader{ .length  = length,
+                            .samples = 1024 * ((h[6] & 0x3) + 1),
+                            .rate    = Rates[static_cast<std::size_t>(rate_index)],
+                            .adts    = true };
+    }
+
+    // MPEG-1, 2 and 2.5, layers I to III
+    std::optional<FrameHeader> ParseMpeg(const std::uint8_t* h) noexcept
+    {
+        // kbit/s, [lsf][layer - 1][index]
+        static constexpr int Bitrates[2][3][15]
+        {
+            {
+                { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+                { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+                { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 },
+            },
+            {
+                { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+                { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160 },
+                { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160 },
+            },
+        };
+        static constexpr std::array<int, 3> Rates{ 44100, 48000, 32000 };
+
+        if (h[0] != 0xFF or (h[1] & 0xE0) != 0xE0)
+            return std::nullopt;
+
+        const auto version       = (h[1] >> 3) & 0x3; // 0: 2.5, 2: 2, 3: 1
+        const auto layer         = 4 - ((h[1] >> 1) & 0x3);
+        const auto bitrate_index = h[2] >> 4;
+        const auto rate_index    = (h[2] >> 2) & 0x3;
+        const auto padding       = (h[2] >> 1) & 0x1;
+
+        // Free format frames don't say how long they are
+        if (version == 1 or layer == 4 or bitrate_index == 0 or bitrate_index == 15 or rate_index == 3)
+            return std::nullopt;
+
+        const bool lsf     = version != 3;
+        const auto rate    = Rates[static_cast<std::size_t>(rate_index)] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+        const auto bitrate = Bitrates[lsf][layer - 1][bitrate_index] * 1000;
+
+        FrameHeader header{ .rate = rate, .mono = (h[3] >> 6) == 3, .layer3 = layer == 3, .lsf = lsf };
+        if (layer == 1)
+        {
+            header.length  = (12 * bitrate / rate + padding) * 4;
+            header.samples = 384;
+        }
+        else if (layer == 3 and lsf)
+        {
+            header.length  = 72 * bitrate / rate + padding;
+            header.samples = 576;
+        }
+        else
+        {
+            header.length  = 144 * bitrate / rate + padding;
+            header.samples = 1152;
+        }
+
+        return header;
+    }
+
+    std::optional<FrameHeader> ParseFrame(const std::uint8_t* h) noexcept
+    {
+        if (auto header = ParseAdts(h))
+            return header;
+
+        return ParseMpeg(h);
+    }
+
+    // Buffered window over the file, only ever moves forwards in practice
+    class Reader
+    {
+    public:
+        explicit Reader(const std::filesystem::path& path)
+            : m_file{ path, std::ios::binary }
+            , m_buf(ChunkSize)
+        { }
+
+        explicit operator bool() const noexcept
+        { return m_file.is_open(); }
+
+        // [pos, pos + n) or nullptr past the end of the file. Invalidates what it returned before.
+        const std::uint8_t* at(std::int64_t pos, std::size_t n)
+        {
+            if (pos < m_base or pos + static_cast<std::int64_t>(n) > m_base + static_cast<std::int64_t>(m_len))
+            {
+                m_file.clear();
+                m_file.seekg(pos);
+                m_file.read(reinterpret_cast<char*>(m_buf.data()), static_cast<std::streamsize>(m_buf.size()));
+
+                m_base = pos;
+                m_len  = static_cast<std::size_t>(std::max<std::streamsize>(m_file.gcount(), 0));
+
+                if (n > m_len)
+                    return nullptr;
+            }
+
+            return m_buf.data() + (pos - m_base);
+        }
+
+        // Next sync word at or after pos, -1 if there is none left
+        std::int64_t resync(std::int64_t pos)
+        {
+            while (at(pos, 2))
+            {
+                const auto from  = static_cast<std::size_t>(pos - m_base);
+                const auto found = SeekIndex::FindSync({ m_buf.data(), m_len }, from);
+                if (found < m_len)
+                    return m_base + static_cast<std::int64_t>(found);
+
+                // The last byte might be the first half of one
+                pos = m_base + static_cast<std::int64_t>(m_len) - 1;
+            }
+
+            return -1;
+        }
+
+    private:
+        std::ifstream m_file;
+        std::vector<std::uint8_t> m_buf;
+        std::int64_t m_base{};
+        std::size_t m_len{};
+    };
+
+    std::int64_t SkipId3v2(Reader& reader)
+    {
+        std::int64_t pos{ 0 };
+
+        // There can be more than one stacked in front of the audio
+        while (const auto* h = reader.at(pos, 10))
+        {
+            if (std::memcmp(h, "ID3", 3) != 0)
+                break;
+
+            const auto size = (h[6] & 0x7F) << 21 | (h[7] & 0x7F) << 14 | (h[8] & 0x7F) << 7 | (h[9] & 0x7F);
+            const auto footer = (h[5] & 0x10) ? 10 : 0;
+            pos += 10 + size + footer;
+        }
+
+        return pos;
+    }
+
+    // The LAME/Xing and VBRI frames describe the stream and aren't decoded
+    bool IsInfoFrame(Reader& reader, std::int64_t pos, const FrameHeader& header)
+    {
+        if (not header.layer3)
+            return false;
+
+        const auto side = header.lsf ? (header.mono ? 9 : 17) : (header.mono ? 17 : 32);
+        if (const auto* h = reader.at(pos + 4 + side, 4); h and (std::memcmp(h, "Xing", 4) == 0 or std::memcmp(h, "Info", 4) == 0))
+            return true;
+
+        const auto* h = reader.at(pos + 4 + 32, 4);
+        return h and std::memcmp(h, "VBRI", 4) == 0;
+    }
+
+    template<typename T>
+    void Put(std::ostream& out, const T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    bool Get(std::istream& in, T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+
+    // Size and modification time, what tells a cached table is still good
+    std::optional<std::pair<std::int64_t, std::int64_t>> FileStamp(const std::filesystem::path& path) noexcept
+    {
+        std::error_code ec;
+        if (not std::filesystem::is_regular_file(path, ec))
+            return std::nullopt;
+
+        const auto size = std::filesystem::file_size(path, ec);
+        if (ec)
+            return std::nullopt;
+
+        const auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec)
+            return std::nullopt;
+
+        return std::pair{ static_cast<std::int64_t>(size), static_cast<std::int64_t>(mtime.time_since_epoch().count()) };
+    }
+
+    std::size_t FindSyncScalar(const std::uint8_t* data, std::size_t from, std::size_t size) noexcept
+    {
+        for (std::size_t i = from; i + 1 < size; i++)
+        {
+            if (data[i] == 0xFF and (data[i + 1] & 0xE0) == 0xE0)
+                return i;
+        }
+
+        return size;
+    }
+
+#ifdef TMUS_X86
+
+    // Compares every byte and its successor at once, the second load is just
+    // shifted by one so a sync word straddling two blocks is never missed.
+    [[gnu::target("sse2")]] std::size_t FindSyncSSE2(const std::uint8_t* data, std::size_t from, std::size_t size) noexcept
+    {
+        const auto ff   = _mm_set1_epi8(static_cast<char>(0xFF));
+        const auto mask = _mm_set1_epi8(static_cast<char>(0xE0));
+
+        std::size_t i = from;
+        for (; i + 17 <= size; i += 16)
+        {
+            const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 1));
+            const auto m = _mm_and_si128(_mm_cmpeq_epi8(a, ff), _mm_cmpeq_epi8(_mm_and_si128(b, mask), mask));
+
+            if (const auto bits = static_cast<unsigned>(_mm_movemask_epi8(m)); bits != 0)
+                return i + static_cast<std::size_t>(std::countr_zero(bits));
+        }
+
+        return FindSyncScalar(data, i, size);
+    }
+
+    [[gnu::target("avx2")]] std::size_t FindSyncAVX2(const std::uint8_t* data, std::size_t from, std::size_t size) noexcept
+    {
+        const auto ff   = _mm256_set1_epi8(static_cast<char>(0xFF));
+        const auto mask = _mm256_set1_epi8(static_cast<char>(0xE0));
+
+        std::size_t i = from;
+        for (; i + 33 <= size; i += 32)
+        {
+            const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+            const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 1));
+            const auto m = _mm256_and_si256(_mm256_cmpeq_epi8(a, ff), _mm256_cmpeq_epi8(_mm256_and_si256(b, mask), mask));
+
+            if (const auto bits = static_cast<unsigned>(_mm256_movemask_epi8(m)); bits != 0)
+                return i + static_cast<std::size_t>(std::countr_zero(bits));
+        }
+
+        return FindSyncSSE2(data, i, size);
+    }
+
+#endif
+
+    using FindSyncFn = std::size_t (*)(const std::uint8_t*, std::size_t, std::size_t) noexcept;
+
+    FindSyncFn PickFindSync() noexcept
+    {
+        switch (Convert::Detect())
+        {
+#ifdef TMUS_X86
+        case Convert::Isa::AVX512:
+        case Convert::Isa::AVX2:
+            return FindSyncAVX2;
+        case Convert::Isa::SSE2:
+            return FindSyncSSE2;
+#endif
+        default:
+            return FindSyncScalar;
+        }
+    }
+}
+
+SeekIndex::SeekIndex(std::filesystem::path path, Kind kind)
+    : m_path { std::move(path) }
+    , m_kind { kind }
+{ }
+
+std::size_t SeekIndex::FindSync(std::span<const std::uint8_t> data, std::size_t from) noexcept
+{
+    static const FindSyncFn find = PickFindSync();
+
+    if (from >= data.size())
+        return data.size();
+
+    return find(data.data(), from, data.size());
+}
+
+std::optional<SeekIndex::Kind> SeekIndex::KindFor(const AVFormatContext* ctx) noexcept
+{
+    if (ctx == nullptr or ctx->iformat == nullptr)
+        return std::nullopt;
+
+    const std::string_view name{ ctx->iformat->name };
+
+    // Raw streams, they bisect the file or guess from the bitrate
+    if (name == "mp3" or name == "aac")
+        return Kind::FRAMES;
+
+    // Bisects on page granules
+    if (name == "ogg")
+        return Kind::CONTAINER;
+
+    return std::nullopt;
+}
+
+std::optional<SeekIndex::Entry> SeekIndex::Find(std::int64_t time) const noexcept
+{
+    const auto it = std::upper_bound(m_entries.begin(), m_entries.end(), time,
+                                     [](std::int64_t t, const Entry& e) { return t < e.time; });
+    if (it == m_entries.begin())
+        return std::nullopt;
+
+    return *std::prev(it);
+}
+
+std::optional<SeekIndex> SeekIndex::Build(const std::filesystem::path& path, Kind kind, std::stop_token st)
+{
+    auto index = kind == Kind::FRAMES ? BuildFrames(path, st) : BuildContainer(path, st);
+    if (index)
+    {
+        util::Log(color::aqua, "Seek index for {}: {} entries\n", path.filename().string(), index->m_entries.size());
+    }
+
+    return index;
+}
+
+std::optional<SeekIndex> SeekIndex::BuildFrames(const std::filesystem::path& path, std::stop_token& st)
+{
+    const auto stamp = FileStamp(path);
+    Reader reader{ path };
+    if (not stamp or not reader)
+        return std::nullopt;
+
+    SeekIndex index{ path, Kind::FRAMES };
+    std::tie(index.m_file_size, index.m_mtime) = *stamp;
+
+    std::int64_t pos{ SkipId3v2(reader) };
+    std::int64_t sample{};
+    std::int64_t next_entry{};
+    std::size_t frames{};
+    bool first{ true };
+    bool adts{};
+    bool synced{};
+
+    while (pos >= 0)
+    {
+        if ((++frames & 0xFFF) == 0 and st.stop_requested())
+            return std::nullopt;
+
+        const auto* h = reader.at(pos, 7);
+        if (not h)
+            break;
+
+        auto header = ParseFrame(h);
+        if (header and not first and (header->adts != adts or header->rate != index.m_rate))
+            header.reset();
+
+        // A stray sync word in the payload isn't a frame, when we don't
+        // know where we are the frame after it has to check out too.
+        if (header and not synced)
+        {
+            if (const auto* next = reader.at(pos + header->length, 7))
+            {
+                const auto follow = ParseFrame(next);
+                if (not follow or follow->adts != header->adts or follow->rate != header->rate)
+                    header.reset();
+            }
+        }
+
+        if (not header)
+        {
+            synced = false;
+            pos    = reader.resync(pos + 1);
+            continue;
+        }
+
+        synced = true;
+
+        if (first)
+        {
+            first         = false;
+            adts          = header->adts;
+            index.m_rate  = header->rate;
+
+            if (not adts and IsInfoFrame(reader, pos, *header))
+            {
+                pos += header->length;
+                continue;
+            }
+        }
+
+        if (sample >= next_entry)
+        {
+            index.m_entries.push_back({ .time = sample, .offset = pos });
+            next_entry = sample + index.m_rate / EntriesPerSecond;
+        }
+
+        sample += header->samples;
+        pos    += header->length;
+    }
+
+    if (index.m_entries.empty())
+        return std::nullopt;
+
+    return index;
+}
+
+std::optional<SeekIndex> SeekIndex::BuildContainer(const std::filesystem::path& path, std::stop_token& st)
+{
+    const auto stamp = FileStamp(path);
+    if (not stamp)
+        return std::nullopt;
+
+    AVFormatContext* raw{};
+    if (avformat_open_input(&raw, path.c_str(), nullptr, nullptr) < 0)
+        return std::nullopt;
+
+    const auto ctx = std::unique_ptr<AVFormatContext, void(*)(AVFormatContext*)>(raw, [](AVFormatContext* ptr) { avformat_close_input(&ptr); });
+    const auto pkt = std::unique_ptr<AVPacket, void(*)(AVPacket*)>(av_packet_alloc(), [](AVPacket* ptr) { av_packet_free(&ptr); });
+
+    if (not pkt or avformat_find_stream_info(ctx.get(), nullptr) < 0)
+        return std::nullopt;
+
+    const auto stream = av_find_best_stream(ctx.get(), AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+    if (stream < 0)
+        return std::nullopt;
+
+    SeekIndex index{ path, Kind::CONTAINER };
+    std::tie(index.m_file_size, index.m_mtime) = *stamp;
+
+    const auto time_base = ctx->streams[stream]->time_base;
+    const auto interval  = av_rescale_q(AV_TIME_BASE / EntriesPerSecond, AVRational{ 1, AV_TIME_BASE }, time_base);
+    auto next_entry      = std::numeric_limits<std::int64_t>::min();
+
+    while (av_read_frame(ctx.get(), pkt.get()) >= 0)
+    {
+        if (st.stop_requested())
+            return std::nullopt;
+
+        if (pkt->stream_index == stream and pkt->pts != AV_NOPTS_VALUE and pkt->pos >= 0 and pkt->pts >= next_entry)
+        {
+            index.m_entries.push_back({ .time = pkt->pts, .offset = pkt->pos });
+            next_entry = pkt->pts + interval;
+        }
+
+        av_packet_unref(pkt.get());
+    }
+
+    if (index.m_entries.empty())
+        return std::nullopt;
+
+    return index;
+}
+
+std::filesystem::path SeekIndex::CacheFile(const std::filesystem::path& path)
+{
+    const auto dir = util::GetUserCacheDir() / "seek";
+    std::filesystem::create_directories(dir);
+
+    return dir / std::format("{:016x}.idx", std::hash<std::string>{}(std::filesystem::absolute(path).string()));
+}
+
+std::optional<SeekIndex> SeekIndex::Load(const std::filesystem::path& path) noexcept
+{
+    try
+    {
+        const auto stamp = FileStamp(path);
+        if (not stamp)
+            return std::nullopt;
+
+        std::ifstream in{ CacheFile(path), std::ios::binary };
+        if (not in)
+            return std::nullopt;
+
+        std::array<char, 4> magic{};
+        std::uint32_t version{};
+        Kind kind{};
+        std::int32_t rate{};
+        std::int64_t size{};
+        std::int64_t mtime{};
+        std::uint32_t path_len{};
+
+        if (not Get(in, magic) or magic != Magic or not Get(in, version) or version != Version)
+            return std::nullopt;
+
+        if (not Get(in, kind) or not Get(in, rate) or not Get(in, size) or not Get(in, mtime) or not Get(in, path_len))
+            return std::nullopt;
+
+        // Another file that hashed the same, or this one changed since
+        std::string stored(path_len, '\0');
+        if (not in.read(stored.data(), path_len) or stored != std::filesystem::absolute(path).string()
+            or std::pair{ size, mtime } != *stamp or (kind != Kind::FRAMES and kind != Kind::CONTAINER))
+        {
+            return std::nullopt;
+        }
+
+        std::uint64_t count{};
+        if (not Get(in, count) or count > static_cast<std::uint64_t>(size))
+            return std::nullopt;
+
+        SeekIndex index{ path, kind };
+        index.m_rate      = rate;
+        index.m_file_size = size;
+        index.m_mtime     = mtime;
+        index.m_entries.resize(count);
+
+        if (not in.read(reinterpret_cast<char*>(index.m_entries.data()), static_cast<std::streamsize>(count * sizeof(Entry))))
+            return std::nullopt;
+
+        return index;
+    }
+    catch (const std::exception& e)
+    {
+        util::Log(color::yellow, "Seek index for {} could not be loaded: {}\n", path.string(), e.what());
+        return std::nullopt;
+    }
+}
+
+void SeekIndex::Save() const
+{
+    const auto target = CacheFile(m_path);
+    const auto partial = std::filesystem::path{ target }.replace_extension(".tmp");
+
+    {
+        std::ofstream out{ partial, std::ios::binary | std::ios::trunc };
+        if (not out)
+        {
+            throw std::runtime_error(std::format("Failed to open {} for writing", partial.string()));
+        }
+
+        const auto path = std::filesystem::absolute(m_path).string();
+
+        Put(out, Magic);
+        Put(out, Version);
+        Put(out, m_kind);
+        Put(out, static_cast<std::int32_t>(m_rate));
+        Put(out, m_file_size);
+        Put(out, m_mtime);
+        Put(out, static_cast<std::uint32_t>(path.size()));
+        out.write(path.data(), static_cast<std::streamsize>(path.size()));
+        Put(out, static_cast<std::uint64_t>(m_entries.size()));
+        out.write(reinterpret_cast<const char*>(m_entries.data()), static_cast<std::streamsize>(m_entries.size() * sizeof(Entry)));
+
+        if (not out.flush())
+        {
+            throw std::runtime_error(std::format("Failed to write {}", partial.string()));
+        }
+    }
+
+    // Readers never see half a table
+    std::filesystem::rename(partial, target);
+}
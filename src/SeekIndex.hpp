@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <vector>
+
+extern "C"
+{
+    #include <libavformat/avformat.h>
+}
+
+/*
+ * Time -> byte offset table for files the demuxer can't seek in accurately
+ * or cheaply on its own: VBR MP3 without a TOC, raw ADTS and Ogg. It is
+ * built once by scanning the file in the background and kept in the user
+ * cache dir, keyed by path, size and modification time.
+ */
+class SeekIndex
+{
+public:
+    enum class Kind : std::uint8_t
+    {
+        // Raw MP3/ADTS frames. Seek by byte offset and count samples from there.
+        FRAMES = 1,
+        // Packets of a container that carries timestamps, handed to libavformat's own index
+        CONTAINER,
+    };
+
+    struct Entry
+    {
+        // Samples at rate() for FRAMES, the stream's time base for CONTAINER
+        std::int64_t time{};
+        // Where the frame or page starts in the file
+        std::int64_t offset{};
+    };
+
+    // Which kind of table helps this demuxer, nullopt when it seeks well on its own
+    [[nodiscard]] static std::optional<Kind> KindFor(const AVFormatContext* ctx) noexcept;
+
+    // The cached table for path, if there is one that still matches the file
+    [[nodiscard]] static std::optional<SeekIndex> Load(const std::filesystem::path& path) noexcept;
+
+    // Scans path once, nullopt if it isn't what kind expects or a stop was requested
+    [[nodiscard]] static std::optional<SeekIndex> Build(const std::filesystem::path& path, Kind kind, std::stop_token st);
+
+    // Throws when the cache can't be written
+    void Save() const;
+
+    // Last entry at or before time, nullopt when time lies before the first one
+    [[nodiscard]] std::optional<Entry> Find(std::int64_t time) const noexcept;
+
+    [[nodiscard]] Kind GetKind() const noexcept
+    { return m_kind; }
+
+    [[nodiscard]] int rate() const noexcept
+    { return m_rate; }
+
+    [[nodiscard]] std::span<const Entry> entries() const noexcept
+    { return m_entries; }
+
+    // Offset of the next MPEG audio / ADTS sync word, 11 set bits, at or after
+    // from. data.size() when there is none.
+    [[nodiscard]] static std::size_t FindSync(std::span<const std::uint8_t> data, std::size_t from) noexcept;
+
+private:
+    SeekIndex(std::filesystem::path path, Kind kind);
+
+    static std::optional<SeekIndex> BuildFrames(const std::filesystem::path& path, std::stop_token& st);
+    static std::optional<SeekIndex> BuildContainer(const std::filesystem::path& path, std::stop_token& st);
+
+    [[nodiscard]] static std::filesystem::path CacheFile(const std::filesystem::path& path);
+
+    std::filesystem::path m_path;
+    Kind m_kind;
+    int m_rate{};
+    std::int64_t m_file_size{};
+    std::int64_t m_mtime{};
+    std::vector<Entry> m_entries{};
+};
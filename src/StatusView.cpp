@@ -23,12 +23,41 @@
 
 #include <ncpp/Utilities.hh>
 
-std::size_t StatusView::getBytesPerSecond()
+void StatusView::SetFormat(const AudioSettings& audioSettings)
 {
-    const auto cc = m_ctx_data->codec_ctx;
-    auto tmp = m_audioSettings->freq * m_audioSettings->ch_layout.nb_channels * av_get_bytes_per_sample(m_audioSettings->fmt);
-    util::Log(color::cornsilk, "{} {}\n", tmp, av_get_bytes_per_sample(cc->sample_fmt));
-    return tmp;
+    std::scoped_lock lk{ mtx };
+
+    m_bytes_per_second = BytesPerSecond(audioSettings);
+    util::Log(color::cornsilk, "{} {}\n", m_bytes_per_second, av_get_bytes_per_sample(audioSettings.fmt));
+}
+
+void StatusView::SetTrack(const ContextData& ctx_data)
+{
+    std::scoped_lock lk{ mtx };
+
+    std::string_view url{ ctx_data.format_ctx->url };
+    url.remove_prefix(url.find_last_of('/') + 1);
+
+    m_url      = url;
+    m_duration = static_cast<int>(ctx_data.format_ctx->duration / AV_TIME_BASE);
+}
+
+void StatusView::Clear()
+{
+    {
+        std::scoped_lock lk{ mtx };
+        m_url.clear();
+        m_duration = 0;
+    }
+
+    draw();
+    Renderer::Render();
+}
+
+void StatusView::SetBufferTarget(int milliseconds)
+{
+    std::scoped_lock lk{ mtx };
+    m_buffer_ms = milliseconds;
 }
 
 void StatusView::draw(std::size_t time) const
@@ -64,11 +93,12 @@ void StatusView::draw(std::size_t time) const
         }
     };
 
-    const auto seconds          = static_cast<int>(time) / m_bytes_per_second;
-    const auto durationStr      = secondsToTime(static_cast<int>(m_ctx_data->format_ctx->duration / AV_TIME_BASE));
+    // The byte count passes INT_MAX after a few hours, only the seconds fit
+    const auto seconds          = time / m_bytes_per_second;
+    const auto durationStr      = secondsToTime(m_duration);
     const auto currentSecondStr = secondsToTime(static_cast<int>(seconds));
 
-    const auto filename = std::format("{} > {} / {}", m_url, currentSecondStr, durationStr);
+    const auto filename = std::format("{} > {} / {}  [buffer {:.1f}s]", m_url, currentSecondStr, durationStr, m_buffer_ms / 1000.0);
     const auto* cStr    = filename.c_str();
 
     std::size_t sizeInBytes{ 0 };
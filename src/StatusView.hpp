@@ -23,6 +23,8 @@
 #include <ncpp/Widget.hh>
 
 #include <memory>
+#include <mutex>
+#include <string>
 
 #include "AudioSettings.hpp"
 #include "ContextData.hpp"
@@ -31,27 +33,36 @@
 class StatusView
 {
 public:
-    explicit StatusView(ContextData& ctx_data, std::shared_ptr<AudioSettings> audioSettings)
-        : m_audioSettings    { std::move(audioSettings) }
-        , m_ctx_data         { &ctx_data }
-        , m_bytes_per_second { getBytesPerSecond() }
-        , m_url              { m_ctx_data->format_ctx->url }
-    {
-        m_ncp = MakeStatusPlane();
-
-        auto pos = m_url.find_last_of('/');
-        m_url.remove_prefix(pos + 1);
-    }
+    // The plane stays for as long as the engine does, every track only
+    // changes what is drawn on it
+    StatusView()
+        : m_ncp{ MakeStatusPlane() }
+    { }
+
+    StatusView(const StatusView&)            = delete;
+    StatusView(StatusView&&)                 = delete;
+    StatusView& operator=(const StatusView&) = delete;
+    StatusView& operator=(StatusView&&)      = delete;
+
+    // The format positions passed to draw() are counted in
+    void SetFormat(const AudioSettings& audioSettings);
+
+    // Switches the status line over to another track
+    void SetTrack(const ContextData& ctx_data);
+
+    // Nothing is playing, the line is left blank
+    void Clear();
+
+    // How far ahead of the output the decoder is buffering
+    void SetBufferTarget(int milliseconds);
 
     void draw(std::size_t override = 0) const;
 
 private:
-    std::size_t getBytesPerSecond();
-
     mutable std::mutex mtx;
-    std::shared_ptr<AudioSettings> m_audioSettings;
     std::unique_ptr<ncpp::Plane> m_ncp{};
-    ContextData* m_ctx_data{};
     std::size_t m_bytes_per_second{};
-    std::string_view m_url{};
+    std::string m_url{};
+    int m_duration{};
+    int m_buffer_ms{};
 };
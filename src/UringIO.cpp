@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "UringIO.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+extern "C"
+{
+    #include <libavutil/error.h>
+    #include <libavutil/mem.h>
+}
+
+// What avio reads into for its own small reads, probing and headers
+static constexpr int IOBufferSize{ 64 * 1024 };
+
+namespace
+{
+    int uring_setup(unsigned entries, io_uring_params* params) noexcept
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) noexcept
+    {
+        int ret{};
+        do
+        {
+            ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+        } while (ret < 0 and errno == EINTR);
+
+        return ret;
+    }
+
+    std::uint64_t NowNs() noexcept
+    {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+    }
+
+    template<typename T>
+    T* At(void* base, std::uint32_t offset) noexcept
+    {
+        return reinterpret_cast<T*>(static_cast<std::uint8_t*>(base) + offset);
+    }
+
+    // The other side of these is the kernel
+    std::uint32_t LoadAcquire(std::uint32_t* p) noexcept
+    { return std::atomic_ref<std::uint32_t>{ *p }.load(std::memory_order_acquire); }
+
+    void StoreRelease(std::uint32_t* p, std::uint32_t value) noexcept
+    { std::atomic_ref<std::uint32_t>{ *p }.store(value, std::memory_order_release); }
+
+    template<typename T>
+    void StoreMax(std::atomic<T>& target, T value) noexcept
+    {
+        auto current = target.load(std::memory_order_relaxed);
+        while (current < value and not target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        { }
+    }
+}
+
+std::shared_ptr<UringIO> UringIO::Open(const std::filesystem::path& path, int depth, std::size_t block_size) noexcept
+{
+    // Non-blocking, a FIFO would otherwise wait for a writer right here
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st{};
+    if (fstat(fd, &st) < 0 or not S_ISREG(st.st_mode) or st.st_size <= 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    constexpr std::size_t Page{ 4096 };
+    depth      = std::clamp(depth, 1, 64);
+    block_size = std::max((block_size + Page - 1) / Page * Page, Page);
+
+    std::shared_ptr<UringIO> io;
+    try
+    {
+        io.reset(new UringIO{ fd, static_cast<std::size_t>(st.st_size), depth, block_size });
+    }
+    catch (const std::bad_alloc&)
+    {
+        close(fd);
+        return nullptr;
+    }
+
+    // From here on the destructor cleans up whatever init() got to
+    try
+    {
+        io->init();
+    }
+    catch (const std::exception& e)
+    {
+        util::Log(color::yellow, "io_uring for {}: {}\n", path.string(), e.what());
+        return nullptr;
+    }
+
+    // The first block tells whether the kernel actually does reads for us
+    std::uint8_t probe{};
+    if (read_packet(io.get(), &probe, 1) != 1 or seek(io.get(), 0, SEEK_SET) != 0)
+    {
+        util::Log(color::yellow, "io_uring reads don't work for {}, falling back\n", path.string());
+        return nullptr;
+    }
+
+    return io;
+}
+
+UringIO::UringIO(int fd, std::size_t size, int depth, std::size_t block_size)
+    : m_fd         { fd }
+    , m_size       { size }
+    , m_block_size { block_size }
+    , m_blocks     ( static_cast<std::size_t>(depth) + 1 )  // One being consumed and depth ahead of it
+{ }
+
+void UringIO::init()
+{
+    for (auto& block : m_blocks)
+        block.data = std::make_unique_for_overwrite<std::uint8_t[]>(m_block_size);
+
+    setup_ring(static_cast<unsigned>(m_blocks.size()));
+
+    auto* buffer = static_cast<std::uint8_t*>(av_malloc(IOBufferSize));
+    if (not buffer)
+    {
+        throw std::runtime_error("Failed to allocate the I/O buffer");
+    }
+
+    m_avio = avio_alloc_context(buffer, IOBufferSize, 0, this, read_packet, nullptr, seek);
+    if (not m_avio)
+    {
+        av_free(buffer);
+        throw std::runtime_error("Failed to allocate the AVIOContext");
+    }
+
+    // Large reads are copied straight out of the blocks into the caller's buffer
+    m_avio->direct = 1;
+}
+
+UringIO::~UringIO()
+{
+    // The kernel still writes into these blocks, they can't go away before it's done
+    while (m_ring_fd >= 0 and m_in_flight.load(std::memory_order_relaxed) > 0)
+        reap(true);
+
+    if (m_reads.load(std::memory_order_relaxed) > 0)
+    {
+        const auto s = stats();
+        util::Log(color::aqua, "io_uring: {} reads, {} bytes, {} stalls, max {} in flight, latency avg {}us max {}us\n",
+                  s.reads, s.bytes, s.stalls, s.max_in_flight, s.latency_avg_us, s.latency_max_us);
+    }
+
+    if (m_avio)
+    {
+        av_freep(&m_avio->buffer);
+        avio_context_free(&m_avio);
+    }
+
+    if (m_sqes)
+        munmap(m_sqes, m_sqes_len);
+    if (m_cq_ptr and m_cq_ptr != m_sq_ptr)
+        munmap(m_cq_ptr, m_cq_len);
+    if (m_sq_ptr)
+        munmap(m_sq_ptr, m_sq_len);
+    if (m_ring_fd >= 0)
+        close(m_ring_fd);
+
+    close(m_fd);
+}
+
+void UringIO::setup_ring(unsigned entries)
+{
+    io_uring_params params{};
+    m_ring_fd = uring_setup(entries, &params);
+    if (m_ring_fd < 0)
+    {
+        throw std::runtime_error(std::format("io_uring_setup: {}", std::strerror(errno)));
+    }
+
+    m_sq_len = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+    m_cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+    const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        m_sq_len = m_cq_len = std::max(m_sq_len, m_cq_len);
+
+    auto map = [this](std::size_t length, off_t offset) -> void*
+    {
+        void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, offset);
+        if (ptr == MAP_FAILED)
+        {
+            throw std::runtime_error(std::format("io_uring mmap: {}", std::strerror(errno)));
+        }
+
+        return ptr;
+    };
+
+    m_sq_ptr = map(m_sq_len, IORING_OFF_SQ_RING);
+    m_cq_ptr = single_mmap ? m_sq_ptr : map(m_cq_len, IORING_OFF_CQ_RING);
+
+    m_sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes     = static_cast<io_uring_sqe*>(map(m_sqes_len, IORING_OFF_SQES));
+
+    m_sq_head  = At<std::uint32_t>(m_sq_ptr, params.sq_off.head);
+    m_sq_tail  = At<std::uint32_t>(m_sq_ptr, params.sq_off.tail);
+    m_sq_mask  = At<std::uint32_t>(m_sq_ptr, params.sq_off.ring_mask);
+    m_sq_array = At<std::uint32_t>(m_sq_ptr, params.sq_off.array);
+    m_cq_head  = At<std::uint32_t>(m_cq_ptr, params.cq_off.head);
+    m_cq_tail  = At<std::uint32_t>(m_cq_ptr, params.cq_off.tail);
+    m_cq_mask  = At<std::uint32_t>(m_cq_ptr, params.cq_off.ring_mask);
+    m_cqes     = At<io_uring_cqe>(m_cq_ptr, params.cq_off.cqes);
+}
+
+void UringIO::submit(std::size_t slot, std::int64_t index, std::size_t from) noexcept
+{
+    auto& block = m_blocks[slot];
+    const auto offset = static_cast<std::size_t>(index) * m_block_size + from;
+
+    block.index        = index;
+    block.length       = from;
+    block.error        = 0;
+    block.ended        = false;
+    block.state        = Block::State::IN_FLIGHT;
+    block.submitted_ns = NowNs();
+
+    // Only we ever move the tail
+    const auto tail = *m_sq_tail;
+    const auto at   = tail & *m_sq_mask;
+
+    auto& sqe = m_sqes[at];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode    = IORING_OP_READ;
+    sqe.fd        = m_fd;
+    sqe.addr      = reinterpret_cast<std::uint64_t>(block.data.get() + from);
+    sqe.len       = static_cast<std::uint32_t>(std::min(m_block_size - from, m_size - offset));
+    sqe.off       = offset;
+    sqe.user_data = slot;
+
+    m_sq_array[at] = at;
+    StoreRelease(m_sq_tail, tail + 1);
+
+    const auto in_flight = m_in_flight.fetch_add(1, std::memory_order_relaxed) + 1;
+    StoreMax(m_max_in_flight, in_flight);
+    m_reads.fetch_add(1, std::memory_order_relaxed);
+
+    // Should the kernel refuse it right now, the entry stays queued and goes with the next enter
+    uring_enter(m_ring_fd, 1, 0, 0);
+}
+
+void UringIO::reap(bool wait) noexcept
+{
+    auto head = *m_cq_head;
+    if (wait and head == LoadAcquire(m_cq_tail))
+    {
+        // Also submits whatever an earlier enter left behind
+        uring_enter(m_ring_fd, *m_sq_tail - LoadAcquire(m_sq_head), 1, IORING_ENTER_GETEVENTS);
+    }
+
+    const auto tail = LoadAcquire(m_cq_tail);
+    for (; head != tail; head++)
+    {
+        const auto& cqe = m_cqes[head & *m_cq_mask];
+        auto& block     = m_blocks[static_cast<std::size_t>(cqe.user_data)];
+
+        block.state = Block::State::READY;
+        if (cqe.res < 0)
+        {
+            block.error = cqe.res;
+        }
+        else
+        {
+            block.length += static_cast<std::size_t>(cqe.res);
+            block.ended   = cqe.res == 0;
+            m_bytes.fetch_add(static_cast<std::size_t>(cqe.res), std::memory_order_relaxed);
+        }
+
+        const auto latency = NowNs() - block.submitted_ns;
+        m_latency_total_ns.fetch_add(latency, std::memory_order_relaxed);
+        StoreMax(m_latency_max_ns, latency);
+        m_in_flight.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    StoreRelease(m_cq_head, head);
+}
+
+UringIO::Block* UringIO::block_at(std::int64_t index) noexcept
+{
+    for (auto& block : m_blocks)
+    {
+        if (block.index == index and block.state != Block::State::EMPTY)
+            return &block;
+    }
+
+    return nullptr;
+}
+
+void UringIO::read_ahead() noexcept
+{
+    reap(false);
+
+    const auto first = static_cast<std::int64_t>(m_pos / m_block_size);
+    const auto last  = std::min(first + static_cast<std::int64_t>(m_blocks.size()) - 1,
+                                static_cast<std::int64_t>((m_size - 1) / m_block_size));
+
+    for (auto index = first; index <= last; index++)
+    {
+        if (block_at(index))
+            continue;
+
+        // A block that's done and not needed anymore, behind us or left over from before a seek
+        const auto free = std::ranges::find_if(m_blocks, [&](const Block& block)
+        {
+            return block.state == Block::State::EMPTY or
+                   (block.state == Block::State::READY and (block.index < first or block.index > last));
+        });
+
+        if (free == m_blocks.end())
+            break;
+
+        submit(static_cast<std::size_t>(free - m_blocks.begin()), index);
+    }
+}
+
+int UringIO::read_packet(void* opaque, std::uint8_t* buf, int buf_size) noexcept
+{
+    auto* self = static_cast<UringIO*>(opaque);
+    if (self->m_pos >= self->m_size)
+        return AVERROR_EOF;
+
+    const auto index = static_cast<std::int64_t>(self->m_pos / self->m_block_size);
+    const auto start = static_cast<std::size_t>(index) * self->m_block_size;
+
+    while (true)
+    {
+        auto* block = self->block_at(index);
+        if (not block or block->state == Block::State::IN_FLIGHT)
+        {
+            // Caught up with the storage, or all slots are still busy with reads from before a seek
+            self->m_stalls.fetch_add(1, std::memory_order_relaxed);
+
+            if (not block)
+                self->read_ahead();
+            if (not self->block_at(index))
+                self->reap(true);
+
+            while ((block = self->block_at(index)) and block->state == Block::State::IN_FLIGHT)
+                self->reap(true);
+
+            if (not block)
+                continue;
+        }
+
+        if (block->error < 0)
+        {
+            const auto error = block->error;
+            block->state = Block::State::EMPTY;
+            block->index = -1;
+            return error;
+        }
+
+        // Short read, only the rest of the block is asked for. The file may
+        // have shrunk since it was opened, then nothing more comes back.
+        if (self->m_pos - start >= block->length)
+        {
+            if (block->ended)
+            {
+                block->state = Block::State::EMPTY;
+                block->index = -1;
+                return AVERROR_EOF;
+            }
+
+            self->submit(static_cast<std::size_t>(block - self->m_blocks.data()), index, block->length);
+            continue;
+        }
+
+        const auto n = std::min(static_cast<std::size_t>(std::max(buf_size, 0)), block->length - (self->m_pos - start));
+        std::memcpy(buf, block->data.get() + (self->m_pos - start), n);
+        self->m_pos += n;
+
+        self->read_ahead();
+        return static_cast<int>(n);
+    }
+}
+
+std::int64_t UringIO::seek(void* opaque, std::int64_t offset, int whence) noexcept
+{
+    auto* self = static_cast<UringIO*>(opaque);
+
+    std::int64_t pos{};
+    switch (whence & ~AVSEEK_FORCE)
+    {
+    case AVSEEK_SIZE:
+        return static_cast<std::int64_t>(self->m_size);
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = static_cast<std::int64_t>(self->m_pos) + offset;
+        break;
+    case SEEK_END:
+        pos = static_cast<std::int64_t>(self->m_size) + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+
+    if (pos < 0 or pos > static_cast<std::int64_t>(self->m_size))
+        return AVERROR(EINVAL);
+
+    // Reads for the new position start right away
+    self->m_pos = static_cast<std::size_t>(pos);
+    if (self->m_pos < self->m_size)
+        self->read_ahead();
+
+    return pos;
+}
+
+UringIO::Stats UringIO::stats() const noexcept
+{
+    const auto reads     = m_reads.load(std::memory_order_relaxed);
+    const auto in_flight = m_in_flight.load(std::memory_order_relaxed);
+    const auto completed = reads - in_flight;
+
+    return Stats{ .reads          = reads,
+                  .bytes          = m_bytes.load(std::memory_order_relaxed),
+                  .stalls         = m_stalls.load(std::memory_order_relaxed),
+                  .in_flight      = in_flight,
+                  .max_in_flight  = m_max_in_flight.load(std::memory_order_relaxed),
+                  .latency_avg_us = completed ? m_latency_total_ns.load(std::memory_order_relaxed) / completed / 1000 : 0,
+                  .latency_max_us = m_latency_max_ns.load(std::memory_order_relaxed) / 1000 };
+}
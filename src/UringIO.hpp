@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+extern "C"
+{
+    #include <libavformat/avio.h>
+}
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/*
+ * AVIOContext for libraries on slow or network mounted storage. The file is
+ * read in large blocks through io_uring, several of them are kept in flight
+ * ahead of the demuxer so it rarely has to wait for the storage at all.
+ */
+class UringIO
+{
+public:
+    struct Stats
+    {
+        std::uint64_t reads{};
+        std::uint64_t bytes{};
+        // Reads the demuxer had to wait for, because they weren't done or weren't even issued
+        std::uint64_t stalls{};
+        std::uint32_t in_flight{};
+        std::uint32_t max_in_flight{};
+        std::uint64_t latency_avg_us{};
+        std::uint64_t latency_max_us{};
+    };
+
+    UringIO(const UringIO&)            = delete;
+    UringIO(UringIO&&)                 = delete;
+    UringIO& operator=(const UringIO&) = delete;
+    UringIO& operator=(UringIO&&)      = delete;
+
+    // nullptr for anything but a regular file, or when the kernel has no io_uring for us
+    [[nodiscard]] static std::shared_ptr<UringIO> Open(const std::filesystem::path& path, int depth, std::size_t block_size) noexcept;
+
+    ~UringIO();
+
+    // Has to outlive the AVFormatContext it is handed to
+    [[nodiscard]] AVIOContext* get() const noexcept
+    { return m_avio; }
+
+    // Any thread
+    [[nodiscard]] Stats stats() const noexcept;
+
+private:
+    struct Block
+    {
+        enum class State
+        {
+            EMPTY,
+            IN_FLIGHT,
+            READY,
+        };
+
+        std::unique_ptr<std::uint8_t[]> data;
+        std::int64_t index{ -1 };
+        std::size_t length{};
+        int error{};
+        // The last read of it came back empty, the file ends before the block does
+        bool ended{};
+        State state{ State::EMPTY };
+        std::uint64_t submitted_ns{};
+    };
+
+    UringIO(int fd, std::size_t size, int depth, std::size_t block_size);
+
+    // Throws, the destructor copes with whatever was set up until then
+    void init();
+    void setup_ring(unsigned entries);
+    // Reads the block at index into slot, from the given byte of it on
+    void submit(std::size_t slot, std::int64_t index, std::size_t from = 0) noexcept;
+    void reap(bool wait) noexcept;
+
+    // Issues reads for the blocks ahead of m_pos that aren't cached or queued yet
+    void read_ahead() noexcept;
+    Block* block_at(std::int64_t index) noexcept;
+
+    static int read_packet(void* opaque, std::uint8_t* buf, int buf_size) noexcept;
+    static std::int64_t seek(void* opaque, std::int64_t offset, int whence) noexcept;
+
+    int m_fd;
+    std::size_t m_size;
+    std::size_t m_block_size;
+    std::size_t m_pos{};
+    std::vector<Block> m_blocks;
+
+    int m_ring_fd{ -1 };
+    void* m_sq_ptr{};
+    std::size_t m_sq_len{};
+    void* m_cq_ptr{};
+    std::size_t m_cq_len{};
+    io_uring_sqe* m_sqes{};
+    std::size_t m_sqes_len{};
+
+    std::uint32_t* m_sq_head{};
+    std::uint32_t* m_sq_tail{};
+    std::uint32_t* m_sq_mask{};
+    std::uint32_t* m_sq_array{};
+    std::uint32_t* m_cq_head{};
+    std::uint32_t* m_cq_tail{};
+    std::uint32_t* m_cq_mask{};
+    io_uring_cqe* m_cqes{};
+
+    AVIOContext* m_avio{};
+
+    std::atomic<std::uint64_t> m_reads{};
+    std::atomic<std::uint64_t> m_bytes{};
+    std::atomic<std::uint64_t> m_stalls{};
+    std::atomic<std::uint32_t> m_in_flight{};
+    std::atomic<std::uint32_t> m_max_in_flight{};
+    std::atomic<std::uint64_t> m_latency_total_ns{};
+    std::atomic<std::uint64_t> m_latency_max_ns{};
+};
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include <pthread.h>
+
+/*
+ * A named thread that outlives the jobs it runs, one at a time. Whatever
+ * was done to the thread itself, its priority or the CPUs it is pinned to,
+ * carries over from one job to the next.
+ */
+class Worker
+{
+public:
+    explicit Worker(const char* name)
+        : m_thread{ [this](std::stop_token st) { run(st); } }
+    {
+        pthread_setname_np(m_thread.native_handle(), name);
+    }
+
+    ~Worker()
+    {
+        Stop();
+    }
+
+    Worker(const Worker&)            = delete;
+    Worker(Worker&&)                 = delete;
+    Worker& operator=(const Worker&) = delete;
+    Worker& operator=(Worker&&)      = delete;
+
+    // Hands job to the thread, the one before has to be stopped first.
+    // job gets a token of its own that Stop() requests.
+    void Run(std::function<void(std::stop_token)> job)
+    {
+        {
+            std::scoped_lock lk{ m_mtx };
+            m_job  = std::move(job);
+            m_stop = std::stop_source{};
+            m_busy = true;
+        }
+
+        m_cv.notify_all();
+    }
+
+    // Asks the job to return and waits until it did, the thread stays
+    void Stop() noexcept
+    {
+        std::unique_lock lk{ m_mtx };
+        m_stop.request_stop();
+        m_cv.wait(lk, [this] { return not m_busy; });
+    }
+
+    [[nodiscard]] pthread_t native_handle() noexcept
+    { return m_thread.native_handle(); }
+
+private:
+    void run(std::stop_token st)
+    {
+        while (true)
+        {
+            std::function<void(std::stop_token)> job;
+            std::stop_token token;
+
+            {
+                std::unique_lock lk{ m_mtx };
+                if (not m_cv.wait(lk, st, [this] { return static_cast<bool>(m_job); }))
+                    return;
+
+                job   = std::exchange(m_job, nullptr);
+                token = m_stop.get_token();
+            }
+
+            job(token);
+
+            // Whatever it captured goes before Stop() returns
+            job = nullptr;
+
+            {
+                std::scoped_lock lk{ m_mtx };
+                m_busy = false;
+            }
+
+            m_cv.notify_all();
+        }
+    }
+
+    std::mutex m_mtx{};
+    std::condition_variable_any m_cv{};
+    std::function<void(std::stop_token)> m_job{};
+    std::stop_source m_stop{};
+    bool m_busy{};
+
+    // Declared last, it starts running as soon as it is constructed
+    std::jthread m_thread;
+};
@@ -22,8 +22,11 @@
 #include "util.hpp"
 
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <new>
+#include <type_traits>
+#include <vector>
 
 #include <ncpp/NotCurses.hh>
 
@@ -62,14 +65,111 @@ namespace Wrap
         return packet;
     }
 
-    inline constexpr auto deleter = [](auto* ptr) { operator delete[](ptr, std::align_val_t(16)); };
+    // Hands out AVPackets and AVFrames and takes them back unreferenced,
+    // decoders that come and go reuse them instead of allocating new ones.
+    template <typename T>
+    class Pool
+    {
+    public:
+        struct Recycler
+        {
+            Pool* pool{};
+            void operator()(T* item) const noexcept { pool->release(item); }
+        };
+
+        using Handle = std::unique_ptr<T, Recycler>;
+
+        Pool(const Pool&)            = delete;
+        Pool(Pool&&)                 = delete;
+        Pool& operator=(const Pool&) = delete;
+        Pool& operator=(Pool&&)      = delete;
+
+        explicit Pool(std::size_t preallocated)
+            : m_total{ preallocated }
+        {
+            m_free.reserve(m_total);
+            for (std::size_t i = 0; i < preallocated; i++)
+            {
+                m_free.push_back(allocate());
+            }
+        }
+
+        [[nodiscard]] Handle acquire()
+        {
+            std::scoped_lock lk{ m_mtx };
+
+            if (m_free.empty())
+            {
+                // Keep room for every item we own, so release() never allocates
+                m_free.reserve(++m_total);
+                return Handle{ allocate().release(), Recycler{ this } };
+            }
+
+            auto item = std::move(m_free.back());
+            m_free.pop_back();
+            return Handle{ item.release(), Recycler{ this } };
+        }
+
+        [[nodiscard]] std::size_t available() const
+        {
+            std::scoped_lock lk{ m_mtx };
+            return m_free.size();
+        }
+
+    private:
+        static UniquePtr<T> allocate()
+        {
+            UniquePtr<T> item{};
+            if constexpr (std::is_same_v<T, AVPacket>)
+                item.reset(av_packet_alloc());
+            else
+                item.reset(av_frame_alloc());
+
+            if (!item)
+            {
+                throw std::runtime_error("Failed to allocate a pooled packet or frame");
+            }
+
+            return item;
+        }
+
+        void release(T* item) noexcept
+        {
+            if constexpr (std::is_same_v<T, AVPacket>)
+                av_packet_unref(item);
+            else
+                av_frame_unref(item);
+
+            std::scoped_lock lk{ m_mtx };
+            m_free.emplace_back(item);
+        }
+
+        mutable std::mutex m_mtx{};
+        std::size_t m_total{};
+        std::vector<UniquePtr<T>> m_free{};
+    };
+
+    // Shared by every decoder of one playback engine
+    struct AvPools
+    {
+        Pool<AVPacket> packets{ 4 };
+        Pool<AVFrame>  frames{ 4 };
+    };
+
+    // Wide enough for AVX-512 loads and stores
+    inline constexpr std::size_t buffer_alignment{ 64 };
+
+    inline constexpr auto deleter = [](auto* ptr) { operator delete[](ptr, std::align_val_t(buffer_alignment)); };
     using align_buf_t = std::unique_ptr<std::uint8_t, decltype(deleter)>;
 
-    inline auto make_aligned_buffer()
+    // The size is rounded up to whole cache lines
+    inline auto make_aligned_buffer(std::size_t size)
     {
+        const auto rounded = (size + buffer_alignment - 1) / buffer_alignment * buffer_alignment;
+
         return align_buf_t
         {
-            std::bit_cast<std::uint8_t*>(operator new[](32'000 + 16, std::align_val_t(16)))
+            std::bit_cast<std::uint8_t*>(operator new[](rounded, std::align_val_t(buffer_alignment)))
         };
     }
 
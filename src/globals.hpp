@@ -34,5 +34,5 @@ namespace Globals
     inline std::atomic_bool stop_request{};
     inline Completion lastCompletion{};
     inline float m_audioVolume{ 0.3f };
-    inline Event event;
+    inline ControlQueue controls;
 }
@@ -18,14 +18,107 @@
  */
 
 #include "AudioLoop.hpp"
+#include "Realtime.hpp"
 #include "tMus.hpp"
 #include "util.hpp"
 
+#include <cerrno>
 #include <cstdlib>
 #include <exception>
+#include <new>
 
 #include <stdexcept>
 
+#include <dlfcn.h>
+#include <pthread.h>
+
+#ifdef DEBUG
+// glibc's own entry points, the allocator below forwards to them
+extern "C"
+{
+    void* __libc_malloc(std::size_t size);
+    void* __libc_calloc(std::size_t count, std::size_t size);
+    void* __libc_realloc(void* ptr, std::size_t size);
+    void* __libc_memalign(std::size_t alignment, std::size_t size);
+    void  __libc_free(void* ptr);
+}
+
+// Catches whatever allocates or takes a mutex inside a realtime section, see
+// rt::Section. Replacing the C allocator covers operator new and everything
+// FFmpeg and PipeWire allocate too. Plain file I/O is not caught, only our
+// own logging checks for it. Only the executable replaces these, the tests
+// bring their own.
+extern "C"
+{
+    void* malloc(std::size_t size) noexcept
+    {
+        if (rt::InSection())
+            rt::Violation("malloc");
+
+        return __libc_malloc(size);
+    }
+
+    void* calloc(std::size_t count, std::size_t size) noexcept
+    {
+        if (rt::InSection())
+            rt::Violation("calloc");
+
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, std::size_t size) noexcept
+    {
+        if (rt::InSection())
+            rt::Violation("realloc");
+
+        return __libc_realloc(ptr, size);
+    }
+
+    void* memalign(std::size_t alignment, std::size_t size) noexcept
+    {
+        if (rt::InSection())
+            rt::Violation("memalign");
+
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+    {
+        if (rt::InSection())
+            rt::Violation("aligned_alloc");
+
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** ptr, std::size_t alignment, std::size_t size) noexcept
+    {
+        if (rt::InSection())
+            rt::Violation("posix_memalign");
+
+        *ptr = __libc_memalign(alignment, size);
+        return *ptr or size == 0 ? 0 : ENOMEM;
+    }
+
+    void free(void* ptr) noexcept
+    {
+        if (ptr and rt::InSection())
+            rt::Violation("free");
+
+        __libc_free(ptr);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        if (rt::InSection())
+            rt::Violation("pthread_mutex_lock");
+
+        // Looked up on the first lock, long before any realtime section
+        static const auto next = reinterpret_cast<int (*)(pthread_mutex_t*)>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+        return next(mutex);
+    }
+}
+#endif
+
 int main() try
 {
     notcurses_options opts{ .termtype = nullptr,
@@ -55,10 +148,9 @@ int main() try
 
     tmus->loop();
 
-    if (playbackThread.joinable())
-    {
-        playbackThread.join();
-    }
+    // Takes the playback engine down with it, its control loop may be
+    // blocked waiting for an event
+    tmus.reset();
 
     util::Log(color::green, "Program exiting\n");
     return EXIT_SUCCESS;
@@ -26,10 +26,13 @@
 #include "Factories.hpp"
 
 #include <algorithm>
+#include <ranges>
+#include <utility>
+#include <vector>
 #include <ncpp/NotCurses.hh>
 #include <fcntl.h>
 
-static void SetupCallbacks(ListView& albumViewRef, ListView& songViewRef, CommandView& cmdView)
+static void SetupCallbacks(ListView& albumViewRef, ListView& songViewRef, PlaybackEngine& engine)
 {
     albumViewRef.setSelectCallback([&songViewRef](const std::filesystem::path& path)
     {
@@ -59,38 +62,20 @@ static void SetupCallbacks(ListView& albumViewRef, ListView& songViewRef, Comman
     songViewRef.setEnterCallback([&](const std::filesystem::path& path)
     {
         util::Log(color::moccasin, "song callback\n");
-        auto starter = [&cmdView, audio_path = path](std::stop_token tkn)
+
+        // Everything after the selected song is queued for gapless playback
+        std::vector<std::filesystem::path> upcoming;
+        const auto& items = songViewRef.getItems();
+        if (auto it = std::ranges::find(items, path, &ListView::ItemType::second); it != items.end())
         {
-            try
-            {
-                AudioLoop loop{ audio_path };
-                loop.consumer_loop(tkn);
-            }
-            catch (const std::runtime_error& e)
-            {
-                cmdView.ReportError(e.what());
-                util::Log(color::red, "Runtime error: {}", e.what());
-            }
-            catch (const std::exception& e)
-            {
-                cmdView.ReportError(e.what());
-                util::Log(color::red, "Exception: ", e.what());
-            }
-            catch (...)
+            for (const auto& item : std::ranges::subrange(std::next(it), items.end()))
             {
-                cmdView.ReportError("Unhandled exception");
-                util::Log(color::red, "Unhandled exception caught\n");
+                upcoming.push_back(item.second);
             }
-        };
-
-        if (playbackThread.joinable())
-        {
-            playbackThread.request_stop();
-            playbackThread.join();
         }
 
-        playbackThread = std::jthread{ starter };
-        pthread_setname_np(playbackThread.native_handle(), "Consumer loop");
+        // Returns right away, the engine winds the old track down on its own
+        engine.Load(path, std::move(upcoming));
 
         return true;
     });
@@ -103,7 +88,7 @@ tMus::tMus(const std::shared_ptr<FocusManager>& manager)
     const auto albumView = std::make_shared<ListView>(std::move(albumPlane), manager->m_CurrentFocus);
     const auto songView  = std::make_shared<ListView>(std::move(songPlane), manager->m_LastFocus);
 
-    auto cmdProcessor = MakeCommandProcessor(albumView, songView);
+    auto cmdProcessor = MakeCommandProcessor(albumView, songView, m_engine);
 
     cfg = std::make_shared<Config>( util::GetUserConfigDir() / "tMus.ini", cmdProcessor );
 
@@ -127,9 +112,24 @@ tMus::tMus(const std::shared_ptr<FocusManager>& manager)
         std::get<std::shared_ptr<ListView>>(songViewRef)->ColorSelected();
     });
 
+    const auto bufferSettings = cfg->GetBufferSettings();
+    m_engine->Configure(bufferSettings);
+
+    // The views go after the engine, its control loop is done with them by then
+    m_engine->SetErrorHandler([&cmdViewRef = *cmdView](std::string_view error)
+    {
+        cmdViewRef.ReportError(error);
+    });
+
     SetupCallbacks(*std::get<std::shared_ptr<ListView>>(albumViewRef),
                    *std::get<std::shared_ptr<ListView>>(songViewRef),
-                   *std::get<std::shared_ptr<CommandView>>(cmdViewRef));
+                   *m_engine);
+
+    // tMus::loop() runs on this thread
+    if (bufferSettings.affinity.ui.any() and not rt::Pin(pthread_self(), bufferSettings.affinity.ui))
+    {
+        util::Log(color::yellow, "Affinity: the UI could not be pinned to {}\n", rt::FormatCpuList(bufferSettings.affinity.ui));
+    }
 }
 
 void tMus::loop()
@@ -24,6 +24,7 @@
 
 #include "CommandView.hpp"
 #include "Config.hpp"
+#include "PlaybackEngine.hpp"
 
 class tMus
 {
@@ -44,4 +45,5 @@ public:
 private:
     std::array<ViewLike, 3> m_views;
     std::shared_ptr<Config> cfg;
+    std::shared_ptr<PlaybackEngine> m_engine{ std::make_shared<PlaybackEngine>() };
 };
@@ -18,7 +18,9 @@
  */
 
 #include "util.hpp"
+#include <cstdlib>
 #include <expected>
+#include <string>
 
 namespace fs = std::filesystem;
 
@@ -69,3 +71,81 @@ fs::path util::GetUserConfigDir()
         return ConfigPath;
     }
 }
+
+fs::path util::GetUserCacheDir()
+{
+    fs::path CachePath;
+    if (auto XDG_CACHE_DIR = GetEnv("XDG_CACHE_HOME"); XDG_CACHE_DIR.has_value())
+    {
+        CachePath = fs::path(XDG_CACHE_DIR.value()) / "tMus";
+    }
+    else if (auto HOME = GetEnv("HOME"); HOME.has_value())
+    {
+        CachePath = fs::path(HOME.value()) / ".cache" / "tMus";
+    }
+    else
+    {
+        throw std::runtime_error("Failed to get user's $HOME variable");
+    }
+
+    std::error_code ec;
+    if (not fs::exists(CachePath) and not fs::create_directories(CachePath, ec))
+    {
+        throw std::runtime_error(std::format("Failed to create user cache directory: {}, {}",
+                                             CachePath.string(), ec.message()));
+    }
+
+    return CachePath;
+}
+
+std::uint64_t util::Wakeups() noexcept
+{
+    std::uint64_t total{ 0 };
+
+    std::error_code ec;
+    for (const auto& task : fs::directory_iterator("/proc/self/task", ec))
+    {
+        std::ifstream status{ task.path() / "status" };
+        for (std::string line; std::getline(status, line); )
+        {
+            constexpr std::string_view key{ "voluntary_ctxt_switches:" };
+            if (line.starts_with(key))
+            {
+                total += std::strtoull(line.c_str() + key.size(), nullptr, 10);
+                break;
+            }
+        }
+    }
+
+    return total;
+}
+
+std::vector<util::ThreadAffinity> util::ThreadAffinities()
+{
+    std::vector<ThreadAffinity> threads;
+
+    std::error_code ec;
+    for (const auto& task : fs::directory_iterator("/proc/self/task", ec))
+    {
+        ThreadAffinity thread{};
+
+        std::ifstream comm{ task.path() / "comm" };
+        std::getline(comm, thread.name);
+
+        std::ifstream status{ task.path() / "status" };
+        for (std::string line; std::getline(status, line); )
+        {
+            constexpr std::string_view key{ "Cpus_allowed_list:" };
+            if (line.starts_with(key))
+            {
+                const auto from = line.find_first_not_of(" \t", key.size());
+                thread.cpus = from == std::string::npos ? "" : line.substr(from);
+                break;
+            }
+        }
+
+        threads.push_back(std::move(thread));
+    }
+
+    return threads;
+}
@@ -20,10 +20,15 @@
 #pragma once
 
 #include "Colors.hpp"
+#include "Realtime.hpp"
+#include <cstdint>
 #include <cstdio>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
 #include <print>
+#include <string>
+#include <vector>
 
 #include <chrono>
 #include <source_location>
@@ -34,13 +39,17 @@ namespace util
     {
         inline constexpr bool OutputFile { true };
         inline std::ofstream logFileStream{};
-        inline std::string message_buf{};
+        inline std::mutex logFileMutex{};
+
+        // Every thread formats on its own, only the write is serialized
+        inline thread_local std::string message_buf{};
     }
 
     inline void Printer()
     {
         if constexpr (internal::OutputFile)
         {
+            std::scoped_lock lk{ internal::logFileMutex };
             internal::logFileStream << internal::message_buf;
             internal::logFileStream.flush();
         }
@@ -53,6 +62,11 @@ namespace util
 
         Log(color c, std::format_string<Args...>&& fmt, Args&&... args, std::source_location location = std::source_location::current()) noexcept
         {
+#ifdef DEBUG
+            if (rt::InSection())
+                rt::Violation("util::Log");
+#endif
+
             internal::message_buf.clear();
             const auto micros = std::chrono::time_point(std::chrono::high_resolution_clock::now());
             const std::string_view floc{ location.file_name() };
@@ -122,4 +136,29 @@ namespace util
     Log(std::format_string<Args...>, Args&&...) -> Log<Args...>;
 
     std::filesystem::path GetUserConfigDir();
+
+    // $XDG_CACHE_HOME/tMus or ~/.cache/tMus, created when missing
+    std::filesystem::path GetUserCacheDir();
+
+    // How often the threads of this process were put to sleep and woken up
+    // again so far, summed over all of them. Sampled twice it tells how many
+    // wakeups happened in between, which is what shows up in powertop.
+    std::uint64_t Wakeups() noexcept;
+
+    struct ThreadAffinity
+    {
+        std::string name;
+        std::string cpus;
+    };
+
+    // Every thread of this process by name with the CPUs it may run on, as
+    // the kernel reports them, so pins done by PipeWire itself show up too
+    std::vector<ThreadAffinity> ThreadAffinities();
+
+    // Steady clock in nanoseconds, for timestamps that are shared between threads
+    inline std::int64_t NowNs() noexcept
+    {
+        const auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    }
 }
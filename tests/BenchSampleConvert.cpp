@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "SampleConvert.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include <x86intrin.h>
+
+extern "C"
+{
+    #include <libavutil/channel_layout.h>
+    #include <libswresample/swresample.h>
+}
+
+using namespace boost::ut;
+
+// Cycles per output sample of the kernels against swr_convert, for the
+// conversions the decoders hit the most. Every run converts one typical
+// decoded frame, the fastest of all repetitions is reported.
+
+constexpr int Channels{ 2 };
+constexpr int Samples{ 4096 };
+constexpr int Repetitions{ 500 };
+
+template <typename F>
+static double CyclesPerSample(F&& convert)
+{
+    auto best = std::numeric_limits<unsigned long long>::max();
+
+    for (int i = 0; i < Repetitions; i++)
+    {
+        const auto start = __rdtsc();
+        convert();
+        best = std::min(best, __rdtsc() - start);
+    }
+
+    return static_cast<double>(best) / (Samples * Channels);
+}
+
+int main()
+{
+    struct Case
+    {
+        AVSampleFormat in;
+        AVSampleFormat out;
+    };
+
+    constexpr std::array cases
+    {
+        Case{ AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_FLT },
+        Case{ AV_SAMPLE_FMT_S16P, AV_SAMPLE_FMT_S16 },
+        Case{ AV_SAMPLE_FMT_S32P, AV_SAMPLE_FMT_S32 },
+        Case{ AV_SAMPLE_FMT_DBLP, AV_SAMPLE_FMT_DBL },
+        Case{ AV_SAMPLE_FMT_DBL,  AV_SAMPLE_FMT_FLT },
+        Case{ AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S16 },
+        Case{ AV_SAMPLE_FMT_S16,  AV_SAMPLE_FMT_FLT },
+    };
+
+    "Benchmark"_test = [&]
+    {
+        AVChannelLayout layout{};
+        av_channel_layout_default(&layout, Channels);
+
+        std::cout << std::format("{:<12} {:>10}", "conversion", "swr");
+        for (auto isa : { Convert::Isa::Scalar, Convert::Isa::SSE2, Convert::Isa::AVX2, Convert::Isa::AVX512 })
+        {
+            if (isa <= Convert::Detect())
+                std::cout << std::format(" {:>10}", Convert::ToString(isa));
+        }
+        std::cout << "  (cycles/sample)\n";
+
+        for (const auto& [in, out] : cases)
+        {
+            const auto planar = av_sample_fmt_is_planar(in);
+            const auto planes = planar ? Channels : 1;
+            const auto in_len = static_cast<std::size_t>(Samples * av_get_bytes_per_sample(in) * (planar ? 1 : Channels));
+
+            // Quiet noise, valid for float and integer formats alike
+            std::vector<std::vector<std::uint8_t>> input(static_cast<std::size_t>(planes), std::vector<std::uint8_t>(in_len));
+            for (auto& plane : input)
+            {
+                for (std::size_t i = 0; i < plane.size(); i++)
+                    plane[i] = static_cast<std::uint8_t>((i * 2654435761u) >> 24) & 0x1F;
+            }
+
+            std::vector<const std::uint8_t*> in_planes;
+            for (const auto& plane : input)
+                in_planes.push_back(plane.data());
+
+            const auto out_len = static_cast<std::size_t>(Samples * Channels * av_get_bytes_per_sample(out));
+            std::vector<std::uint8_t> swr_out(out_len);
+            std::vector<std::uint8_t> kernel_out(out_len);
+
+            SwrContext* swr{};
+            expect (swr_alloc_set_opts2(&swr, &layout, out, 48'000, &layout, in, 48'000, 0, nullptr) == 0);
+            expect (swr_init(swr) >= 0);
+
+            auto* swr_ptr = swr_out.data();
+            const auto swr_cycles = CyclesPerSample([&]
+            {
+                swr_convert(swr, &swr_ptr, Samples, in_planes.data(), Samples);
+            });
+
+            std::cout << std::format("{:<12} {:>10.3f}", std::format("{}->{}", av_get_sample_fmt_name(in), av_get_sample_fmt_name(out)), swr_cycles);
+
+            for (auto isa : { Convert::Isa::Scalar, Convert::Isa::SSE2, Convert::Isa::AVX2, Convert::Isa::AVX512 })
+            {
+                if (isa > Convert::Detect())
+                    continue;
+
+                Convert::Converter converter{ in, out, Channels, isa };
+                const auto cycles = CyclesPerSample([&]
+                {
+                    converter(kernel_out.data(), in_planes.data(), Samples);
+                });
+
+                std::cout << std::format(" {:>10.3f}", cycles);
+
+                // Pure interleaving has to be bit exact, conversions round
+                // differently from swr and are checked in TestSampleConvert.
+                if (av_get_packed_sample_fmt(in) == out)
+                    expect (kernel_out == swr_out) << Convert::ToString(isa);
+            }
+
+            std::cout << '\n';
+            swr_free(&swr);
+        }
+
+        av_channel_layout_uninit(&layout);
+    };
+}
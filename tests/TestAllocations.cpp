@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "Decoder.hpp"
+#include "Pipewire.hpp"
+#include "PlaybackClock.hpp"
+#include "Realtime.hpp"
+#include "RingBuffer.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <vector>
+
+#include <dlfcn.h>
+#include <pthread.h>
+
+using namespace boost::ut;
+
+// glibc's own entry points, the allocator below forwards to them
+extern "C"
+{
+    void* __libc_malloc(std::size_t size);
+    void* __libc_calloc(std::size_t count, std::size_t size);
+    void* __libc_realloc(void* ptr, std::size_t size);
+    void* __libc_memalign(std::size_t alignment, std::size_t size);
+    void  __libc_free(void* ptr);
+}
+
+// The executable replaces the C allocator, so operator new and everything
+// FFmpeg allocates through av_malloc passes through here. While counting is
+// switched on every allocation is counted, the ones the size of an AVPacket
+// or an AVFrame also apart from the rest: the pools are there so decoding
+// never makes new ones. Inside a realtime section every call into the
+// allocator is counted, frees included, whether counting is on or not, and
+// so is every mutex that is taken.
+static std::atomic<bool> counting{ false };
+static std::atomic<std::size_t> allocations{ 0 };
+static std::atomic<std::size_t> allocated_bytes{ 0 };
+static std::atomic<std::size_t> pooled_allocations{ 0 };
+static std::atomic<std::size_t> section_allocations{ 0 };
+static std::atomic<std::size_t> section_locks{ 0 };
+
+static void Count(std::size_t size) noexcept
+{
+    if (counting.load(std::memory_order_relaxed))
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+
+        if (size == sizeof(AVPacket) or size == sizeof(AVFrame))
+            pooled_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (rt::InSection())
+        section_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C"
+{
+    void* malloc(std::size_t size) noexcept
+    {
+        Count(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(std::size_t count, std::size_t size) noexcept
+    {
+        Count(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, std::size_t size) noexcept
+    {
+        Count(size);
+        return __libc_realloc(ptr, size);
+    }
+
+    void* memalign(std::size_t alignment, std::size_t size) noexcept
+    {
+        Count(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+    {
+        Count(size);
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** ptr, std::size_t alignment, std::size_t size) noexcept
+    {
+        Count(size);
+        *ptr = __libc_memalign(alignment, size);
+        return *ptr or size == 0 ? 0 : ENOMEM;
+    }
+
+    void free(void* ptr) noexcept
+    {
+        if (ptr and rt::InSection())
+            section_allocations.fetch_add(1, std::memory_order_relaxed);
+
+        __libc_free(ptr);
+    }
+
+    int pthread_mutex_lock(pthread_mutex_t* mutex) noexcept
+    {
+        if (rt::InSection())
+            section_locks.fetch_add(1, std::memory_order_relaxed);
+
+        static const auto next = reinterpret_cast<int (*)(pthread_mutex_t*)>(dlsym(RTLD_NEXT, "pthread_mutex_lock"));
+        return next(mutex);
+    }
+}
+
+int main()
+{
+    const auto file = std::filesystem::path("tests/misc/output.wav");
+
+    // The producer decoding into the ring and the realtime thread pulling
+    // quantum sized chunks back out, the way they run during playback.
+    "SteadyStateDecode"_test = [&]
+    {
+        Wrap::AvPools pools;
+        Decoder decoder{ file, pools };
+
+        const auto settings = decoder.getAudioSettings();
+        const auto quantum  = static_cast<std::size_t>(QuantumFrames(*settings) * settings->ch_layout.nb_channels *
+                                                       av_get_bytes_per_sample(settings->fmt));
+
+        RingBuffer ring{ 1 << 20, 1 << 19, 1 << 18 };
+        std::vector<std::uint8_t> out(quantum);
+        std::size_t decoded{ 0 };
+
+        auto play = [&]
+        {
+            const int length = decoder.Decode();
+            // The test file is short, rewinding is not part of playback
+            if (length < 0)
+            {
+                const bool was_counting = counting.exchange(false);
+                decoder.Seek(0);
+                counting = was_counting;
+                return;
+            }
+
+            ring.write(decoder.buffer(), static_cast<std::size_t>(length));
+            decoded += static_cast<std::size_t>(length);
+
+            while (ring.size() >= quantum)
+                ring.read(out.data(), quantum);
+        };
+
+        // Let the codec and the demuxer settle on their buffers first
+        for (int i = 0; i < 64; i++)
+            play();
+
+        decoded  = 0;
+        counting = true;
+
+        for (int i = 0; i < 4096; i++)
+            play();
+
+        counting = false;
+
+        // The decoder reuses its pooled packet and frame for every call
+        expect (pooled_allocations.load() == 0_ul) << "packets or frames allocated while decoding";
+
+        // What is left are the payloads the demuxer allocates for every packet,
+        // per second of audio rather than of the time the test took
+        const auto seconds = static_cast<double>(decoded) / static_cast<double>(BytesPerSecond(*settings));
+        std::cout << std::format("Demuxer payloads: {:.0f} allocations, {:.0f} KiB per second of audio\n",
+                                 static_cast<double>(allocations.load()) / seconds,
+                                 static_cast<double>(allocated_bytes.load()) / 1024 / seconds);
+    };
+
+    // What the process callback does every quantum, from inside its section
+    "RealtimeSection"_test = []
+    {
+        constexpr std::uint32_t stride{ 8 };
+        constexpr std::uint64_t frames{ 256 };
+
+        RingBuffer ring{ 1 << 16, 1 << 15, 1 << 14 };
+        PlaybackClock clock;
+        std::vector<std::uint8_t> in(stride * frames * 4);
+        std::vector<std::uint8_t> out(stride * frames);
+
+        clock.restart(1, stride, stride * 48'000);
+
+        std::size_t silent{ 0 };
+        for (std::int64_t cycle = 0; cycle < 4096; cycle++)
+        {
+            // The producer side runs on a thread of its own
+            if (ring.below_low_watermark())
+                ring.write(in.data(), in.size());
+
+            // Now and then paused, the clock goes on over silence
+            auto* source = cycle % 64 == 63 ? nullptr : &ring;
+
+            const rt::Section section;
+            if (FillQuantum(source, clock, out.data(), frames, stride, 0, cycle * 5'333'333, frames * 2).got == 0)
+                silent++;
+        }
+
+        expect (silent == 64_ul);
+        expect (section_allocations.load() == 0_ul);
+        expect (section_locks.load() == 0_ul);
+        expect (not rt::InSection());
+    };
+}
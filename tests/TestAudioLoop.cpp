@@ -23,6 +23,12 @@
 #include "ut.hpp"
 #include "tMus.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
 using namespace boost::ut;
 
 int main()
@@ -69,6 +75,70 @@ int main()
         expect (throws<std::runtime_error>(will_throw));
     };
 
+    "Decoder"_test = [&]
+    {
+        Wrap::AvPools pools;
+
+        Decoder primed{ correct, pools };
+        Decoder plain{ correct, pools };
+
+        primed.Prime();
+
+        // Played at the file's own rate and in a format Pipewire takes as is
+        const auto& settings = *plain.getAudioSettings();
+        expect (settings.freq == plain.getContextData().codec_ctx->sample_rate);
+        expect (DoesPipewireSupportFormat(settings.fmt));
+        expect (settings.fmt == NativeOutputFormat(plain.getContextData().codec_ctx->sample_fmt));
+
+        // Every step of opening the file took some time
+        const auto& timings = plain.getOpenTimings();
+        expect (timings.open.count() > 0 and timings.probe.count() > 0 and timings.codec.count() > 0);
+
+        const auto first = plain.Decode();
+        expect (first > 0);
+        expect (primed.Decode() == first);
+
+        // Sized for the codec up front, aligned for the widest vector loads
+        expect (static_cast<std::size_t>(first) <= plain.BufferCapacity());
+        expect (reinterpret_cast<std::uintptr_t>(plain.buffer()) % Wrap::buffer_alignment == 0_ul);
+
+        // Runs into the end of the file and stays there
+        std::vector<std::uint8_t> pcm(plain.buffer(), plain.buffer() + first);
+        int ret{ 0 };
+        while ((ret = plain.Decode()) >= 0)
+        {
+            pcm.insert(pcm.end(), plain.buffer(), plain.buffer() + ret);
+        }
+
+        expect (ret == -1);
+        expect (plain.Decode() == -1);
+        expect (pcm.size() > 0_ul);
+
+        // A seek brings it back
+        plain.Seek(0);
+        expect (plain.Decode() > 0);
+
+        // And lands on the exact sample, however far it is from a packet boundary
+        const auto frame_bytes = BytesPerSecond(settings) / static_cast<std::size_t>(settings.freq);
+        for (std::int64_t sample : { 12345l, 1l, 777l })
+        {
+            const auto at = static_cast<std::size_t>(sample) * frame_bytes;
+
+            plain.Seek(sample);
+            const auto len = plain.Decode();
+
+            expect (len > 0);
+            expect (std::equal(plain.buffer(), plain.buffer() + std::min<std::size_t>(static_cast<std::size_t>(len), pcm.size() - at),
+                               pcm.begin() + static_cast<std::ptrdiff_t>(at)));
+        }
+
+        expect (throws<std::runtime_error>([&] { Decoder d{ incorrect, pools }; }));
+
+        // Two decoders are still holding on to theirs
+        expect (pools.frames.available() == 2_ul);
+        expect (pools.packets.available() == 2_ul);
+    };
+
     "AudioLoop"_test = [&]
     {
         notcurses_options opts{ .termtype = nullptr,
@@ -82,14 +152,17 @@ int main()
 
         tMus::Init();
         tMus::InitLog();
-        auto should_not_fail = [&] { AudioLoop p{ correct }; };
+
+        // Every loop below attaches to the same stream
+        PlaybackEngine engine;
+        auto should_not_fail = [&] { AudioLoop p{ correct, engine }; };
 
         expect(nothrow(should_not_fail));
 
         auto can_be_stopped = [&](std::stop_token st)
         {
-            AudioLoop loop{ correct };
-            loop.consumer_loop(st);
+            AudioLoop loop{ correct, engine };
+            loop.control_loop(st);
         };
 
         std::jthread th{ can_be_stopped };
@@ -106,4 +179,47 @@ int main()
 
         expect (th.joinable() == false);
     };
+
+    "Engine"_test = [&]
+    {
+        notcurses_options opts{ .termtype = nullptr,
+                                .loglevel = NCLOGLEVEL_FATAL,
+                                .margin_t = 0, .margin_r = 0,
+                                .margin_b = 0, .margin_l = 0,
+                                .flags = NCOPTION_SUPPRESS_BANNERS,
+        };
+
+        ncpp::NotCurses nc{ opts };
+
+        tMus::Init();
+        tMus::InitLog();
+
+        Globals::stop_request = false;
+
+        std::atomic<int> errors{ 0 };
+        PlaybackEngine engine;
+        engine.SetErrorHandler([&](std::string_view) { errors++; });
+
+        // Skipping through tracks never waits for the one that is playing
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < 20; i++)
+        {
+            engine.Load(i % 5 == 4 ? incorrect : correct, { correct });
+        }
+        engine.Stop();
+        engine.Load(incorrect);
+
+        expect (std::chrono::steady_clock::now() - start < std::chrono::milliseconds{ 100 });
+
+        // The last request fails to open, whatever was picked up before it
+        for (int i = 0; i < 200 and errors == 0; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds{ 10 });
+        }
+
+        expect (errors >= 1);
+
+        // Going away in the middle of a track takes it down as well
+        engine.Load(correct);
+    };
 }
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "ut.hpp"
+
+#include "BufferGovernor.hpp"
+
+using namespace boost::ut;
+
+int main()
+{
+    using namespace std::chrono_literals;
+
+    // Starts well away from the epoch, so the first raise is not in a cooldown
+    const BufferGovernor::clock::time_point start{ 1h };
+
+    "Raise"_test = [&]
+    {
+        BufferGovernor governor{ 60s, 5s };
+
+        expect (not governor.update(start, 0, 0, false));
+        expect (governor.scale() == 1);
+
+        expect (governor.update(start + 1s, 3, 0, false));
+        expect (governor.scale() == 2);
+
+        // Still the same burst, the ring didn't get the time to fill up
+        expect (not governor.update(start + 2s, 5, 0, false));
+        expect (governor.level() == 1);
+
+        expect (governor.update(start + 8s, 6, 0, false));
+        expect (governor.update(start + 20s, 7, 0, false) == false);
+        expect (governor.level() == BufferGovernor::MaxLevel);
+        expect (governor.underruns() == 7_ul);
+    };
+
+    "Settling"_test = [&]
+    {
+        BufferGovernor governor{ 60s, 5s };
+
+        // A seek emptied the ring, those are skipped for good
+        expect (not governor.update(start, 4, 1, true));
+        expect (not governor.update(start + 1s, 4, 1, false));
+        expect (governor.level() == 0);
+        expect (governor.underruns() == 0_ul);
+        expect (governor.near_misses() == 0_ul);
+    };
+
+    "Lower"_test = [&]
+    {
+        BufferGovernor governor{ 60s, 5s };
+
+        expect (governor.update(start, 1, 0, false));
+        expect (governor.update(start + 10s, 2, 0, false));
+
+        // Near misses keep it where it is
+        expect (not governor.update(start + 50s, 2, 3, false));
+        expect (not governor.update(start + 100s, 2, 3, false));
+        expect (governor.level() == 2);
+
+        expect (governor.update(start + 111s, 2, 3, false));
+        expect (governor.level() == 1);
+
+        // One step per quiet period
+        expect (not governor.update(start + 112s, 2, 3, false));
+        expect (governor.update(start + 171s, 2, 3, false));
+        expect (governor.level() == 0);
+        expect (not governor.update(start + 500s, 2, 3, false));
+    };
+}
@@ -43,6 +43,12 @@ q     = quit
 
 [Audio]
 volume = 30
+profile = low-latency
+buffer_high_ms = 800
+
+[Affinity]
+producer = 0
+output   = 1-2
 )"};
 
         if (not fs::exists("/tmp/tmus-test/"))
@@ -64,5 +70,39 @@ volume = 30
 
         fs::path config_path{ "/tmp/tmus-test/test" };
         Config cfg{ config_path, cmd_proc };
+
+        // The profile fills in what isn't set on its own
+        const auto buffers = cfg.GetBufferSettings();
+        expect (buffers.output.quantum == 256);
+        expect (buffers.output.buffers == 2);
+        expect (buffers.high_watermark_ms == 800);
+        expect (buffers.low_watermark_ms == 250);
+        expect (buffers.prebuffer_ms == 50);
+
+        // Threads left out get the CPUs the process started with
+        expect (rt::FormatCpuList(buffers.affinity.producer) == "0");
+        expect (rt::FormatCpuList(buffers.affinity.output) == "1-2");
+        expect (buffers.affinity.ui == rt::Affinity(pthread_self()));
+    };
+
+    "LatencyProfiles"_test = []
+    {
+        expect (FindLatencyProfile("power-save") != nullptr);
+        expect (FindLatencyProfile("fast") == nullptr);
+
+        // The defaults are the balanced profile
+        const BufferSettings defaults{};
+        const auto* balanced = FindLatencyProfile("balanced");
+        expect (balanced->high_watermark_ms == defaults.high_watermark_ms);
+        expect (balanced->low_watermark_ms == defaults.low_watermark_ms);
+        expect (balanced->prebuffer_ms == defaults.prebuffer_ms);
+        expect (balanced->output.quantum == defaults.output.quantum);
+        expect (balanced->output.buffers == defaults.output.buffers);
+
+        for (const auto& profile : LatencyProfiles)
+        {
+            expect (profile.low_watermark_ms <= profile.high_watermark_ms);
+            expect (profile.prebuffer_ms <= profile.high_watermark_ms);
+        }
     };
 }
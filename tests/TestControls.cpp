@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "CommandProcessor.hpp"
+#include "Controls.hpp"
+#include "globals.hpp"
+#include "util.hpp"
+
+#include <thread>
+#include <vector>
+
+using namespace boost::ut;
+
+int main()
+{
+    "SeekTargetParse"_test = []
+    {
+        using Kind = SeekTarget::Kind;
+
+        auto parsed = [](std::string_view str, Kind kind, double value)
+        {
+            const auto target = SeekTarget::Parse(str);
+            return target and target->kind == kind and target->value == value;
+        };
+
+        expect (parsed("1:23.5",    Kind::ABSOLUTE, 83.5));
+        expect (parsed("1:02:03",   Kind::ABSOLUTE, 3723.0));
+        expect (parsed("90",        Kind::ABSOLUTE, 90.0));
+        expect (parsed("+30",       Kind::RELATIVE, 30.0));
+        expect (parsed("-5",        Kind::RELATIVE, -5.0));
+        expect (parsed("-1:30",     Kind::RELATIVE, -90.0));
+        expect (parsed("42%",       Kind::PERCENT,  42.0));
+        expect (parsed("  12.25 ",  Kind::ABSOLUTE, 12.25));
+
+        for (std::string_view bad : { "", "abc", "1:75", "1.5:00", "101%", "+", "1:2:3:4", "--5", "5s", "-5%" })
+        {
+            expect (not SeekTarget::Parse(bad)) << bad;
+        }
+    };
+
+    "SeekTargetResolve"_test = []
+    {
+        const SeekTarget back{ .kind = SeekTarget::Kind::RELATIVE, .value = -10.0 };
+        const SeekTarget half{ .kind = SeekTarget::Kind::PERCENT,  .value = 50.0 };
+        const SeekTarget past{ .kind = SeekTarget::Kind::ABSOLUTE, .value = 500.0 };
+
+        expect (back.Resolve(25.0, 200.0) == 15.0);
+        expect (back.Resolve(4.0, 200.0) == 0.0);
+        expect (half.Resolve(25.0, 200.0) == 100.0);
+        expect (past.Resolve(25.0, 200.0) == 200.0);
+
+        // Without a duration only percentages are lost
+        expect (not half.Resolve(25.0, 0.0));
+        expect (past.Resolve(25.0, 0.0) == 500.0);
+    };
+
+    "ControlQueueCoalesce"_test = []
+    {
+        using Kind = SeekTarget::Kind;
+        ControlQueue queue;
+
+        for (int i = 0; i < 5; i++)
+            queue.Push(Control::Volume(+0.01f));
+
+        queue.Push(Control::Seek({ .kind = Kind::RELATIVE, .value = 10.0 }));
+        queue.Push(Control::Seek({ .kind = Kind::RELATIVE, .value = -3.0 }));
+        queue.Push(Control::Pause());
+        queue.Push(Control::Pause());
+        queue.Push(Control::Seek({ .kind = Kind::RELATIVE, .value = 1.0 }));
+        queue.Push(Control::Seek({ .kind = Kind::PERCENT,  .value = 50.0 }));
+        queue.Push(Control::Seek({ .kind = Kind::RELATIVE, .value = 5.0 }));
+        queue.Push(Control::Pause());
+
+        std::vector<Control> got;
+        queue.Drain([&](const Control& command) { got.push_back(command); });
+
+        // Nothing is lost, neighbours that amount to one are folded
+        expect (fatal (got.size() == 4_ul));
+        expect (got[0].kind == Control::Kind::VOLUME);
+        expect (got[0].volume_delta > 0.049f and got[0].volume_delta < 0.051f);
+
+        // The pause pair cancelled out, the relative seeks around it were added up
+        // until a percentage replaced them, which can't take more relative ones
+        expect (got[1].kind == Control::Kind::SEEK);
+        expect (got[1].seek.kind == Kind::PERCENT and got[1].seek.value == 50.0);
+        expect (got[2].kind == Control::Kind::SEEK);
+        expect (got[2].seek.kind == Kind::RELATIVE and got[2].seek.value == 5.0);
+        expect (got[3].kind == Control::Kind::PAUSE);
+
+        expect (queue.stats().coalesced == 9_ul);
+        expect (queue.stats().dropped == 0_ul);
+
+        // Once drained it stays empty
+        got.clear();
+        queue.Drain([&](const Control& command) { got.push_back(command); });
+        expect (got.empty());
+    };
+
+    "ControlQueueFull"_test = []
+    {
+        ControlQueue queue;
+
+        for (std::size_t i = 0; i < ControlQueue::Capacity; i++)
+            expect (queue.Push(Control::Pause()));
+
+        expect (not queue.Push(Control::Pause()));
+        expect (queue.stats().dropped == 1_ul);
+
+        // Every pause cancels the one before it
+        std::size_t handled{ 0 };
+        queue.Drain([&](const Control&) { handled++; });
+        expect (handled == 0_ul);
+        expect (queue.Push(Control::Pause()));
+    };
+
+    "ControlCommandDropped"_test = []
+    {
+        CommandProcessor proc;
+        proc.registerCommand("pause", std::make_shared<Pause>());
+        proc.registerCommand("seek", std::make_shared<Seek>());
+
+        for (std::size_t i = 0; i < ControlQueue::Capacity; i++)
+            expect (Globals::controls.Push(Control::Pause()));
+
+        // A full queue is reported as such, not as a bad argument
+        expect (not proc.processCommand("pause").has_value());
+        expect (proc.takeReport() == "Playback is busy, the command was dropped");
+        expect (proc.processCommand("seek abc") == std::optional<std::string>{ "Incorrect argument: abc" });
+
+        Globals::controls.Drain([](const Control&) { });
+        expect (not proc.processCommand("seek +5").has_value());
+        expect (proc.takeReport().empty());
+
+        // Idle, nothing is kept for the next track to trip over
+        Globals::controls.Close();
+        for (std::size_t i = 0; i <= ControlQueue::Capacity; i++)
+            expect (not proc.processCommand("pause").has_value());
+        expect (proc.takeReport() == "Nothing is playing");
+
+        Globals::controls.Open();
+        std::size_t handled{ 0 };
+        Globals::controls.Drain([&](const Control&) { handled++; });
+        expect (handled == 0_ul);
+        expect (Globals::controls.stats().stale == 1_ul);
+    };
+
+    "ControlQueueClosed"_test = []
+    {
+        ControlQueue queue;
+        expect (queue.IsOpen());
+        expect (queue.Push(Control::Pause()));
+
+        // What got in before closing is thrown away on opening
+        queue.Close();
+        expect (not queue.Push(Control::Volume(+0.01f)));
+        expect (queue.stats().dropped == 0_ul);
+
+        queue.Open();
+        std::size_t handled{ 0 };
+        queue.Drain([&](const Control&) { handled++; });
+        expect (handled == 0_ul);
+        expect (queue.stats().stale == 1_ul);
+
+        expect (queue.Push(Control::Pause()));
+        queue.Drain([&](const Control&) { handled++; });
+        expect (handled == 1_ul);
+    };
+
+    "ControlQueueThreads"_test = []
+    {
+        constexpr int Writers{ 4 };
+        constexpr int PerWriter{ 10'000 };
+        ControlQueue queue;
+
+        std::vector<std::jthread> writers;
+        for (int w = 0; w < Writers; w++)
+        {
+            writers.emplace_back([&]
+            {
+                for (int i = 0; i < PerWriter; i++)
+                {
+                    while (not queue.Push(Control::Volume(1.f)))
+                        std::this_thread::yield();
+                }
+            });
+        }
+
+        // Whatever got folded, every delta arrives exactly once
+        double total{ 0.0 };
+        std::stop_source stop;
+        while (total < Writers * PerWriter)
+        {
+            queue.WaitFor(stop.get_token(), std::chrono::milliseconds{ 10 });
+            queue.Drain([&](const Control& command) { total += command.volume_delta; });
+        }
+
+        writers.clear();
+        expect (total == static_cast<double>(Writers * PerWriter));
+    };
+
+    "ControlQueueParked"_test = []
+    {
+        using namespace std::chrono_literals;
+        ControlQueue queue;
+
+        std::atomic<int> handled{ 0 };
+        std::jthread loop{ [&](std::stop_token st)
+        {
+            while (not st.stop_requested())
+            {
+                queue.Wait(st);
+                queue.Drain([&](const Control&) { handled++; });
+            }
+        } };
+
+        std::this_thread::sleep_for(50ms);
+
+        // Nothing queued, nothing wakes the loop
+        const auto from = util::Wakeups();
+        std::this_thread::sleep_for(300ms);
+        expect (util::Wakeups() - from <= 2_ul);
+
+        queue.Push(Control::Volume(0.01f));
+        while (handled == 0)
+            std::this_thread::yield();
+
+        expect (handled.load() == 1_i);
+    };
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "Mailbox.hpp"
+
+#include <atomic>
+#include <thread>
+
+using namespace boost::ut;
+
+int main()
+{
+    struct Value
+    {
+        std::uint64_t serial{};
+        std::uint64_t check{};
+    };
+
+    "LatestWins"_test = []
+    {
+        Mailbox<Value> mailbox;
+        expect (not mailbox.take().has_value());
+
+        mailbox.post({ 1, 1 });
+        mailbox.post({ 2, 2 });
+        mailbox.post({ 3, 3 });
+
+        const auto value = mailbox.take();
+        expect (fatal (value.has_value()));
+        expect (value->serial == 3_ul);
+
+        // Taken once only
+        expect (not mailbox.take().has_value());
+
+        mailbox.post({ 4, 4 });
+        expect (mailbox.take()->serial == 4_ul);
+    };
+
+    "Threads"_test = []
+    {
+        constexpr std::uint64_t total{ 1'000'000 };
+        Mailbox<Value> mailbox;
+
+        std::jthread writer{ [&]
+        {
+            for (std::uint64_t i = 1; i <= total; i++)
+                mailbox.post({ i, ~i });
+        } };
+
+        // Never torn and never older than what was taken before
+        std::uint64_t last{ 0 };
+        bool consistent{ true };
+        while (last < total)
+        {
+            if (const auto value = mailbox.take())
+            {
+                consistent &= value->check == ~value->serial and value->serial > last;
+                last = value->serial;
+            }
+        }
+
+        expect (consistent);
+        expect (last == total);
+    };
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "MappedIO.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace boost::ut;
+namespace fs = std::filesystem;
+
+int main()
+{
+    const auto path = fs::path("tests/misc/output.wav");
+
+    "Reads"_test = [&]
+    {
+        std::ifstream file{ path, std::ios::binary };
+        const std::vector<std::uint8_t> expected{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+
+        const auto io = MappedIO::Open(path);
+        expect (fatal (io != nullptr));
+        expect (io->size() == expected.size());
+
+        auto* pb = io->get();
+        expect (avio_size(pb) == static_cast<std::int64_t>(expected.size()));
+
+        // Both through avio's own buffer and straight into ours
+        std::vector<std::uint8_t> got(expected.size());
+        const auto head = avio_read(pb, got.data(), 16);
+        const auto rest = avio_read(pb, got.data() + 16, static_cast<int>(got.size()) - 16);
+
+        expect (head == 16_i);
+        expect (rest == static_cast<int>(expected.size()) - 16);
+        expect (got == expected);
+        expect (avio_feof(pb) or avio_r8(pb) == 0_i);
+    };
+
+    "Seeks"_test = [&]
+    {
+        std::ifstream file{ path, std::ios::binary };
+        const std::vector<std::uint8_t> expected{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+
+        const auto io = MappedIO::Open(path);
+        expect (fatal (io != nullptr));
+
+        auto* pb = io->get();
+        for (const std::int64_t at : { 1000l, 44l, static_cast<std::int64_t>(expected.size()) - 1 })
+        {
+            expect (avio_seek(pb, at, SEEK_SET) == at);
+            expect (avio_r8(pb) == expected[static_cast<std::size_t>(at)]);
+        }
+
+        expect (avio_seek(pb, -1, SEEK_SET) < 0_l);
+    };
+
+    "Truncated"_test = []
+    {
+        const auto shrunk = fs::temp_directory_path() / "tMusTestMappedIO.shrunk";
+        std::vector<std::uint8_t> expected(6 * 1024 * 1024);
+        for (std::size_t i = 0; i < expected.size(); i++)
+            expected[i] = static_cast<std::uint8_t>(i * 7);
+
+        {
+            std::ofstream file{ shrunk, std::ios::binary };
+            file.write(reinterpret_cast<const char*>(expected.data()), static_cast<std::streamsize>(expected.size()));
+        }
+
+        const auto io = MappedIO::Open(shrunk);
+        expect (fatal (io != nullptr));
+
+        // Rewritten in place while it plays, past the window that was checked on opening
+        constexpr std::size_t left{ 3 * 1024 * 1024 + 1234 };
+        fs::resize_file(shrunk, left);
+
+        // Ends where the file ends now, instead of a SIGBUS
+        auto* pb = io->get();
+        std::vector<std::uint8_t> got(expected.size());
+        expect (avio_read(pb, got.data(), static_cast<int>(got.size())) == static_cast<int>(left));
+        expect (std::equal(got.begin(), got.begin() + left, expected.begin()));
+        expect (io->size() == left);
+
+        fs::remove(shrunk);
+    };
+
+    "FallsBack"_test = []
+    {
+        const auto fifo = fs::temp_directory_path() / "tMusTestMappedIO.fifo";
+        fs::remove(fifo);
+        expect (mkfifo(fifo.c_str(), 0600) == 0_i);
+
+        // Left to libavformat's own I/O
+        expect (MappedIO::Open(fifo) == nullptr);
+        expect (MappedIO::Open("/dev/null") == nullptr);
+        expect (MappedIO::Open(fs::temp_directory_path()) == nullptr);
+        expect (MappedIO::Open("meow") == nullptr);
+
+        fs::remove(fifo);
+    };
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "PlaybackClock.hpp"
+
+using namespace boost::ut;
+
+int main()
+{
+    // 4 bytes a frame at 1000 frames a second, so 1ms is 4 bytes
+    constexpr std::uint32_t Stride{ 4 };
+    constexpr std::uint64_t BytesPerSecond{ 4000 };
+    constexpr std::int64_t Ms{ 1'000'000 };
+
+    auto heard = [](const PlaybackClock& clock, std::uint32_t generation, std::int64_t now_ns)
+    {
+        return clock.position(generation, now_ns).value_or(~0ul);
+    };
+
+    "NothingYet"_test = [&]
+    {
+        PlaybackClock clock;
+        expect (not clock.position(0, 0).has_value());
+
+        clock.restart(1, Stride, BytesPerSecond);
+        clock.update(10 * Ms, 0);
+        expect (not clock.position(1, 10 * Ms).has_value());
+    };
+
+    "Latency"_test = [&]
+    {
+        PlaybackClock clock;
+        clock.restart(1, Stride, BytesPerSecond);
+
+        // Three blocks of 100 frames, 150 of them still ahead of the speaker
+        for (std::uint64_t i = 0; i < 3; i++)
+            clock.append(i * 400, 100, 100);
+
+        clock.update(1000 * Ms, 150);
+        expect (heard(clock, 1, 1000 * Ms) == 600_ul);
+
+        // Moves on with the time, but only over audio that was handed out
+        expect (heard(clock, 1, 1010 * Ms) == 640_ul);
+        expect (heard(clock, 1, 2000 * Ms) == 1200_ul);
+
+        // Older than what was published
+        expect (heard(clock, 1, 900 * Ms) == 600_ul);
+
+        // Another source was attached in the meantime
+        expect (not clock.position(2, 1000 * Ms).has_value());
+    };
+
+    "Underrun"_test = [&]
+    {
+        PlaybackClock clock;
+        clock.restart(1, Stride, BytesPerSecond);
+
+        // Half a block of audio, then silence that doesn't move the source
+        clock.append(0, 100, 100);
+        clock.append(400, 50, 100);
+        clock.append(0, 0, 100);
+
+        clock.update(1000 * Ms, 200);
+        expect (heard(clock, 1, 1000 * Ms) == 400_ul);
+        expect (heard(clock, 1, 1100 * Ms) == 600_ul);
+
+        // Heard up to the last real frame, then it stands still
+        clock.update(1100 * Ms, 50);
+        expect (heard(clock, 1, 1100 * Ms) == 600_ul);
+        expect (heard(clock, 1, 1500 * Ms) == 600_ul);
+    };
+
+    "Reposition"_test = [&]
+    {
+        PlaybackClock clock;
+        clock.restart(1, Stride, BytesPerSecond);
+
+        // A discard jumped the source ahead, a rewind sent it back
+        clock.append(0, 100, 100);
+        clock.append(10'000, 100, 100);
+        clock.append(4'000, 100, 100);
+
+        clock.update(1000 * Ms, 250);
+        expect (heard(clock, 1, 1000 * Ms) == 200_ul);
+
+        // Not beyond the end of the block, the next one is elsewhere in the source
+        expect (heard(clock, 1, 1500 * Ms) == 400_ul);
+
+        clock.update(1050 * Ms, 150);
+        expect (heard(clock, 1, 1050 * Ms) == 10'200_ul);
+
+        clock.update(1100 * Ms, 90);
+        expect (heard(clock, 1, 1100 * Ms) == 4'040_ul);
+
+        // Blocks of a previous source are gone
+        clock.restart(2, Stride, BytesPerSecond);
+        clock.append(0, 100, 100);
+        clock.update(1200 * Ms, 1000);
+        expect (heard(clock, 2, 1200 * Ms) == 0_ul);
+        expect (heard(clock, 2, 1210 * Ms) == 40_ul);
+    };
+}
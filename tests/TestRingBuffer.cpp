@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+using namespace boost::ut;
+
+int main()
+{
+    "Capacity"_test = []
+    {
+        RingBuffer ring{ 1000, 800, 200 };
+
+        expect (ring.capacity() == 1024_ul);
+        expect (ring.empty());
+        expect (ring.space() == 1024_ul);
+    };
+
+    "WrapAround"_test = []
+    {
+        RingBuffer ring{ 64, 64, 0 };
+
+        std::vector<std::uint8_t> in(48);
+        std::iota(in.begin(), in.end(), std::uint8_t{ 0 });
+
+        std::vector<std::uint8_t> out(48);
+
+        expect (ring.write(in.data(), in.size()) == 48_ul);
+        expect (ring.read(out.data(), 40) == 40_ul);
+
+        // This write crosses the end of the storage
+        expect (ring.write(in.data(), in.size()) == 48_ul);
+        expect (ring.size() == 56_ul);
+
+        // Only the part up to the end of the storage is contiguous
+        expect (ring.peek().size() == 24_ul);
+
+        ring.consume(8);
+        expect (ring.read(out.data(), out.size()) == 48_ul);
+        expect (out == in);
+        expect (ring.empty());
+    };
+
+    "Full"_test = []
+    {
+        RingBuffer ring{ 64, 64, 0 };
+        std::vector<std::uint8_t> in(100, 7);
+
+        expect (ring.write(in.data(), in.size()) == 64_ul);
+        expect (ring.write(in.data(), in.size()) == 0_ul);
+
+        // Applied by the consumer on its next read
+        ring.discard();
+        expect (ring.peek().empty());
+        expect (ring.empty());
+    };
+
+    "DiscardFreesSpace"_test = []
+    {
+        RingBuffer ring{ 64, 64, 0 };
+        std::vector<std::uint8_t> in(64, 7);
+        std::vector<std::uint8_t> out(64);
+
+        // The producer doesn't have to wait for the consumer, e.g. a seek while paused
+        expect (ring.write(in.data(), in.size()) == 64_ul);
+        ring.discard();
+        expect (ring.empty());
+        expect (ring.space() == 64_ul);
+
+        std::fill(in.begin(), in.end(), std::uint8_t{ 9 });
+        expect (ring.write(in.data(), 32) == 32_ul);
+        expect (ring.read(out.data(), out.size()) == 32_ul);
+        expect (std::all_of(out.begin(), out.begin() + 32, [](auto b) { return b == 9; }));
+
+        // Not while the consumer may still be copying the discarded bytes
+        expect (ring.write(in.data(), in.size()) == 64_ul);
+        const auto chunk = ring.peek();
+        ring.discard();
+        expect (ring.space() == 0_ul);
+        ring.consume(chunk.size());
+        expect (ring.space() == 64_ul);
+    };
+
+    "History"_test = []
+    {
+        RingBuffer ring{ 64, 64, 0, 64 };
+        std::vector<std::uint8_t> in(64);
+        std::iota(in.begin(), in.end(), std::uint8_t{ 0 });
+
+        std::vector<std::uint8_t> out(64);
+
+        // The history is kept on top of what can be queued
+        expect (ring.capacity() == 128_ul);
+        expect (ring.write(in.data(), in.size()) == 64_ul);
+        expect (ring.space() == 0_ul);
+
+        expect (ring.read(out.data(), 48) == 48_ul);
+        expect (ring.history() == 48_ul);
+
+        // What was read is not overwritten, the same bytes play again
+        expect (ring.write(in.data(), in.size()) == 48_ul);
+        ring.rewind(16);
+        expect (ring.read(out.data(), 32) == 32_ul);
+        expect (std::equal(out.begin(), out.begin() + 32, in.begin() + 32));
+
+        // Only as far back as there is history
+        expect (ring.history() == 64_ul);
+        ring.rewind(1000);
+        expect (ring.peek().size() == 112_ul);
+        expect (ring.history() == 0_ul);
+        expect (ring.space() == 0_ul);
+
+        // Nothing before a discard is worth going back to
+        ring.read(out.data(), 16);
+        ring.discard();
+        ring.rewind(16);
+        expect (ring.peek().empty());
+        expect (ring.history() == 0_ul);
+    };
+
+    "Watermarks"_test = []
+    {
+        RingBuffer ring{ 256, 192, 64 };
+        std::vector<std::uint8_t> buf(256);
+
+        expect (ring.below_low_watermark());
+        expect (not ring.above_high_watermark());
+
+        ring.write(buf.data(), 192);
+        expect (ring.above_high_watermark());
+        expect (not ring.below_low_watermark());
+
+        ring.read(buf.data(), 128);
+        expect (not ring.above_high_watermark());
+        expect (ring.below_low_watermark());
+    };
+
+    "MoveWatermarks"_test = []
+    {
+        RingBuffer ring{ 192, 128, 64, 64 };
+        std::vector<std::uint8_t> buf(256);
+
+        ring.write(buf.data(), 100);
+        expect (not ring.below_low_watermark());
+
+        // A producer throttled at the old high watermark has to fill up again
+        const auto epoch = ring.producer_epoch();
+        ring.set_watermarks(192, 160);
+        expect (ring.producer_epoch() != epoch);
+        expect (ring.below_low_watermark());
+
+        // Never more than can be queued on top of the history
+        ring.set_watermarks(1000, 1000);
+        expect (ring.high_watermark() == 192_ul);
+
+        ring.set_watermarks(64, 128);
+        expect (ring.high_watermark() == 64_ul);
+        expect (ring.above_high_watermark());
+        expect (not ring.below_low_watermark());
+    };
+
+    "ProducerWakeup"_test = []
+    {
+        RingBuffer ring{ 256, 192, 64 };
+        std::vector<std::uint8_t> buf(256);
+
+        ring.write(buf.data(), 192);
+
+        const auto epoch = ring.producer_epoch();
+        std::jthread producer{ [&] { ring.wait_producer(epoch); } };
+
+        // Still above the low watermark, no wakeup
+        ring.read(buf.data(), 64);
+        expect (ring.producer_epoch() == epoch);
+
+        ring.read(buf.data(), 64);
+        expect (ring.producer_epoch() != epoch);
+
+        producer.join();
+        expect (not producer.joinable());
+    };
+
+    "ProducerConsumer"_test = []
+    {
+        constexpr std::size_t total{ 1 << 20 };
+        RingBuffer ring{ 4096, 4096, 0 };
+
+        std::jthread producer{ [&]
+        {
+            std::array<std::uint8_t, 1000> chunk{};
+            std::size_t sent{ 0 };
+
+            while (sent < total)
+            {
+                const auto n = std::min(chunk.size(), total - sent);
+                for (std::size_t i = 0; i < n; i++)
+                    chunk[i] = static_cast<std::uint8_t>((sent + i) & 0xFF);
+
+                std::size_t done{ 0 };
+                while (done < n)
+                    done += ring.write(chunk.data() + done, n - done);
+
+                sent += n;
+            }
+        } };
+
+        std::size_t received{ 0 };
+        bool in_order{ true };
+        std::array<std::uint8_t, 777> chunk{};
+
+        while (received < total)
+        {
+            const auto n = ring.read(chunk.data(), chunk.size());
+            for (std::size_t i = 0; i < n; i++)
+                in_order &= chunk[i] == static_cast<std::uint8_t>((received + i) & 0xFF);
+
+            received += n;
+        }
+
+        expect (in_order);
+        expect (ring.empty());
+    };
+}
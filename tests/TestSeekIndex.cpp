@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "SeekIndex.hpp"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <vector>
+
+using namespace boost::ut;
+namespace fs = std::filesystem;
+
+namespace
+{
+    // MPEG-1 layer III, 128 kbit/s, 44.1 kHz, stereo: 417 bytes and 1152 samples
+    constexpr std::size_t Mp3FrameLength{ 417 };
+
+    std::vector<std::uint8_t> Mp3Frame(bool info = false)
+    {
+        std::vector<std::uint8_t> frame(Mp3FrameLength, 0);
+        frame[0] = 0xFF;
+        frame[1] = 0xFB;
+        frame[2] = 0x90;
+        frame[3] = 0x00;
+
+        if (info)
+        {
+            std::copy_n("Xing", 4, frame.begin() + 4 + 32);
+        }
+
+        return frame;
+    }
+
+    // AAC LC, 44.1 kHz, stereo, one raw block of 1024 samples
+    std::vector<std::uint8_t> AdtsFrame(std::size_t length)
+    {
+        std::vector<std::uint8_t> frame(length, 0);
+        frame[0] = 0xFF;
+        frame[1] = 0xF1;
+        frame[2] = 0x50;
+        frame[3] = static_cast<std::uint8_t>(0x80 | (length >> 11));
+        frame[4] = static_cast<std::uint8_t>(length >> 3);
+        frame[5] = static_cast<std::uint8_t>((length & 0x7) << 5 | 0x1F);
+        frame[6] = 0xFC;
+
+        return frame;
+    }
+
+    void Append(std::vector<std::uint8_t>& out, const std::vector<std::uint8_t>& in)
+    {
+        out.insert(out.end(), in.begin(), in.end());
+    }
+
+    void WriteFile(const fs::path& path, const std::vector<std::uint8_t>& data)
+    {
+        std::ofstream out{ path, std::ios::binary | std::ios::trunc };
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+}
+
+int main()
+{
+    const auto dir = fs::temp_directory_path() / "tMusTestSeekIndex";
+    fs::create_directories(dir);
+    setenv("XDG_CACHE_HOME", dir.c_str(), 1);
+
+    "FindSync"_test = []
+    {
+        std::mt19937 rng{ 42 };
+        std::vector<std::uint8_t> data(4099);
+        for (auto& byte : data)
+            byte = static_cast<std::uint8_t>(rng());
+
+        auto naive = [&](std::size_t from)
+        {
+            for (std::size_t i = from; i + 1 < data.size(); i++)
+            {
+                if (data[i] == 0xFF and (data[i + 1] & 0xE0) == 0xE0)
+                    return i;
+            }
+
+            return data.size();
+        };
+
+        bool same{ true };
+        for (std::size_t from = 0; from <= data.size(); from++)
+            same &= SeekIndex::FindSync(data, from) == naive(from);
+
+        expect (same);
+
+        // Across a block boundary and right at the end
+        std::vector<std::uint8_t> zeros(64, 0);
+        zeros[31] = 0xFF;
+        zeros[32] = 0xE2;
+        expect (SeekIndex::FindSync(zeros, 0) == 31_ul);
+
+        zeros[62] = 0xFF;
+        zeros[63] = 0xF0;
+        expect (SeekIndex::FindSync(zeros, 32) == 62_ul);
+        expect (SeekIndex::FindSync(zeros, 63) == 64_ul);
+    };
+
+    "Mp3Frames"_test = [&]
+    {
+        // ID3v2 tag with 20 bytes of payload, the Xing frame, then audio
+        std::vector<std::uint8_t> file{ 'I', 'D', '3', 4, 0, 0, 0, 0, 0, 20 };
+        file.resize(30, 0);
+        Append(file, Mp3Frame(true));
+
+        const auto audio = static_cast<std::int64_t>(file.size());
+        for (int i = 0; i < 200; i++)
+            Append(file, Mp3Frame());
+
+        // Junk with a stray sync word in it, the scan has to find its way back
+        file.insert(file.end(), { 0x12, 0xFF, 0xE0, 0x00, 0x34 });
+        const auto resumed = static_cast<std::int64_t>(file.size());
+        for (int i = 0; i < 100; i++)
+            Append(file, Mp3Frame());
+
+        const auto path = dir / "frames.mp3";
+        WriteFile(path, file);
+
+        const auto index = SeekIndex::Build(path, SeekIndex::Kind::FRAMES, {});
+        expect (fatal (index.has_value()));
+        expect (index->rate() == 44100_i);
+
+        const auto first = index->Find(0);
+        expect (fatal (first.has_value()));
+        expect (first->offset == audio);
+
+        // Every entry sits right on a frame
+        bool on_frames{ true };
+        for (const auto& entry : index->entries())
+        {
+            const auto frame = entry.time / 1152;
+            const auto expected = frame < 200 ? audio + frame * static_cast<std::int64_t>(Mp3FrameLength)
+                                              : resumed + (frame - 200) * static_cast<std::int64_t>(Mp3FrameLength);
+            on_frames &= entry.time % 1152 == 0 and entry.offset == expected;
+        }
+        expect (on_frames);
+
+        // Half a second apart, the last one at or before the target wins
+        const auto mid = index->Find(44100 * 3 + 10);
+        expect (fatal (mid.has_value()));
+        expect (mid->time <= 44100 * 3 + 10 and mid->time > 44100 * 3 + 10 - 44100 / 2 - 1152);
+        expect (not index->Find(-1));
+    };
+
+    "AdtsFrames"_test = [&]
+    {
+        std::vector<std::uint8_t> file;
+        for (std::size_t i = 0; i < 300; i++)
+            Append(file, AdtsFrame(200 + i % 7));
+
+        const auto path = dir / "frames.aac";
+        WriteFile(path, file);
+
+        const auto index = SeekIndex::Build(path, SeekIndex::Kind::FRAMES, {});
+        expect (fatal (index.has_value()));
+        expect (index->rate() == 44100_i);
+
+        const auto last = index->Find(1024 * 300);
+        expect (fatal (last.has_value()));
+        expect (last->time % 1024 == 0_i);
+        expect (last->time > 1024 * 300 - 44100 / 2 - 1024);
+    };
+
+    "Cache"_test = [&]
+    {
+        std::vector<std::uint8_t> file;
+        for (int i = 0; i < 100; i++)
+            Append(file, Mp3Frame());
+
+        const auto path = dir / "cached.mp3";
+        WriteFile(path, file);
+
+        const auto built = SeekIndex::Build(path, SeekIndex::Kind::FRAMES, {});
+        expect (fatal (built.has_value()));
+        expect (nothrow ([&] { built->Save(); }));
+
+        const auto loaded = SeekIndex::Load(path);
+        expect (fatal (loaded.has_value()));
+        expect (loaded->GetKind() == SeekIndex::Kind::FRAMES);
+        expect (loaded->rate() == built->rate());
+        expect (std::ranges::equal(loaded->entries(), built->entries(),
+                                   [](const auto& a, const auto& b) { return a.time == b.time and a.offset == b.offset; }));
+
+        // A changed file doesn't match its table anymore
+        Append(file, Mp3Frame());
+        WriteFile(path, file);
+        expect (not SeekIndex::Load(path));
+    };
+
+    "Stop"_test = [&]
+    {
+        std::vector<std::uint8_t> file;
+        for (int i = 0; i < 10000; i++)
+            Append(file, Mp3Frame());
+
+        const auto path = dir / "stopped.mp3";
+        WriteFile(path, file);
+
+        std::stop_source stop;
+        stop.request_stop();
+        expect (not SeekIndex::Build(path, SeekIndex::Kind::FRAMES, stop.get_token()));
+    };
+
+    fs::remove_all(dir);
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "UringIO.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <sys/stat.h>
+
+using namespace boost::ut;
+namespace fs = std::filesystem;
+
+int main()
+{
+    // Large enough for plenty of blocks, and not a multiple of one
+    const auto path = fs::temp_directory_path() / "tMusTestUringIO.bin";
+    std::vector<std::uint8_t> expected(3 * 1024 * 1024 + 1234);
+    for (std::size_t i = 0; i < expected.size(); i++)
+        expected[i] = static_cast<std::uint8_t>((i * 31 + i / 4096) & 0xFF);
+
+    {
+        std::ofstream file{ path, std::ios::binary };
+        file.write(reinterpret_cast<const char*>(expected.data()), static_cast<std::streamsize>(expected.size()));
+    }
+
+    constexpr std::size_t Block{ 64 * 1024 };
+
+    "Reads"_test = [&]
+    {
+        const auto io = UringIO::Open(path, 4, Block);
+        expect (fatal (io != nullptr));
+
+        auto* pb = io->get();
+        expect (avio_size(pb) == static_cast<std::int64_t>(expected.size()));
+
+        // Both through avio's own buffer and straight into ours
+        std::vector<std::uint8_t> got(expected.size());
+        const auto head = avio_read(pb, got.data(), 16);
+        const auto rest = avio_read(pb, got.data() + 16, static_cast<int>(got.size()) - 16);
+
+        expect (head == 16_i);
+        expect (rest == static_cast<int>(expected.size()) - 16);
+        expect (got == expected);
+        expect (avio_feof(pb) or avio_r8(pb) == 0_i);
+
+        // Everything was read once. More than one read was queued before the
+        // first one was reaped, whether the storage served them in parallel
+        // is not something these counters can tell.
+        const auto stats = io->stats();
+        expect (stats.bytes == expected.size());
+        expect (stats.reads == (expected.size() + Block - 1) / Block);
+        expect (stats.max_in_flight > 1_u);
+        expect (stats.max_in_flight <= 5_u);
+        expect (stats.in_flight == 0_u);
+        expect (stats.latency_max_us >= stats.latency_avg_us);
+    };
+
+    "Seeks"_test = [&]
+    {
+        const auto io = UringIO::Open(path, 2, Block);
+        expect (fatal (io != nullptr));
+
+        auto* pb = io->get();
+        const auto last = static_cast<std::int64_t>(expected.size()) - 1;
+        for (const std::int64_t at : { 1000l, last, 44l, 2'000'000l, static_cast<std::int64_t>(Block) - 1, last - 70'000 })
+        {
+            expect (avio_seek(pb, at, SEEK_SET) == at);
+
+            std::vector<std::uint8_t> got(std::min<std::size_t>(100'000, expected.size() - static_cast<std::size_t>(at)));
+            expect (avio_read(pb, got.data(), static_cast<int>(got.size())) == static_cast<int>(got.size()));
+            expect (std::equal(got.begin(), got.end(), expected.begin() + at));
+        }
+
+        expect (avio_seek(pb, -1, SEEK_SET) < 0_l);
+    };
+
+    "Truncated"_test = [&]
+    {
+        const auto shrunk = fs::temp_directory_path() / "tMusTestUringIO.shrunk";
+        fs::copy_file(path, shrunk, fs::copy_options::overwrite_existing);
+
+        const auto io = UringIO::Open(shrunk, 2, Block);
+        expect (fatal (io != nullptr));
+
+        // Rewritten in place while it plays, the new end falls inside a block
+        // well past the ones that may have been read already
+        constexpr std::size_t left{ 8 * Block + 1000 };
+        fs::resize_file(shrunk, left);
+
+        auto* pb = io->get();
+        std::vector<std::uint8_t> got(expected.size());
+        expect (avio_read(pb, got.data(), static_cast<int>(got.size())) == static_cast<int>(left));
+        expect (std::equal(got.begin(), got.begin() + left, expected.begin()));
+        expect (avio_feof(pb));
+
+        fs::remove(shrunk);
+    };
+
+    "FallsBack"_test = []
+    {
+        const auto fifo = fs::temp_directory_path() / "tMusTestUringIO.fifo";
+        fs::remove(fifo);
+        expect (mkfifo(fifo.c_str(), 0600) == 0_i);
+
+        expect (UringIO::Open(fifo, 4, Block) == nullptr);
+        expect (UringIO::Open("/dev/null", 4, Block) == nullptr);
+        expect (UringIO::Open("meow", 4, Block) == nullptr);
+
+        fs::remove(fifo);
+    };
+
+    fs::remove(path);
+}
@@ -19,8 +19,12 @@
 
 #include "ut.hpp"
 #include "util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <print>
+#include <thread>
 
 using namespace boost::ut;
 
@@ -35,4 +39,85 @@ int main()
 
         expect (fs::exists(dir));
     };
+
+    "GetUserCacheDir"_test = []
+    {
+        expect (getenv("HOME") != nullptr or getenv("XDG_CACHE_HOME") != nullptr);
+        auto dir = util::GetUserCacheDir();
+
+        expect (fs::exists(dir));
+        expect (dir.filename() == "tMus");
+    };
+
+    "Wakeups"_test = []
+    {
+        using namespace std::chrono_literals;
+
+        // Every sleep is one wakeup of this thread
+        const auto before = util::Wakeups();
+        for (int i = 0; i < 5; i++)
+            std::this_thread::sleep_for(1ms);
+
+        expect (util::Wakeups() - before >= 5_ul);
+
+        // A parked thread adds nothing, only the sleep below and the final wakeup count
+        std::atomic<bool> go{ false };
+        std::jthread parked{ [&] { go.wait(false); } };
+        std::this_thread::sleep_for(50ms);
+
+        const auto parked_from = util::Wakeups();
+        std::this_thread::sleep_for(300ms);
+        const auto parked_to = util::Wakeups();
+
+        go = true;
+        go.notify_one();
+
+        expect (parked_to - parked_from <= 2_ul);
+    };
+
+    "CpuList"_test = []
+    {
+        const auto cpus = rt::ParseCpuList("0,2-4,7");
+        expect (cpus.has_value());
+        expect (cpus->count() == 5_ul);
+        expect (cpus->test(3) and not cpus->test(5));
+        expect (rt::FormatCpuList(*cpus) == "0,2-4,7");
+
+        expect (rt::FormatCpuList(*rt::ParseCpuList("3")) == "3");
+        expect (rt::FormatCpuList(*rt::ParseCpuList("1,2,3")) == "1-3");
+
+        expect (not rt::ParseCpuList(""));
+        expect (not rt::ParseCpuList("4-2"));
+        expect (not rt::ParseCpuList("1,,2"));
+        expect (not rt::ParseCpuList("a"));
+        expect (not rt::ParseCpuList("100000"));
+    };
+
+    "ThreadAffinities"_test = []
+    {
+        const auto original = rt::Affinity(pthread_self());
+        expect (original.any());
+
+        // A thread that is pinned shows up in the report with its single CPU
+        std::size_t first{ 0 };
+        while (not original.test(first))
+            first++;
+
+        rt::CpuSet one{};
+        one.set(first);
+        const auto cpu = rt::FormatCpuList(one);
+
+        std::atomic<bool> go{ false };
+        std::jthread pinned{ [&] { go.wait(false); } };
+        pthread_setname_np(pinned.native_handle(), "Pinned");
+        expect (rt::Pin(pinned.native_handle(), one));
+        expect (rt::Affinity(pinned.native_handle()) == one);
+
+        const auto threads = util::ThreadAffinities();
+        expect (threads.size() >= 2_ul);
+        expect (std::ranges::any_of(threads, [&](const auto& thread) { return thread.name == "Pinned" and thread.cpus == cpu; }));
+
+        go = true;
+        go.notify_one();
+    };
 }
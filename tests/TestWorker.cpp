@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2023-2025 Dāniels Ponamarjovs <bonux@duck.com>
+ *
+ * This file is part of tMus.
+ *
+ * tMus is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * tMus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with tMus. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ut.hpp"
+
+#include "Worker.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace boost::ut;
+
+int main()
+{
+    "SameThread"_test = []
+    {
+        Worker worker{ "Worker" };
+
+        std::atomic<pthread_t> first{};
+        std::atomic<pthread_t> second{};
+
+        worker.Run([&](std::stop_token) { first = pthread_self(); });
+        worker.Stop();
+
+        worker.Run([&](std::stop_token) { second = pthread_self(); });
+        worker.Stop();
+
+        // Each job has finished by the time Stop() returns, on the one thread
+        expect (pthread_equal(first, second) != 0);
+        expect (pthread_equal(first, worker.native_handle()) != 0);
+    };
+
+    "Stop"_test = []
+    {
+        Worker worker{ "Worker" };
+        std::atomic<int> runs{ 0 };
+
+        for (int i = 0; i < 3; i++)
+        {
+            worker.Run([&](std::stop_token st)
+            {
+                while (not st.stop_requested())
+                    std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+
+                runs++;
+            });
+
+            worker.Stop();
+            expect (runs == i + 1);
+        }
+
+        // Stopping without a job doesn't wait for anything
+        worker.Stop();
+    };
+
+    "Destroy"_test = []
+    {
+        std::atomic<bool> stopped{ false };
+
+        {
+            Worker worker{ "Worker" };
+            worker.Run([&](std::stop_token st)
+            {
+                while (not st.stop_requested())
+                    std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+
+                stopped = true;
+            });
+        }
+
+        expect (stopped.load());
+    };
+}